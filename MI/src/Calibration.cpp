@@ -1,4 +1,6 @@
 #include "Calibration.h"
+#include <algorithm>
+#include <numeric>
 
 #define KDE_METHOD
 //#define CHI_SQUARE_TEST
@@ -6,23 +8,46 @@
 
 namespace perls
 {
-    Calibration::Calibration ()
+    Calibration::Calibration () : Calibration (std::string (), std::string ())
     {
-        /** set intrinsic vectors **/
-        this->intrinsic_vec = Eigen::VectorXd(10);
+    }
 
-        this->intrinsic_vec <<1022.53, 1198.45, /** u0, v0 **/
+    static Eigen::VectorXd default_intrinsic ()
+    {
+        Eigen::VectorXd intrinsic(10);
+        intrinsic <<1022.53, 1198.45, /** u0, v0 **/
                 1880.36, -536.721, -12.9298, -18.0154, 5.6414,
                 1.00176, -0.00863924, 0.00846056;
+        return intrinsic;
+    }
+
+    Calibration::Calibration (const std::string &image_path, const std::string &cloud_path)
+        : Calibration (image_path, cloud_path, default_intrinsic ())
+    {
+    }
+
+    Calibration::Calibration (const std::string &image_path, const std::string &cloud_path,
+                              const Eigen::VectorXd &intrinsic)
+    {
+        this->img_path = image_path;
+        this->point_cloud_org_path = cloud_path;
+
+        /** set intrinsic vectors **/
+        this->intrinsic_vec = intrinsic;
+
+        /** 8-bit grayscale and reflectivity in one bin per level, MLE estimator **/
+        this->m_numBins = MAX_BINS;
+        this->m_binFraction = 1;
+        this->m_estimatorType = 1;
+        this->m_gradientMode = MI_GRADIENT_FULL;
+        this->m_debugOutput = false;
 
         //load images
         load_image ();
         //load scan
         load_point_cloud (this->point_cloud_org_path);
-
-        this->m_jointTarget = cv::Mat::eye (this->m_numBins, this->m_numBins, CV_32FC1)/(this->m_numBins);
-        this->m_grayTarget = cv::Mat::ones (1, this->m_numBins, CV_32FC1)/this->m_numBins;
-        this->m_refcTarget = cv::Mat::ones (1, this->m_numBins, CV_32FC1)/this->m_numBins;
+        //precompute the cost evaluator
+        build_evaluator ();
         return;
     }
    
@@ -34,7 +59,7 @@ namespace perls
         pcl::PointCloud<pcl::PointXYZI>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZI>); /** apply icp result to source point cloud **/
         /** file loading check **/
         if (pcl::io::loadPCDFile<pcl::PointXYZI>(cloud_path, *cloud) == -1) {
-            ROS_ERROR("Could Not Load Target File!\n");
+            std::cerr << "Could Not Load Target File " << cloud_path << std::endl;
         }
         std::cout << "Num of original loaded points = " << cloud->points.size() << std::endl;
 
@@ -62,36 +87,20 @@ namespace perls
         pcl::PointCloud<pcl::PointXYZI>::Ptr cloud_uv_us_corr_xyz(new pcl::PointCloud<pcl::PointXYZI>);
 
         /** projection **/
-        Eigen::Vector3d point_vec;
-        Eigen::Vector2d uv_vec;
-        double theta, uv_radius, xy_radius;
+        OmniProjector projector(this->intrinsic_vec);
+        PointsSoA points;
+        PixelsSoA pixels;
+        std::vector<double> uv_radius(cloud_org->points.size());
+        toPointsSoA(*cloud_org, points);
+        projector.transformProject(R, translation, points, pixels, nullptr, uv_radius.data());
+
         pcl::PointXYZI uv_point;
         for (int i = 0; i < cloud_org->points.size(); i++) {
             uv_point.intensity = cloud_org->points[i].intensity;
-            point_vec << cloud_org->points[i].x, cloud_org->points[i].y, cloud_org->points[i].z;
-            point_vec = R * point_vec + translation;
-
-            /** intrinsic transformation **/
-            Eigen::Vector2d uv_0 = {this->intrinsic_vec(0), this->intrinsic_vec(1)};
-            Eigen::VectorXd a_ = Eigen::VectorXd(5);
-            Eigen::Matrix2d affine;
-            Eigen::Matrix2d affine_inv;
-
-            a_ << this->intrinsic_vec(2), this->intrinsic_vec(3), this->intrinsic_vec(4), this->intrinsic_vec(5), this->intrinsic_vec(6);
-            affine << this->intrinsic_vec(7), this->intrinsic_vec(8), this->intrinsic_vec(9), 1.0;
-
-            theta = acos(point_vec(2) / sqrt((point_vec(0) * point_vec(0)) + (point_vec(1) * point_vec(1)) + (point_vec(2) * point_vec(2))));
-            uv_radius = a_(0) + a_(1) * theta + a_(2) * pow(theta, 2) + a_(3) * pow(theta, 3) + a_(4) * pow(theta, 4);
-            xy_radius = sqrt(point_vec(1) * point_vec(1) + point_vec(0) * point_vec(0));
-            uv_vec = {uv_radius / xy_radius * point_vec(0) + uv_0(0), uv_radius / xy_radius * point_vec(1) + uv_0(1)};
-            affine_inv.row(0) << affine(1, 1) / (affine(0, 0) * affine(1, 1) - affine(1, 0) * affine(0, 1)),
-                    - affine(0, 1) / (affine(0, 0) * affine(1, 1) - affine(1, 0) * affine(0, 1));
-            affine_inv.row(1) << - affine(1, 0) / (affine(0, 0) * affine(1, 1) - affine(1, 0) * affine(0, 1)),
-                    affine(0, 0) / (affine(0, 0) * affine(1, 1) - affine(1, 0) * affine(0, 1));
-            uv_vec = affine_inv * uv_vec;
+            Eigen::Vector2d uv_vec = pixels.row(i);
 
             if (0 <= uv_vec[0] && uv_vec[0] < this->fisheye_img.rows && 0 <= uv_vec[1] && uv_vec[1] < this->fisheye_img.cols) {
-                if (uv_radius > 400 & uv_radius < 1000) {
+                if (uv_radius[i] > 400 & uv_radius[i] < 1000) {
                     /** points on uv plane **/
                     uv_point.x = uv_vec[0];
                     uv_point.y = uv_vec[1];
@@ -103,7 +112,9 @@ namespace perls
             }
         }
         std::cout << "Num of point in uv plane: " << cloud_uv->points.size() << std::endl;
-        pcl::io::savePCDFileBinary(this->cloud_uv_corr_xyz_path, *cloud_uv_corr_xyz);
+        if (!this->cloud_uv_corr_xyz_path.empty()) {
+            pcl::io::savePCDFileBinary(this->cloud_uv_corr_xyz_path, *cloud_uv_corr_xyz);
+        }
 
         /** uniform sampling in cloud_uv **/
         pcl::UniformSampling<pcl::PointXYZI> us(true);
@@ -114,7 +125,9 @@ namespace perls
         pcl::PointIndices indices;
         const pcl::IndicesConstPtr& us_removed_idx = us.getRemovedIndices();
 
-        pcl::io::savePCDFileBinary(this->cloud_uv_us_path, *cloud_uv_us);
+        if (!this->cloud_uv_us_path.empty()) {
+            pcl::io::savePCDFileBinary(this->cloud_uv_us_path, *cloud_uv_us);
+        }
         std::cout << "Num of uniform sampling cloud: " << cloud_uv_us->points.size() << std::endl;
 
         pcl::ExtractIndices<pcl::PointXYZI> extract;
@@ -124,11 +137,11 @@ namespace perls
         extract.filter(*cloud_uv_us_corr_xyz);
         std::cout << "Num of cloud in 3d space corresponding to the uniform sampling cloud in uv plane: " << cloud_uv_us_corr_xyz->points.size() << std::endl;
 
-        pcl::io::savePCDFileBinary(this->cloud_uv_us_corr_xyz_path, *cloud_uv_us_corr_xyz);
+        if (!this->cloud_uv_us_corr_xyz_path.empty()) {
+            pcl::io::savePCDFileBinary(this->cloud_uv_us_corr_xyz_path, *cloud_uv_us_corr_xyz);
+        }
 
-        /** load the saved point cloud **/
-        pcl::io::loadPCDFile(this->cloud_uv_us_path, *cloud_uv_us);
-        pcl::io::loadPCDFile(this->cloud_uv_us_corr_xyz_path, *cloud_uv_us_corr_xyz);
+        /** the sampled cloud is used as filtered, without a round trip through the saved files **/
         this->point_cloud = cloud_uv_us_corr_xyz;
 
 //        double DIST_THRESH = 10000;
@@ -223,190 +236,43 @@ namespace perls
     }
 
     /**
-     * This function computes the smoothed distribution at a given transformation x
+     * This function builds the in-memory cost evaluator from the loaded image and scan.
+     * Call it again after reloading either of them or changing the bins.
      */
-    Histogram Calibration::get_histogram (Eigen::Vector3d translation, Eigen::Vector3d euler) {
-        cv::Mat img = this->fisheye_img;
-        Eigen::Matrix3d R;
-        R = Eigen::AngleAxisd(euler[0], Eigen::Vector3d::UnitZ())
-                       * Eigen::AngleAxisd(euler[1], Eigen::Vector3d::UnitY())
-                       * Eigen::AngleAxisd(euler[2], Eigen::Vector3d::UnitX());
-//        std::cout << "Translation Vector: \n" << translation << std::endl;
-//        std::cout << "Rotation Matrix: \n" << R << std::endl;
-
-        //count the number of points that project onto the valid image region
-        float gray_sum = 0;
-        float refc_sum = 0;
-
-        Histogram hist (this->m_numBins);
-
-        pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = this->point_cloud;
-
-        //Loop over all points
-        Eigen::Vector3d point_vec;
-        Eigen::Vector3d point_trans_vec;
-        Eigen::Vector2d uv_vec;
-        double theta, uv_radius, xy_radius;
-        pcl::PointXYZI point, uv_point;
-
-        /** check of projected points on uv plane **/
-        pcl::PointCloud<pcl::PointXYZI>::Ptr uv_cloud(new pcl::PointCloud<pcl::PointXYZI>);
-
-        std::ofstream gray_outfile;
-        gray_outfile.open(this->gray_path, std::ios::out);
-        std::ofstream refc_outfile;
-        refc_outfile.open(this->refc_path, std::ios::out);
-
-        for (int i = 0; i < cloud->points.size(); i++) {
-            point = cloud->points[i];
-            uv_point.intensity = point.intensity;
-
-            point_vec << point.x, point.y, point.z;
-            point_trans_vec = R * point_vec + translation;
-//                std::cout << "Transformed Point Position: \n" << point_trans_vec << std::endl;
-
-            // calculate projection on image
-            /** intrinsic transformation **/
-            Eigen::Vector2d uv_0 = {this->intrinsic_vec(0), this->intrinsic_vec(1)};
-            Eigen::VectorXd a_ = Eigen::VectorXd(5);
-            Eigen::Matrix2d affine;
-            Eigen::Matrix2d affine_inv;
-
-            a_ << this->intrinsic_vec(2), this->intrinsic_vec(3), this->intrinsic_vec(4), this->intrinsic_vec(5), this->intrinsic_vec(6);
-            affine << this->intrinsic_vec(7), this->intrinsic_vec(8), this->intrinsic_vec(9), 1.0;
-
-            theta = acos(point_trans_vec(2) / sqrt((point_trans_vec(0) * point_trans_vec(0)) + (point_trans_vec(1) * point_trans_vec(1)) + (point_trans_vec(2) * point_trans_vec(2))));
-            uv_radius = a_(0) + a_(1) * theta + a_(2) * pow(theta, 2) + a_(3) * pow(theta, 3) + a_(4) * pow(theta, 4);
-            xy_radius = sqrt(point_trans_vec(1) * point_trans_vec(1) + point_trans_vec(0) * point_trans_vec(0));
-            uv_vec = {uv_radius / xy_radius * point_trans_vec(0) + uv_0(0), uv_radius / xy_radius * point_trans_vec(1) + uv_0(1)};
-            affine_inv.row(0) << affine(1, 1) / (affine(0, 0) * affine(1, 1) - affine(1, 0) * affine(0, 1)),
-                                 - affine(0, 1) / (affine(0, 0) * affine(1, 1) - affine(1, 0) * affine(0, 1));
-            affine_inv.row(1) << - affine(1, 0) / (affine(0, 0) * affine(1, 1) - affine(1, 0) * affine(0, 1)),
-                                 affine(0, 0) / (affine(0, 0) * affine(1, 1) - affine(1, 0) * affine(0, 1));
-            uv_vec = affine_inv * uv_vec;
-
-            //if image_point is within the frame
-            int gray, refc;
-            if (0 <= uv_vec[0] && uv_vec[0] < img.rows && 0 <= uv_vec[1] && uv_vec[1] < img.cols) {
-                if (uv_radius > 400 & uv_radius < 1000) {
-                    /** points on uv plane **/
-                    uv_point.x = uv_vec[0];
-                    uv_point.y = uv_vec[1];
-                    uv_point.z = 0;
-                    uv_cloud->points.push_back(uv_point);
-
-                    /** get the grayscale if point within frame **/
-//                        int b = img.at<cv::Vec3b>(uv_vec[0], uv_vec[1])[0];
-//                        int g = img.at<cv::Vec3b>(uv_vec[0], uv_vec[1])[1];
-//                        int r = img.at<cv::Vec3b>(uv_vec[0], uv_vec[1])[2];
-//                        gray = (0.114 * b + 0.587 * g + 0.299 * r) / this->m_binFraction;
-                    gray = img.at<cv::Vec3b>(uv_vec[0], uv_vec[1])[0] / this->m_binFraction;
-                    refc = point.intensity / this->m_binFraction;
-
-//                        gray_outfile << gray << "\t" << std::endl;
-//                        refc_outfile << refc << "\t" << std::endl;
-
-                    hist.grayHist.at<float>(gray) = hist.grayHist.at<float>(gray) + 1;
-                    hist.refcHist.at<float>(refc) = hist.refcHist.at<float>(refc) + 1;
-                    hist.jointHist.at<float>(gray, refc) = hist.jointHist.at<float>(gray, refc) + 1;
-                    hist.count++;
-                    gray_sum = gray_sum + gray;
-                    refc_sum = refc_sum + refc;
-                }
-            }
+    void Calibration::build_evaluator ()
+    {
+        this->m_evaluator = std::make_shared<MiEvaluator> (this->intrinsic_vec, this->fisheye_img, *this->point_cloud,
+                                                           this->m_numBins, this->m_binFraction, this->m_estimatorType);
+        if (this->m_debugOutput) {
+            this->m_evaluator->set_debug_hook ([this] (const MiPose &pose, const Histogram &hist, const Probability &prob) {
+                this->save_debug_output (hist, prob);
+            });
         }
-        gray_outfile.close();
-        refc_outfile.close();
-
-        /** save the hist of grayscale and reflectivity **/
-
-
-        int gray_size = hist.grayHist.cols;
-        int refc_size = hist.refcHist.cols;
-        int joint_r_size = hist.jointHist.rows;
-        int joint_c_size = hist.jointHist.cols;
-
-//        std::ofstream outfile;
-//        outfile.open(this->gray_hist_path, std::ios::out);
-//        for (int i = 0; i < gray_size; i++) {
-//            outfile << hist.grayHist.at<float>(i) << "\t";
-//        }
-//        outfile.close();
-//        outfile.open(this->refc_hist_path, std::ios::out);
-//        for (int i = 0; i < refc_size; i++) {
-//            outfile << hist.refcHist.at<float>(i) << "\t";
-//        }
-//        outfile.close();
-//        outfile.open(this->joint_hist_path, std::ios::out);
-//        for (int r = 0; r < joint_r_size; ++r) {
-//            for (int c = 0; c < joint_c_size; ++c) {
-//                outfile << hist.refcHist.at<float>(r, c) << "\t";
-//            }
-//            outfile << "\n";
-//        }
-//        outfile.close();
+    }
 
-        /** save the joint hist image **/
+    /**
+     * This function writes the histograms and the joint probability of an evaluation as images.
+     * It is the only file output of the cost evaluation, enabled by m_debugOutput.
+     */
+    void Calibration::save_debug_output (const Histogram &hist, const Probability &prob)
+    {
         cv::imwrite(this->refc_hist_img_path, hist.refcHist);
         cv::imwrite(this->gray_hist_img_path, hist.grayHist);
         cv::imwrite(this->joint_hist_img_path, hist.jointHist);
+        cv::imwrite(this->joint_prob_img_path, prob.jointProb * 255);
+    }
 
-//        /** save the uv point to check **/
-//        pcl::io::savePCDFileBinary(this->check_uv_cloud_path, *uv_cloud);
-
-        hist.gray_sum = gray_sum;
-        hist.refc_sum = refc_sum;
-        return hist;
+    /**
+     * This function computes the histograms at a given transformation x
+     */
+    Histogram Calibration::get_histogram (Eigen::Vector3d translation, Eigen::Vector3d euler) {
+        return this->m_evaluator->histogram ({translation, euler});
     }
 
     Probability
     Calibration::get_probability_MLE (Histogram hist)
     {
-        //Calculate sample covariance matrix
-        float mu_gray = hist.gray_sum/hist.count;
-        float mu_refc = hist.refc_sum/hist.count;
-        //Covariances
-        double sigma_gray = 0;
-        double sigma_refc = 0;
-        //Cross correlation
-        double sigma_gr = 0;
-        
-        Probability probMLE (this->m_numBins);
-        
-        for (int i = 0; i < this->m_numBins; i++)
-        {
-           for (int j = 0; j < this->m_numBins; j++)
-           {
-             //Cross Correlation term;
-             sigma_gr = sigma_gr + hist.jointHist.at<float>(i, j)*(i - mu_refc)*(j - mu_gray);
-             //Normalize the histogram so that the value is between (0,1)
-             probMLE.jointProb.at<float>(i, j) = hist.jointHist.at<float>(i, j)/(hist.count);
-           }
-    
-           //calculate sample covariance 
-           sigma_gray = sigma_gray + (hist.grayHist.at<float>(i)*(i - mu_gray)*(i - mu_gray));
-           sigma_refc = sigma_refc + (hist.refcHist.at<float>(i)*(i - mu_refc)*(i - mu_refc));
-           
-           probMLE.grayProb.at<float>(i) = hist.grayHist.at<float>(i)/hist.count;
-           probMLE.refcProb.at<float>(i) = hist.refcHist.at<float>(i)/hist.count;
-        }
-    
-        sigma_gray = sigma_gray/hist.count;
-        sigma_refc = sigma_refc/hist.count;
-        sigma_gr = sigma_gr/hist.count;
-        double corr_coeff = ((sigma_gr)/(sigma_gray*sigma_refc));
-        corr_coeff = sqrt (corr_coeff*corr_coeff);
-        this->m_corrCoeff = corr_coeff;
-        
-        //Compute the optimal bandwidth (Silverman's rule of thumb)
-        sigma_gray = 1.06*sqrt (sigma_gray)/pow (hist.count, 0.2);
-        sigma_refc = 1.06*sqrt (sigma_refc)/pow (hist.count, 0.2); 
-
-        cv::GaussianBlur (probMLE.grayProb, probMLE.grayProb, cv::Size(0, 0), sigma_gray);
-        cv::GaussianBlur (probMLE.refcProb, probMLE.refcProb, cv::Size(0, 0), sigma_refc);
-        cv::GaussianBlur (probMLE.jointProb, probMLE.jointProb, cv::Size(0, 0), sigma_gray, sigma_refc);
-        probMLE.count = hist.count; 
-        return probMLE; 
+        return MiEvaluator::probability_MLE (hist, &this->m_corrCoeff);
     }
 
     /**
@@ -415,51 +281,7 @@ namespace perls
     Probability 
     Calibration::get_probability_JS (Probability probMLE)
     {
-        //Calculate JS estimate
-        //Estimate lamda from the data
-        /** 
-        //Reference:[1] Entropy inference and the James Stein estimator. Hausser and Strimmer.
-        //Sample Variance of MLE
-        //Using unbiased estimator of variance as given in [1]:
-        //Var(\theta_k) = \frac{\theta_k(1 - \theta_k)}{n-1}
-        //=> \lambda = \frac{1 - \sum_{k=0}^{K} (\theta_k)^2}{\sum_{k=0}^{K} (t_k - \theta_k)
-        //Here t_k      = target distribution (here m_jointTarget)
-        //     \theta_k = MLE estimate (here probMLE.jointProb)  
-        **/
-        float squareSumMLE = cv::norm (probMLE.jointProb);
-        squareSumMLE = (squareSumMLE*squareSumMLE); 
-        //Difference of MLE from the target 
-        float squareDiffMLETarget = cv::norm (this->m_jointTarget, probMLE.jointProb);
-        squareDiffMLETarget =  (squareDiffMLETarget*squareDiffMLETarget);
-         
-        float lambda = (1.0-squareSumMLE)/squareDiffMLETarget;
-        lambda = (lambda/(probMLE.count-1));
-        //lambda = squareDiffMLETarget/squareSumMLE;
-        //lambda = sqrt(this->m_corrCoeff); 
-//        std::cout << lambda << " " << squareSumMLE << " " << squareDiffMLETarget << std::endl;
-        //lambda = 1 - sqrt(squareSumMLE); 
-        //lambda = 0.0; 
-        if (lambda > 1)
-            lambda = 1;
-        if (lambda < 0)
-            lambda = 0; 
-        
-        //Scale the target distribution by lambda
-        //Scale the MLE or the histograms by (1-lambda)  
-        //Get the JS estimate as a weighted combination of target and the MLE
-        Probability probJS (this->m_numBins);
-
-        probJS.jointProb = this->m_jointTarget*lambda + probMLE.jointProb*(1.0-lambda);
-        //cv::GaussianBlur (jointJSEstimate, jointJSEstimate, cv::Size(5, 5), 1.2, 1.2);
-        probJS.grayProb = this->m_grayTarget*lambda + probMLE.grayProb*(1.0-lambda);
-        //cv::GaussianBlur (margJSEstimate1, margJSEstimate1, cv::Size(1, 5), 0, 1.2);
-        probJS.refcProb = this->m_refcTarget*lambda + probMLE.refcProb*(1.0-lambda);
-        //cv::GaussianBlur (margJSEstimate2, margJSEstimate2, cv::Size(1, 5), 0, 1.2);
-
-        /** save the image of probability **/
-        cv::imwrite(this->joint_prob_img_path, probJS.jointProb * 255);
-        
-        return probJS;
+        return this->m_evaluator->probability_JS (probMLE);
     }
     
     /**
@@ -468,52 +290,7 @@ namespace perls
     Probability 
     Calibration::get_probability_Bayes (Histogram hist)
     {
-        float a = 1; //0.5 , 1/this->m_numBins, sqrt (count)/this->m_numBins etc
-        float A_joint = this->m_numBins*this->m_numBins;
-        float A_marg = this->m_numBins;
-        Probability probBayes (this->m_numBins);
-        //Calculate sample covariance matrix
-        float mu_gray = hist.gray_sum/hist.count;
-        float mu_refc = hist.refc_sum/hist.count;
-        //Covariances
-        double sigma_gray = 0;
-        double sigma_refc = 0;
-        //Cross correlation
-        double sigma_gr = 0;
-        
-        for (int i = 0; i < this->m_numBins; i++)
-        {
-           for (int j = 0; j < this->m_numBins; j++)
-           {
-             //Cross Correlation term;
-             sigma_gr = sigma_gr + hist.jointHist.at<float>(i, j)*(i - mu_refc)*(j - mu_gray);
-             //Normalize the histogram so that the value is between (0,1)
-             probBayes.jointProb.at<float>(i, j) = (hist.jointHist.at<float>(i, j)+a)/(hist.count + A_joint);
-           }
-    
-           //calculate sample covariance 
-           sigma_gray = sigma_gray + (hist.grayHist.at<float>(i)*(i - mu_gray)*(i - mu_gray));
-           sigma_refc = sigma_refc + (hist.refcHist.at<float>(i)*(i - mu_refc)*(i - mu_refc));
-           
-           probBayes.grayProb.at<float>(i) = (hist.grayHist.at<float>(i) + a)/(hist.count + A_marg);
-           probBayes.refcProb.at<float>(i) = (hist.refcHist.at<float>(i) + a)/(hist.count + A_marg);
-        }
-    
-        sigma_gray = sigma_gray/hist.count;
-        sigma_refc = sigma_refc/hist.count;
-        sigma_gr = sigma_gr/hist.count;
-        double corr_coeff = ((sigma_gr)/(sigma_gray*sigma_refc));
-        corr_coeff = sqrt (corr_coeff*corr_coeff);
-        this->m_corrCoeff = corr_coeff;
-        
-        //Compute the optimal bandwidth (Silverman's rule of thumb)
-        sigma_gray = 1.06*sqrt (sigma_gray)/pow (hist.count, 0.2);
-        sigma_refc = 1.06*sqrt (sigma_refc)/pow (hist.count, 0.2); 
-        
-        cv::GaussianBlur (probBayes.grayProb, probBayes.grayProb, cv::Size(0, 0), sigma_gray);
-        cv::GaussianBlur (probBayes.refcProb, probBayes.refcProb, cv::Size(0, 0), sigma_refc);
-        cv::GaussianBlur (probBayes.jointProb, probBayes.jointProb, cv::Size(0, 0), sigma_gray, sigma_refc);
-        return probBayes; 
+        return MiEvaluator::probability_Bayes (hist, &this->m_corrCoeff);
     }
 
 
@@ -523,49 +300,16 @@ namespace perls
     float
     Calibration::mi_cost (Eigen::Vector3d translation, Eigen::Vector3d euler)
     {
-        //Get MLE of probability distribution
-        Histogram hist = get_histogram (translation, euler);
-        Probability prob;
-        Probability probMLE; 
-        switch (this->m_estimatorType)
-        {
-            case 1: //MLE
-                prob = get_probability_MLE (hist);
-                break;
-            case 2: //James-Stein type
-                probMLE = get_probability_MLE (hist);
-                prob = get_probability_JS (probMLE); 
-                break;
-            case 3: //Bayes estimator
-                prob = get_probability_Bayes (hist);
-                break;
-        }
+        return this->m_evaluator->cost ({translation, euler});
+    }
 
-        //Calculate log of JS estimate
-        cv::Mat jointLog = cv::Mat::zeros(this->m_numBins, this->m_numBins, CV_32FC1);
-        cv::Mat grayLog = cv::Mat::zeros(1, this->m_numBins, CV_32FC1); 
-        cv::Mat refcLog = cv::Mat::zeros(1, this->m_numBins, CV_32FC1);
- 
-        cv::log (prob.jointProb, jointLog);
-        cv::log (prob.grayProb, grayLog);
-        cv::log (prob.refcProb, refcLog);
-        
-        cv::Mat jointEntropyMat, grayEntropyMat, refcEntropyMat;
-        //jointEntropyMat = jointJSEstimate*jointJSLog;
-        cv::multiply (prob.jointProb, jointLog, jointEntropyMat);
-        //margEntropyMat1 = margJSEstimate1*margJSLog1;
-        cv::multiply (prob.grayProb, grayLog, grayEntropyMat); 
-        //margEntropyMat2 = margJSEstimate2*margJSLog2;
-        cv::multiply (prob.refcProb, refcLog, refcEntropyMat); 
-        
-        //Sum all the elements
-        float Hx  = cv::norm (grayEntropyMat, cv::NORM_L1);
-        float Hy  = cv::norm (refcEntropyMat, cv::NORM_L1);
-        float Hxy = cv::norm (jointEntropyMat, cv::NORM_L1);
-        
-        float cost = Hx + Hy - Hxy;
-        //float cost = Hxy;
-        return cost;
+    /**
+     * This function calculates the mutual information of a batch of candidate poses in one call
+     */
+    std::vector<float>
+    Calibration::mi_cost_batch (const std::vector<MiPose> &poses)
+    {
+        return this->m_evaluator->cost_batch (poses);
     }
 
     /**
@@ -618,25 +362,30 @@ namespace perls
         double step_rot = 1*DTOR;
         double max_cost_l1 = 0; 
 
-        float curr_cost = 0;
+        std::vector<MiPose> poses;
+        std::vector<float> costs;
         for (double x = translation[0] - gridsize_trans; x <= translation[0] + gridsize_trans; x = x + step_trans) {
           for (double y = translation[1] - gridsize_trans; y <= translation[1] + gridsize_trans; y = y + step_trans) {
             for (double z = translation[2] - gridsize_trans; z <= translation[2] + gridsize_trans; z = z + step_trans) {
+              //the rotation grid of each translation is evaluated as one batch
+              poses.clear ();
               for (double r = euler[2] - gridsize_rot; r <= euler[2] + gridsize_rot; r = r + step_rot) {
                 for (double p = euler[1] - gridsize_rot; p <= euler[1] + gridsize_rot; p = p + step_rot) {
                   for (double h = euler[0] - gridsize_rot; h <= euler[0] + gridsize_rot; h = h + step_rot) {
                       translation_0[0] = x; translation_0[1] = y; translation_0[2] = z;
                       euler_0[2] = r; euler_0[1] = p; euler_0[0] = h;
-                      curr_cost = this->mi_cost (translation_0, euler_0);
-
-                      if (curr_cost > max_cost_l1) {
-                          max_cost_l1 = curr_cost;
-                          translation_max_l1 = translation_0;
-                          euler_max_l1 = euler_0;
-                      }
+                      poses.push_back ({translation_0, euler_0});
                   }
                 }
               }
+              costs = this->mi_cost_batch (poses);
+              for (int i = 0; i < poses.size (); i++) {
+                  if (costs[i] > max_cost_l1) {
+                      max_cost_l1 = costs[i];
+                      translation_max_l1 = poses[i].translation;
+                      euler_max_l1 = poses[i].euler;
+                  }
+              }
             }
           }
         }
@@ -660,25 +409,27 @@ namespace perls
         translation_max_l2 = translation_max_l1;
         euler_max_l2 = euler_max_l1;
 
-        curr_cost = 0;
         for (double x = translation[0] - gridsize_trans; x <= translation[0] + gridsize_trans; x = x + step_trans) {
             for (double y = translation[1] - gridsize_trans; y <= translation[1] + gridsize_trans; y = y + step_trans) {
                 for (double z = translation[2] - gridsize_trans; z <= translation[2] + gridsize_trans; z = z + step_trans) {
+                    poses.clear ();
                     for (double r = euler[2] - gridsize_rot; r <= euler[2] + gridsize_rot; r = r + step_rot) {
                         for (double p = euler[1] - gridsize_rot; p <= euler[1] + gridsize_rot; p = p + step_rot) {
                             for (double h = euler[0] - gridsize_rot; h <= euler[0] + gridsize_rot; h = h + step_rot) {
                                 translation_0[0] = x; translation_0[1] = y; translation_0[2] = z;
                                 euler_0[2] = r; euler_0[1] = p; euler_0[0] = h;
-                                curr_cost = this->mi_cost (translation_0, euler_0);
-
-                                if (curr_cost > max_cost_l2) {
-                                    max_cost_l2 = curr_cost;
-                                    translation_max_l2 = translation_0;
-                                    euler_max_l2 = euler_0;
-                                }
+                                poses.push_back ({translation_0, euler_0});
                             }
                         }
                     }
+                    costs = this->mi_cost_batch (poses);
+                    for (int i = 0; i < poses.size (); i++) {
+                        if (costs[i] > max_cost_l2) {
+                            max_cost_l2 = costs[i];
+                            translation_max_l2 = poses[i].translation;
+                            euler_max_l2 = poses[i].euler;
+                        }
+                    }
                 }
             }
         }
@@ -689,6 +440,135 @@ namespace perls
         return max_cost_l2;
     }
 
+    /**
+     * This function enumerates the grid of one search level around a center pose,
+     * +-gridsize in steps of step on every axis, counts rounded so that the center is always a node
+     */
+    static void append_grid_poses (const MiPose &center, double gridsize_trans, double step_trans,
+                                   double gridsize_rot, double step_rot, std::vector<MiPose> &poses)
+    {
+        const int n_trans = round (gridsize_trans/step_trans);
+        const int n_rot = round (gridsize_rot/step_rot);
+        MiPose pose;
+        for (int x = -n_trans; x <= n_trans; x++) {
+          for (int y = -n_trans; y <= n_trans; y++) {
+            for (int z = -n_trans; z <= n_trans; z++) {
+              for (int r = -n_rot; r <= n_rot; r++) {
+                for (int p = -n_rot; p <= n_rot; p++) {
+                  for (int h = -n_rot; h <= n_rot; h++) {
+                      pose.translation = center.translation + step_trans*Eigen::Vector3d (x, y, z);
+                      pose.euler = center.euler + step_rot*Eigen::Vector3d (h, p, r);
+                      poses.push_back (pose);
+                  }
+                }
+              }
+            }
+          }
+        }
+    }
+
+    /**
+     * This function performs the grid search of exhaustive_grid_search hierarchically and in parallel.
+     * Every level first scores all cells with a coarse evaluator (one point in kStride, kBinMerge bins merged),
+     * then evaluates the full cost in order of decreasing coarse score, in batches spread over the threads.
+     * The coarse score plus the largest full - coarse gap seen so far (with a safety factor) serves as
+     * the upper bound of a cell, the remaining cells are pruned once that bound cannot beat the incumbent.
+     * The kSeeds best cells of a level are refined by the next one.
+     * translation and euler are updated to the maximum.
+     */
+    float
+    Calibration::hierarchical_grid_search (Eigen::Vector3d &translation, Eigen::Vector3d &euler)
+    {
+        const int kStride = 8;
+        const int kBinMerge = 4;
+        const int kSeeds = 3;
+        const int kBatch = 64; /** full evaluations between two bound checks **/
+        const float kSlackFactor = 1.5;
+        /** gridsize and step of translation (m) and rotation (rad) as in exhaustive_grid_search **/
+        const std::vector<std::vector<double>> levels = {
+            {0.20, 0.05, 3*DTOR, 1*DTOR},
+            {0.04, 0.01, 0.5*DTOR, 0.1*DTOR}};
+
+        double start_time = omp_get_wtime ();
+
+        /** coarse evaluator on a subsample of the scan **/
+        pcl::PointCloud<pcl::PointXYZI> sub_cloud;
+        for (int i = 0; i < this->point_cloud->points.size (); i += kStride) {
+            sub_cloud.points.push_back (this->point_cloud->points[i]);
+        }
+        MiEvaluator coarse (this->intrinsic_vec, this->fisheye_img, sub_cloud,
+                            this->m_numBins/kBinMerge, this->m_binFraction*kBinMerge, this->m_estimatorType);
+
+        MiPose best = {translation, euler};
+        float best_cost = this->m_evaluator->cost (best);
+        std::vector<MiPose> seeds = {best};
+        long full_evals = 1;
+        long coarse_evals = 0;
+        long exhaustive_evals = 0;
+
+        for (int level = 0; level < levels.size (); level++) {
+            std::vector<MiPose> poses;
+            for (auto &seed : seeds) {
+                append_grid_poses (seed, levels[level][0], levels[level][1], levels[level][2], levels[level][3], poses);
+            }
+            /** the exhaustive search visits the grid of a single center per level **/
+            exhaustive_evals += poses.size ()/seeds.size ();
+
+            std::vector<float> coarse_costs = coarse.cost_batch (poses);
+            coarse_evals += poses.size ();
+            std::vector<int> order (poses.size ());
+            std::iota (order.begin (), order.end (), 0);
+            std::sort (order.begin (), order.end (), [&] (int a, int b) { return coarse_costs[a] > coarse_costs[b]; });
+
+            std::vector<std::pair<float, int>> evaluated;
+            float slack = 0;
+            int num_full = 0;
+            for (int start = 0; start < order.size (); start += kBatch) {
+                if (start > 0 && coarse_costs[order[start]] + slack < best_cost) {
+                    break;
+                }
+                const int end = std::min (start + kBatch, int(order.size ()));
+                std::vector<MiPose> batch;
+                for (int k = start; k < end; k++) {
+                    batch.push_back (poses[order[k]]);
+                }
+                std::vector<float> costs = this->m_evaluator->cost_batch (batch);
+                for (int k = start; k < end; k++) {
+                    const int idx = order[k];
+                    const float cost = costs[k - start];
+                    slack = std::max (slack, kSlackFactor*(cost - coarse_costs[idx]));
+                    evaluated.push_back ({cost, idx});
+                    if (cost > best_cost) {
+                        best_cost = cost;
+                        best = poses[idx];
+                    }
+                }
+                num_full += end - start;
+            }
+            full_evals += num_full;
+
+            /** refine around the best cells of this level **/
+            std::sort (evaluated.begin (), evaluated.end (), std::greater<std::pair<float, int>> ());
+            seeds.clear ();
+            for (int k = 0; k < std::min (kSeeds, int(evaluated.size ())); k++) {
+                seeds.push_back (poses[evaluated[k].second]);
+            }
+            if (seeds.empty ()) {
+                seeds.push_back (best);
+            }
+            printf ("Level %d grid search done: %d cells, %d full evaluations, %d pruned\n",
+                    level + 1, int(poses.size ()), num_full, int(poses.size ()) - num_full);
+            printf ("%lf %lf %lf %lf %lf %lf %lf\n", best_cost, best.translation[0], best.translation[1], best.translation[2],
+                    best.euler[2]*RTOD, best.euler[1]*RTOD, best.euler[0]*RTOD);
+        }
+
+        printf ("Evaluations: %ld full + %ld coarse (1/%d of the points) vs %ld exhaustive, %.2f s\n",
+                full_evals, coarse_evals, kStride, exhaustive_evals, omp_get_wtime () - start_time);
+        translation = best.translation;
+        euler = best.euler;
+        return best_cost;
+    }
+
     /**
      * This function performs the gradient descent search for the transformation 
      * parameters
@@ -718,6 +598,14 @@ namespace perls
         double delF_delX_ = 0, delF_delY_ = 0, delF_delZ_ = 0;
         double delF_delR_ = 0, delF_delP_ = 0, delF_delH_ = 0;
         double f_max = 0;
+        //probe evaluations of the finite differences and the step, full or as deltas of the iteration state
+        MiState state;
+        auto probe_cost = [&] (const Eigen::Vector3d &t, const Eigen::Vector3d &e) -> float {
+            if (this->m_gradientMode == MI_GRADIENT_DELTA) {
+                return this->m_evaluator->delta_cost (state, {t, e});
+            }
+            return this->mi_cost (t, e);
+        };
         while (index < MAX_ITER)
         {
             std::cout << "The current search iteration: " << index << std::endl;
@@ -726,68 +614,88 @@ namespace perls
             #ifdef CHI_SQUARE_TEST
               f_prev = chi_square_cost (translation_k, euler_k);
             #else
-              f_prev = mi_cost (translation_k, euler_k);
+              if (this->m_gradientMode == MI_GRADIENT_DELTA) {
+                  //one full pass per iteration, the probes below are deltas of it
+                  this->m_evaluator->init_state ({translation_k, euler_k}, state);
+                  f_prev = this->m_evaluator->cost (this->m_evaluator->state_histogram (state), state.pose);
+              }
+              else {
+                  f_prev = mi_cost (translation_k, euler_k);
+              }
             #endif
             if (f_prev > f_max)
                 f_max = f_prev;
     
-            double _f = 0; 
-    
-            double x, y, z, r, p, h;
-            x = translation_k[0]; y = translation_k[1]; z = translation_k[2];
-            r = euler_k[2]; p = euler_k[1]; h = euler_k[0];
-
-            Eigen::Vector3d euler_delta = {h, p, r}; // zyx
-            Eigen::Vector3d translation_delta = {x + deltax, y, z}; // xyz
-
-            #ifdef CHI_SQUARE_TEST
-              _f = chi_square_cost (translation_delta, euler_delta);
-            #else 
-              _f = mi_cost (translation_delta, euler_delta);
-            #endif
-    
-            double delF_delX = (_f - f_prev)/deltax;
-
-            translation_delta = {x, y + deltay, z}; // xyz
-            #ifdef CHI_SQUARE_TEST
-              _f = chi_square_cost (translation_delta, euler_delta);
-            #else 
-              _f = mi_cost (translation_delta, euler_delta);
-            #endif
-            double delF_delY = (_f - f_prev)/deltay;
-
-            translation_delta = {x, y, z + deltaz}; // xyz
-            #ifdef CHI_SQUARE_TEST
-              _f = chi_square_cost (translation_delta, euler_delta);
-            #else 
-              _f = mi_cost (translation_delta, euler_delta);
-            #endif
-            double delF_delZ = (_f - f_prev)/deltaz;
-
-            euler_delta = {h, p, r + deltar}; // zyx
-            translation_delta = {x, y, z}; // xyz
-            #ifdef CHI_SQUARE_TEST
-              _f = chi_square_cost (translation_delta, euler_delta);
-            #else 
-              _f = mi_cost (translation_delta, euler_delta);
-            #endif
-            double delF_delR = (_f - f_prev)/deltar;
-
-            euler_delta = {h, p + deltap, r}; // zyx
-            #ifdef CHI_SQUARE_TEST
-              _f = chi_square_cost (translation_delta, euler_delta);
-            #else 
-              _f = mi_cost (translation_delta, euler_delta);
-            #endif
-            double delF_delP = (_f - f_prev)/deltap;
-
-            euler_delta = {h + deltah, p, r}; // zyx
-            #ifdef CHI_SQUARE_TEST
-              _f = chi_square_cost (translation_delta, euler_delta);
-            #else 
-              _f = mi_cost (translation_delta, euler_delta);
+            double delF_delX, delF_delY, delF_delZ;
+            double delF_delR, delF_delP, delF_delH;
+            #ifndef CHI_SQUARE_TEST
+            if (this->m_gradientMode == MI_GRADIENT_PARZEN) {
+                //analytic gradient of the parzen window MI, in the order x, y, z, h, p, r
+                Eigen::Matrix<double, 6, 1> gradient = this->m_evaluator->parzen_gradient ({translation_k, euler_k});
+                delF_delX = gradient[0]; delF_delY = gradient[1]; delF_delZ = gradient[2];
+                delF_delH = gradient[3]; delF_delP = gradient[4]; delF_delR = gradient[5];
+            }
+            else
             #endif
-            double delF_delH = (_f - f_prev)/deltah;
+            {
+                double _f = 0; 
+
+                double x, y, z, r, p, h;
+                x = translation_k[0]; y = translation_k[1]; z = translation_k[2];
+                r = euler_k[2]; p = euler_k[1]; h = euler_k[0];
+
+                Eigen::Vector3d euler_delta = {h, p, r}; // zyx
+                Eigen::Vector3d translation_delta = {x + deltax, y, z}; // xyz
+
+                #ifdef CHI_SQUARE_TEST
+                  _f = chi_square_cost (translation_delta, euler_delta);
+                #else 
+                  _f = probe_cost (translation_delta, euler_delta);
+                #endif
+
+                delF_delX = (_f - f_prev)/deltax;
+
+                translation_delta = {x, y + deltay, z}; // xyz
+                #ifdef CHI_SQUARE_TEST
+                  _f = chi_square_cost (translation_delta, euler_delta);
+                #else 
+                  _f = probe_cost (translation_delta, euler_delta);
+                #endif
+                delF_delY = (_f - f_prev)/deltay;
+
+                translation_delta = {x, y, z + deltaz}; // xyz
+                #ifdef CHI_SQUARE_TEST
+                  _f = chi_square_cost (translation_delta, euler_delta);
+                #else 
+                  _f = probe_cost (translation_delta, euler_delta);
+                #endif
+                delF_delZ = (_f - f_prev)/deltaz;
+
+                euler_delta = {h, p, r + deltar}; // zyx
+                translation_delta = {x, y, z}; // xyz
+                #ifdef CHI_SQUARE_TEST
+                  _f = chi_square_cost (translation_delta, euler_delta);
+                #else 
+                  _f = probe_cost (translation_delta, euler_delta);
+                #endif
+                delF_delR = (_f - f_prev)/deltar;
+
+                euler_delta = {h, p + deltap, r}; // zyx
+                #ifdef CHI_SQUARE_TEST
+                  _f = chi_square_cost (translation_delta, euler_delta);
+                #else 
+                  _f = probe_cost (translation_delta, euler_delta);
+                #endif
+                delF_delP = (_f - f_prev)/deltap;
+
+                euler_delta = {h + deltah, p, r}; // zyx
+                #ifdef CHI_SQUARE_TEST
+                  _f = chi_square_cost (translation_delta, euler_delta);
+                #else 
+                  _f = probe_cost (translation_delta, euler_delta);
+                #endif
+                delF_delH = (_f - f_prev)/deltah;
+            }
     
             double norm_delF_del_trans = sqrt(delF_delX*delF_delX + delF_delY*delF_delY + delF_delZ*delF_delZ); 
             double norm_delF_del_rot   = sqrt(delF_delR*delF_delR + delF_delP*delF_delP + delF_delH*delF_delH);
@@ -860,7 +768,7 @@ namespace perls
             #ifdef CHI_SQUARE_TEST
               f_curr = chi_square_cost (translation_k, euler_k);
             #else 
-              f_curr = mi_cost (translation_k, euler_k);
+              f_curr = probe_cost (translation_k, euler_k);
             #endif
     
             if (f_curr < f_prev)
@@ -899,6 +807,8 @@ namespace perls
 
         translation = translation_k;
         euler = euler_k;
+        this->translation = translation_k;
+        this->euler_angle = euler_k;
         return index;
     }
 
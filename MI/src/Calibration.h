@@ -4,12 +4,11 @@
 #include <iostream>
 #include <fstream>
 #include <string.h>
+#include <memory>
 /** opencv **/
-#include <opencv/cv.h>
-#include <opencv/highgui.h>
-#include "opencv2/imgproc/imgproc.hpp"
-#include <opencv/cv.hpp>
 #include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <opencv2/highgui/highgui.hpp>
 /** pcl **/
 #include <pcl/point_cloud.h>
@@ -26,6 +25,8 @@
 #include <pcl/filters/conditional_removal.h>
 #include <pcl/common/time.h>
 #include <pcl/filters/extract_indices.h>
+/** in-memory mutual information cost **/
+#include "MiEvaluator.h"
 /** namespace **/
 using namespace std;
 
@@ -50,54 +51,21 @@ using namespace std;
 #define CAM_PARAM_CONFIG_PATH "../config/master.cfg"
 #define RANGE_THRESH 5.0 //in m
 
+/** gradient of gradient_descent_search **/
+#define MI_GRADIENT_FULL 0 //finite differences, full histogram per probe
+#define MI_GRADIENT_DELTA 1 //finite differences, probes re-bin only the points that may change pixel (approximate, pays off only if the probes move points by less than a pixel)
+#define MI_GRADIENT_PARZEN 2 //analytic gradient of the parzen window MI
+
 namespace perls
 {
-    class Probability 
-    {
-        public:
-          Probability (){};
-          Probability (int n)
-          {
-              jointProb = cv::Mat::zeros (n, n, CV_32FC1);
-              refcProb = cv::Mat::zeros (1, n, CV_32FC1);
-              grayProb = cv::Mat::zeros (1, n, CV_32FC1);
-              count = 0;
-          };
-          ~Probability () {};
-          //joint Probability
-          cv::Mat jointProb;
-          //marginal probability reflectivity
-          cv::Mat refcProb;
-          //marginal probability grayscale
-          cv::Mat grayProb;
-          int count;
-    };
-
-    class Histogram 
-    {
-        public:
-          Histogram (){};
-          Histogram (int n)
-          {
-              jointHist = cv::Mat::zeros (n, n, CV_32FC1);
-              refcHist = cv::Mat::zeros (1, n, CV_32FC1);
-              grayHist = cv::Mat::zeros (1, n, CV_32FC1);
-              count = 0;
-          };
-          ~Histogram () {};
-          //joint Histogram
-          cv::Mat jointHist;
-          cv::Mat refcHist;
-          cv::Mat grayHist; 
-          int count;
-          int gray_sum;
-          int refc_sum;
-    };
-
     class Calibration
     {
         public:
           Calibration ();
+          /** fisheye hdr image and lidar scan, the intermediate clouds are only written if their paths are set **/
+          Calibration (const std::string &image_path, const std::string &cloud_path);
+          /** same, with the camera intrinsics u0, v0, a0..a4, c, d, e instead of the built-in ones **/
+          Calibration (const std::string &image_path, const std::string &cloud_path, const Eigen::VectorXd &intrinsic);
           /** parameters **/
           Eigen::VectorXd intrinsic_vec;
           Eigen::Vector3d euler_angle;
@@ -123,8 +91,12 @@ namespace perls
           /**Functions to load the data**/
           int m_estimatorType;
           double m_corrCoeff;
+          int m_gradientMode;
+          bool m_debugOutput; /** write the histograms of every cost evaluation as images **/
           void   load_point_cloud (std::string cloud_path);
           void   load_image ();
+          void   build_evaluator ();
+          void   save_debug_output (const Histogram &hist, const Probability &prob);
           /*****************************/
 
           /**Helper functions**/
@@ -138,6 +110,8 @@ namespace perls
           /**Cost Functions**/
           float mi_cost (Eigen::Vector3d translation, Eigen::Vector3d euler); 
           float chi_square_cost (Eigen::Vector3d translation, Eigen::Vector3d euler);
+          std::vector<float> mi_cost_batch (const std::vector<MiPose> &poses);
+          long num_evaluations () const { return m_evaluator->num_evaluations (); }
           /*****************************/
 
           /** Covariance Matrix**/
@@ -147,13 +121,12 @@ namespace perls
           /**Optimization Functions**/ 
           float gradient_descent_search (Eigen::Vector3d translation, Eigen::Vector3d euler);
           float exhaustive_grid_search (Eigen::Vector3d translation, Eigen::Vector3d euler);
+          float hierarchical_grid_search (Eigen::Vector3d &translation, Eigen::Vector3d &euler);
           /*****************************/
        private:
           int m_NumScans;
           int m_NumCams;
-          cv::Mat m_jointTarget;
-          cv::Mat m_grayTarget;
-          cv::Mat m_refcTarget;
+          std::shared_ptr<MiEvaluator> m_evaluator;
           int m_numBins;
           int m_binFraction; 
     };
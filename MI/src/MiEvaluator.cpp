@@ -0,0 +1,699 @@
+#include "MiEvaluator.h"
+/** basic **/
+#include <cmath>
+#include <cstring>
+#include <limits>
+/** opencv **/
+#include <opencv2/imgproc/imgproc.hpp>
+#include <Eigen/Geometry>
+
+namespace perls
+{
+    MiEvaluator::MiEvaluator (const Eigen::VectorXd &intrinsic,
+                              const cv::Mat &gray_img,
+                              const pcl::PointCloud<pcl::PointXYZI> &cloud,
+                              int num_bins,
+                              int bin_fraction,
+                              int estimator_type)
+    {
+        this->m_numBins = num_bins;
+        this->m_estimatorType = estimator_type;
+        this->m_projector.setIntrinsic (intrinsic);
+
+        /** points and their reflectivity bins, kept for every evaluation **/
+        toPointsSoA (cloud, this->m_points);
+        this->m_refcBins.resize (cloud.points.size ());
+        for (int i = 0; i < cloud.points.size (); i++) {
+            int refc = cloud.points[i].intensity / bin_fraction;
+            this->m_refcBins[i] = std::min (std::max (refc, 0), num_bins - 1);
+        }
+
+        /** grayscale bin of every pixel **/
+        cv::Mat gray = gray_img;
+        if (gray.channels () == 3) {
+            cv::cvtColor (gray_img, gray, cv::COLOR_BGR2GRAY);
+        }
+        cv::Mat gray_bins;
+        gray.convertTo (gray_bins, CV_32S);
+        gray_bins = gray_bins / bin_fraction;
+        cv::min (gray_bins, num_bins - 1, gray_bins);
+        gray_bins.convertTo (this->m_grayBins, CV_8U);
+
+        /** continuous grayscale for the parzen gradient **/
+        this->m_binFraction = bin_fraction;
+        gray.convertTo (this->m_grayValue, CV_32F, 1.0 / bin_fraction);
+
+        /** ln(1 + i / size), one extra node for the interpolation **/
+        const int size = 1 << kLogTableBits;
+        this->m_logTable.resize (size + 1);
+        for (int i = 0; i <= size; i++) {
+            this->m_logTable[i] = log (1.0 + double(i) / size);
+        }
+
+        /** targets of the James-Stein shrinkage **/
+        this->m_jointTarget = cv::Mat::eye (num_bins, num_bins, CV_32FC1)/num_bins;
+        this->m_grayTarget = cv::Mat::ones (1, num_bins, CV_32FC1)/num_bins;
+        this->m_refcTarget = cv::Mat::ones (1, num_bins, CV_32FC1)/num_bins;
+    }
+
+    void MiEvaluator::set_radius_bounds (double r_min, double r_max)
+    {
+        this->m_rMin = r_min;
+        this->m_rMax = r_max;
+    }
+
+    inline float MiEvaluator::fast_log (float p) const
+    {
+        const int kShift = 23 - kLogTableBits;
+        uint32_t bits;
+        memcpy (&bits, &p, sizeof (bits));
+        const int exponent = int((bits >> 23) & 0xff) - 127;
+        const uint32_t mantissa = bits & 0x7fffff;
+        const int idx = mantissa >> kShift;
+        const float frac = float(mantissa & ((1u << kShift) - 1)) * (1.0f / (1u << kShift));
+        return exponent * float(M_LN2) + this->m_logTable[idx] + frac * (this->m_logTable[idx + 1] - this->m_logTable[idx]);
+    }
+
+    /** rotation of the zyx euler angles and its derivatives w.r.t. euler[0], euler[1] and euler[2] **/
+    static Eigen::Matrix3d euler_rotation (const Eigen::Vector3d &euler, Eigen::Matrix3d *dR = nullptr)
+    {
+        Eigen::Matrix3d Rz, Ry, Rx;
+        Rz = Eigen::AngleAxisd(euler[0], Eigen::Vector3d::UnitZ());
+        Ry = Eigen::AngleAxisd(euler[1], Eigen::Vector3d::UnitY());
+        Rx = Eigen::AngleAxisd(euler[2], Eigen::Vector3d::UnitX());
+        if (dR != nullptr) {
+            const double cz = cos (euler[0]), sz = sin (euler[0]);
+            const double cy = cos (euler[1]), sy = sin (euler[1]);
+            const double cx = cos (euler[2]), sx = sin (euler[2]);
+            Eigen::Matrix3d dRz, dRy, dRx;
+            dRz << -sz, -cz, 0, cz, -sz, 0, 0, 0, 0;
+            dRy << -sy, 0, cy, 0, 0, 0, -cy, 0, -sy;
+            dRx << 0, 0, 0, 0, -sx, -cx, 0, cx, -sx;
+            dR[0] = dRz * Ry * Rx;
+            dR[1] = Rz * dRy * Rx;
+            dR[2] = Rz * Ry * dRx;
+        }
+        return Rz * Ry * Rx;
+    }
+
+    inline int MiEvaluator::pixel_index (double u, double v, double uv_radius) const
+    {
+        //if image_point is within the frame
+        if (0 <= u && u < this->m_grayBins.rows && 0 <= v && v < this->m_grayBins.cols
+            && uv_radius > this->m_rMin && uv_radius < this->m_rMax) {
+            return int(u) * this->m_grayBins.cols + int(v);
+        }
+        return -1;
+    }
+
+    void MiEvaluator::accumulate (const Eigen::Matrix3d &R, const Eigen::Vector3d &t, int begin, int end, MiCounts &acc) const
+    {
+        const int n = this->m_numBins;
+        const uchar *gray_bins = this->m_grayBins.ptr<uchar> ();
+        const double *x = this->m_points.col (0).data ();
+        const double *y = this->m_points.col (1).data ();
+        const double *z = this->m_points.col (2).data ();
+        for (int i = begin; i < end; i++) {
+            Eigen::Vector3d p = R * Eigen::Vector3d (x[i], y[i], z[i]) + t;
+            double u, v, uv_radius;
+            this->m_projector.project (p.x (), p.y (), p.z (), u, v, uv_radius);
+            const int pixel = pixel_index (u, v, uv_radius);
+            if (pixel >= 0) {
+                const int gray = gray_bins[pixel];
+                const int refc = this->m_refcBins[i];
+                acc.joint[gray * n + refc]++;
+                acc.gray[gray]++;
+                acc.refc[refc]++;
+                acc.count++;
+                acc.gray_sum += gray;
+                acc.refc_sum += refc;
+            }
+        }
+    }
+
+    Histogram MiEvaluator::to_histogram (const MiCounts &counts) const
+    {
+        const int n = this->m_numBins;
+        Histogram hist (n);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                hist.jointHist.at<float>(i, j) = counts.joint[i * n + j];
+            }
+            hist.grayHist.at<float>(i) = counts.gray[i];
+            hist.refcHist.at<float>(i) = counts.refc[i];
+        }
+        hist.count = counts.count;
+        hist.gray_sum = counts.gray_sum;
+        hist.refc_sum = counts.refc_sum;
+        return hist;
+    }
+
+    /**
+     * This function computes the histograms at a given transformation.
+     * Points are split over threads with a private histogram each, unless called from a parallel region.
+     */
+    Histogram MiEvaluator::histogram (const MiPose &pose) const
+    {
+        const int n = this->m_numBins;
+        const int num_points = this->m_points.rows ();
+        const Eigen::Matrix3d R = euler_rotation (pose.euler);
+
+        MiCounts total;
+        total.reset (n);
+
+        #pragma omp parallel if (!omp_in_parallel ())
+        {
+            MiCounts acc;
+            acc.reset (n);
+
+            const int num_threads = omp_get_num_threads ();
+            const int tid = omp_get_thread_num ();
+            const int begin = long(num_points) * tid / num_threads;
+            const int end = long(num_points) * (tid + 1) / num_threads;
+            accumulate (R, pose.translation, begin, end, acc);
+
+            #pragma omp critical (mi_histogram_merge)
+            {
+                for (int k = 0; k < n * n; k++) {
+                    total.joint[k] += acc.joint[k];
+                }
+                for (int k = 0; k < n; k++) {
+                    total.gray[k] += acc.gray[k];
+                    total.refc[k] += acc.refc[k];
+                }
+                total.count += acc.count;
+                total.gray_sum += acc.gray_sum;
+                total.refc_sum += acc.refc_sum;
+            }
+        }
+        return to_histogram (total);
+    }
+
+    /**
+     * This function projects every point once at the reference pose and keeps what the deltas need.
+     */
+    void MiEvaluator::init_state (const MiPose &pose, MiState &state) const
+    {
+        const int n = this->m_numBins;
+        const int num_points = this->m_points.rows ();
+        const uchar *gray_bins = this->m_grayBins.ptr<uchar> ();
+        state.pose = pose;
+        state.R = euler_rotation (pose.euler);
+        state.pixel.resize (num_points);
+        state.frac.resize (2 * num_points);
+        state.radius.resize (num_points);
+        state.jacobian.resize (6 * num_points);
+
+        #pragma omp parallel for if (!omp_in_parallel ())
+        for (int i = 0; i < num_points; i++) {
+            Eigen::Vector3d p = state.R * this->m_points.row (i).transpose () + pose.translation;
+            double u, v, uv_radius, J[6];
+            this->m_projector.project (p.x (), p.y (), p.z (), u, v, uv_radius);
+            this->m_projector.jacobian (p.x (), p.y (), p.z (), J);
+            state.pixel[i] = pixel_index (u, v, uv_radius);
+            state.frac[2 * i] = u - floor (u);
+            state.frac[2 * i + 1] = v - floor (v);
+            state.radius[i] = uv_radius;
+            for (int k = 0; k < 6; k++) {
+                state.jacobian[6 * i + k] = J[k];
+            }
+        }
+
+        state.counts.reset (n);
+        for (int i = 0; i < num_points; i++) {
+            if (state.pixel[i] >= 0) {
+                const int gray = gray_bins[state.pixel[i]];
+                const int refc = this->m_refcBins[i];
+                state.counts.joint[gray * n + refc]++;
+                state.counts.gray[gray]++;
+                state.counts.refc[refc]++;
+                state.counts.count++;
+                state.counts.gray_sum += gray;
+                state.counts.refc_sum += refc;
+            }
+        }
+    }
+
+    /**
+     * This function computes the histograms at pose as deltas of the reference state.
+     * The camera frame displacement of a point is exact, its pixel motion is predicted with the jacobian.
+     * A point keeps its pixel if the predicted position, widened by half the motion and a small fixed margin,
+     * stays inside its pixel and away from the radius bounds; all other points are projected again.
+     * The margin is a heuristic, not a bound on the second order terms, so a point near a pixel border can be
+     * kept in the wrong pixel and the result may differ slightly from histogram (pose).
+     */
+    Histogram MiEvaluator::delta_histogram (const MiState &state, const MiPose &pose, int *num_rebinned) const
+    {
+        const int n = this->m_numBins;
+        const int num_points = this->m_points.rows ();
+        const uchar *gray_bins = this->m_grayBins.ptr<uchar> ();
+        const Eigen::Matrix3d R = euler_rotation (pose.euler);
+        const Eigen::Matrix3d dR = R - state.R;
+        const Eigen::Vector3d dt = pose.translation - state.pose.translation;
+        const double kMinMargin = 0.02; /** pixels **/
+
+        /** (point, new pixel) of the points whose pixel changed **/
+        std::vector<std::pair<int, int>> changes;
+        int rebinned = 0;
+        #pragma omp parallel if (!omp_in_parallel ())
+        {
+            std::vector<std::pair<int, int>> local_changes;
+            int local_rebinned = 0;
+            #pragma omp for schedule(static) nowait
+            for (int i = 0; i < num_points; i++) {
+                const Eigen::Vector3d point = this->m_points.row (i).transpose ();
+                const Eigen::Vector3d dp = dR * point + dt;
+                const float *J = &state.jacobian[6 * i];
+                const double du = J[0] * dp.x () + J[1] * dp.y () + J[2] * dp.z ();
+                const double dv = J[3] * dp.x () + J[4] * dp.y () + J[5] * dp.z ();
+                const double motion = fabs (du) + fabs (dv);
+                const double margin = 0.5 * motion + kMinMargin;
+                const double u = state.frac[2 * i] + du;
+                const double v = state.frac[2 * i + 1] + dv;
+                const double r = state.radius[i];
+                /** NaN predictions fail every comparison and are projected again **/
+                const bool keep = u - margin >= 0 && u + margin < 1 && v - margin >= 0 && v + margin < 1
+                                  && fabs (r - this->m_rMin) > motion + margin && fabs (r - this->m_rMax) > motion + margin;
+                if (keep) {
+                    continue;
+                }
+                local_rebinned++;
+                const Eigen::Vector3d p = R * point + pose.translation;
+                double pu, pv, uv_radius;
+                this->m_projector.project (p.x (), p.y (), p.z (), pu, pv, uv_radius);
+                const int pixel = pixel_index (pu, pv, uv_radius);
+                if (pixel != state.pixel[i]) {
+                    local_changes.push_back ({i, pixel});
+                }
+            }
+            #pragma omp critical (mi_delta_merge)
+            {
+                changes.insert (changes.end (), local_changes.begin (), local_changes.end ());
+                rebinned += local_rebinned;
+            }
+        }
+
+        MiCounts counts = state.counts;
+        for (auto &change : changes) {
+            const int refc = this->m_refcBins[change.first];
+            const int old_pixel = state.pixel[change.first];
+            if (old_pixel >= 0) {
+                const int gray = gray_bins[old_pixel];
+                counts.joint[gray * n + refc]--;
+                counts.gray[gray]--;
+                counts.refc[refc]--;
+                counts.count--;
+                counts.gray_sum -= gray;
+                counts.refc_sum -= refc;
+            }
+            if (change.second >= 0) {
+                const int gray = gray_bins[change.second];
+                counts.joint[gray * n + refc]++;
+                counts.gray[gray]++;
+                counts.refc[refc]++;
+                counts.count++;
+                counts.gray_sum += gray;
+                counts.refc_sum += refc;
+            }
+        }
+        if (num_rebinned != nullptr) {
+            *num_rebinned = rebinned;
+        }
+        return to_histogram (counts);
+    }
+
+    float MiEvaluator::delta_cost (const MiState &state, const MiPose &pose) const
+    {
+        return cost (delta_histogram (state, pose), pose);
+    }
+
+    /** cubic B-spline kernel and its derivative **/
+    static inline double bspline3 (double x)
+    {
+        x = fabs (x);
+        if (x < 1) {
+            return 2.0 / 3 - x * x + 0.5 * x * x * x;
+        }
+        if (x < 2) {
+            return (2 - x) * (2 - x) * (2 - x) / 6;
+        }
+        return 0;
+    }
+
+    static inline double bspline3_derivative (double x)
+    {
+        const double ax = fabs (x);
+        if (ax < 1) {
+            return -2 * x + 1.5 * x * ax;
+        }
+        if (ax < 2) {
+            return (x > 0 ? -0.5 : 0.5) * (2 - ax) * (2 - ax);
+        }
+        return 0;
+    }
+
+    /**
+     * The joint distribution is p(g, r) = 1/N sum_i B(g - g_i) [r = r_i], with g_i the bilinear grayscale of point i
+     * in bin units, and the reflectivity marginal does not depend on the pose. Hence
+     * dMI = 1/N sum_i sum_g -B'(g - g_i) ln(p(g, r_i) / p(g)) dg_i,
+     * where dg_i follows from the image gradient, the projection jacobian and the derivatives of the rigid transform.
+     */
+    Eigen::Matrix<double, 6, 1> MiEvaluator::parzen_gradient (const MiPose &pose, double *parzen_mi) const
+    {
+        const int n = this->m_numBins;
+        const int num_points = this->m_points.rows ();
+        const int rows = this->m_grayValue.rows;
+        const int cols = this->m_grayValue.cols;
+        Eigen::Matrix3d dR[3];
+        const Eigen::Matrix3d R = euler_rotation (pose.euler, dR);
+
+        /** grayscale and its derivative w.r.t. the 6 parameters of every counted point **/
+        std::vector<float> gray (num_points, -1);
+        std::vector<float> dgray (6 * num_points, 0);
+        std::vector<double> joint (n * n, 0);
+        long count = 0;
+        this->m_numEvaluations++;
+
+        #pragma omp parallel if (!omp_in_parallel ())
+        {
+            std::vector<double> local_joint (n * n, 0);
+            long local_count = 0;
+            #pragma omp for schedule(static) nowait
+            for (int i = 0; i < num_points; i++) {
+                const Eigen::Vector3d point = this->m_points.row (i).transpose ();
+                const Eigen::Vector3d p = R * point + pose.translation;
+                double u, v, uv_radius;
+                this->m_projector.project (p.x (), p.y (), p.z (), u, v, uv_radius);
+                if (pixel_index (u, v, uv_radius) < 0 || u > rows - 1 || v > cols - 1) {
+                    continue;
+                }
+                const int u0 = std::min (int(u), rows - 2);
+                const int v0 = std::min (int(v), cols - 2);
+                const double wu = u - u0, wv = v - v0;
+                const float *row0 = this->m_grayValue.ptr<float> (u0);
+                const float *row1 = this->m_grayValue.ptr<float> (u0 + 1);
+                const double g = std::min (double(n - 1), (1 - wu) * ((1 - wv) * row0[v0] + wv * row0[v0 + 1])
+                                                          + wu * ((1 - wv) * row1[v0] + wv * row1[v0 + 1]));
+                gray[i] = g;
+
+                /** derivatives of the bilinear interpolant **/
+                double J[6];
+                this->m_projector.jacobian (p.x (), p.y (), p.z (), J);
+                const double gu = (1 - wv) * (row1[v0] - row0[v0]) + wv * (row1[v0 + 1] - row0[v0 + 1]);
+                const double gv = (1 - wu) * (row0[v0 + 1] - row0[v0]) + wu * (row1[v0 + 1] - row1[v0]);
+                /** d gray / d camera frame point **/
+                const Eigen::Vector3d w (gu * J[0] + gv * J[3], gu * J[1] + gv * J[4], gu * J[2] + gv * J[5]);
+                for (int k = 0; k < 3; k++) {
+                    dgray[6 * i + k] = w[k];
+                    dgray[6 * i + 3 + k] = w.dot (dR[k] * point);
+                }
+
+                const int refc = this->m_refcBins[i];
+                for (int b = int(g) - 1; b <= int(g) + 2; b++) {
+                    if (b >= 0 && b < n) {
+                        local_joint[b * n + refc] += bspline3 (b - g);
+                    }
+                }
+                local_count++;
+            }
+            #pragma omp critical (mi_parzen_merge)
+            {
+                for (int k = 0; k < n * n; k++) {
+                    joint[k] += local_joint[k];
+                }
+                count += local_count;
+            }
+        }
+
+        Eigen::Matrix<double, 6, 1> gradient = Eigen::Matrix<double, 6, 1>::Zero ();
+        if (count == 0) {
+            return gradient;
+        }
+
+        /** ln(p(g, r) / p(g)), the kernel mass is normalized over the bins **/
+        double mass = 0;
+        for (int k = 0; k < n * n; k++) {
+            mass += joint[k];
+        }
+        std::vector<double> gray_prob (n, 0);
+        std::vector<double> refc_prob (n, 0);
+        for (int g = 0; g < n; g++) {
+            for (int r = 0; r < n; r++) {
+                joint[g * n + r] /= mass;
+                gray_prob[g] += joint[g * n + r];
+                refc_prob[r] += joint[g * n + r];
+            }
+        }
+        std::vector<float> log_ratio (n * n, 0);
+        double mi = 0;
+        for (int g = 0; g < n; g++) {
+            for (int r = 0; r < n; r++) {
+                const double p = joint[g * n + r];
+                if (p > 0) {
+                    log_ratio[g * n + r] = log (p / gray_prob[g]);
+                    mi += p * (log_ratio[g * n + r] - log (refc_prob[r]));
+                }
+            }
+        }
+
+        std::vector<double> partial (6, 0);
+        #pragma omp parallel if (!omp_in_parallel ())
+        {
+            double local_partial[6] = {0, 0, 0, 0, 0, 0};
+            #pragma omp for schedule(static) nowait
+            for (int i = 0; i < num_points; i++) {
+                const double g = gray[i];
+                if (g < 0) {
+                    continue;
+                }
+                const int refc = this->m_refcBins[i];
+                double weight = 0;
+                for (int b = int(g) - 1; b <= int(g) + 2; b++) {
+                    if (b >= 0 && b < n) {
+                        weight -= bspline3_derivative (b - g) * log_ratio[b * n + refc];
+                    }
+                }
+                for (int k = 0; k < 6; k++) {
+                    local_partial[k] += weight * dgray[6 * i + k];
+                }
+            }
+            #pragma omp critical (mi_parzen_merge)
+            for (int k = 0; k < 6; k++) {
+                partial[k] += local_partial[k];
+            }
+        }
+        for (int k = 0; k < 6; k++) {
+            gradient[k] = partial[k] / mass;
+        }
+        if (parzen_mi != nullptr) {
+            *parzen_mi = mi;
+        }
+        return gradient;
+    }
+
+    /**
+     * This function calculates the MLE of the distribution, smoothed with the Silverman bandwidth.
+     */
+    Probability MiEvaluator::probability_MLE (const Histogram &hist, double *corr_coeff)
+    {
+        const int num_bins = hist.grayHist.cols;
+        //Calculate sample covariance matrix
+        float mu_gray = float(hist.gray_sum)/hist.count;
+        float mu_refc = float(hist.refc_sum)/hist.count;
+        //Covariances
+        double sigma_gray = 0;
+        double sigma_refc = 0;
+        //Cross correlation
+        double sigma_gr = 0;
+
+        Probability probMLE (num_bins);
+
+        for (int i = 0; i < num_bins; i++)
+        {
+           for (int j = 0; j < num_bins; j++)
+           {
+             //Cross Correlation term;
+             sigma_gr = sigma_gr + hist.jointHist.at<float>(i, j)*(i - mu_refc)*(j - mu_gray);
+             //Normalize the histogram so that the value is between (0,1)
+             probMLE.jointProb.at<float>(i, j) = hist.jointHist.at<float>(i, j)/(hist.count);
+           }
+
+           //calculate sample covariance
+           sigma_gray = sigma_gray + (hist.grayHist.at<float>(i)*(i - mu_gray)*(i - mu_gray));
+           sigma_refc = sigma_refc + (hist.refcHist.at<float>(i)*(i - mu_refc)*(i - mu_refc));
+
+           probMLE.grayProb.at<float>(i) = hist.grayHist.at<float>(i)/hist.count;
+           probMLE.refcProb.at<float>(i) = hist.refcHist.at<float>(i)/hist.count;
+        }
+
+        sigma_gray = sigma_gray/hist.count;
+        sigma_refc = sigma_refc/hist.count;
+        sigma_gr = sigma_gr/hist.count;
+        if (corr_coeff != nullptr) {
+            *corr_coeff = fabs (sigma_gr/(sigma_gray*sigma_refc));
+        }
+
+        //Compute the optimal bandwidth (Silverman's rule of thumb)
+        sigma_gray = 1.06*sqrt (sigma_gray)/pow (hist.count, 0.2);
+        sigma_refc = 1.06*sqrt (sigma_refc)/pow (hist.count, 0.2);
+
+        cv::GaussianBlur (probMLE.grayProb, probMLE.grayProb, cv::Size(0, 0), sigma_gray);
+        cv::GaussianBlur (probMLE.refcProb, probMLE.refcProb, cv::Size(0, 0), sigma_refc);
+        cv::GaussianBlur (probMLE.jointProb, probMLE.jointProb, cv::Size(0, 0), sigma_gray, sigma_refc);
+        probMLE.count = hist.count;
+        return probMLE;
+    }
+
+    /**
+     * This calculates the Bayes estimate of distribution
+     */
+    Probability MiEvaluator::probability_Bayes (const Histogram &hist, double *corr_coeff)
+    {
+        const int num_bins = hist.grayHist.cols;
+        float a = 1; //0.5 , 1/num_bins, sqrt (count)/num_bins etc
+        float A_joint = num_bins*num_bins;
+        float A_marg = num_bins;
+        Probability probBayes (num_bins);
+        //Calculate sample covariance matrix
+        float mu_gray = float(hist.gray_sum)/hist.count;
+        float mu_refc = float(hist.refc_sum)/hist.count;
+        //Covariances
+        double sigma_gray = 0;
+        double sigma_refc = 0;
+        //Cross correlation
+        double sigma_gr = 0;
+
+        for (int i = 0; i < num_bins; i++)
+        {
+           for (int j = 0; j < num_bins; j++)
+           {
+             //Cross Correlation term;
+             sigma_gr = sigma_gr + hist.jointHist.at<float>(i, j)*(i - mu_refc)*(j - mu_gray);
+             //Normalize the histogram so that the value is between (0,1)
+             probBayes.jointProb.at<float>(i, j) = (hist.jointHist.at<float>(i, j)+a)/(hist.count + A_joint);
+           }
+
+           //calculate sample covariance
+           sigma_gray = sigma_gray + (hist.grayHist.at<float>(i)*(i - mu_gray)*(i - mu_gray));
+           sigma_refc = sigma_refc + (hist.refcHist.at<float>(i)*(i - mu_refc)*(i - mu_refc));
+
+           probBayes.grayProb.at<float>(i) = (hist.grayHist.at<float>(i) + a)/(hist.count + A_marg);
+           probBayes.refcProb.at<float>(i) = (hist.refcHist.at<float>(i) + a)/(hist.count + A_marg);
+        }
+
+        sigma_gray = sigma_gray/hist.count;
+        sigma_refc = sigma_refc/hist.count;
+        sigma_gr = sigma_gr/hist.count;
+        if (corr_coeff != nullptr) {
+            *corr_coeff = fabs (sigma_gr/(sigma_gray*sigma_refc));
+        }
+
+        //Compute the optimal bandwidth (Silverman's rule of thumb)
+        sigma_gray = 1.06*sqrt (sigma_gray)/pow (hist.count, 0.2);
+        sigma_refc = 1.06*sqrt (sigma_refc)/pow (hist.count, 0.2);
+
+        cv::GaussianBlur (probBayes.grayProb, probBayes.grayProb, cv::Size(0, 0), sigma_gray);
+        cv::GaussianBlur (probBayes.refcProb, probBayes.refcProb, cv::Size(0, 0), sigma_refc);
+        cv::GaussianBlur (probBayes.jointProb, probBayes.jointProb, cv::Size(0, 0), sigma_gray, sigma_refc);
+        probBayes.count = hist.count;
+        return probBayes;
+    }
+
+    /**
+     * This function calculates the JS estimate from the MLE.
+     * Reference: Entropy inference and the James Stein estimator. Hausser and Strimmer.
+     */
+    Probability MiEvaluator::probability_JS (const Probability &probMLE) const
+    {
+        //Sample Variance of MLE, lambda = (1 - sum theta_k^2) / sum (t_k - theta_k)^2 / (n - 1)
+        float squareSumMLE = cv::norm (probMLE.jointProb);
+        squareSumMLE = (squareSumMLE*squareSumMLE);
+        //Difference of MLE from the target
+        float squareDiffMLETarget = cv::norm (this->m_jointTarget, probMLE.jointProb);
+        squareDiffMLETarget = (squareDiffMLETarget*squareDiffMLETarget);
+
+        float lambda = (1.0-squareSumMLE)/squareDiffMLETarget;
+        lambda = (lambda/(probMLE.count-1));
+        if (lambda > 1)
+            lambda = 1;
+        if (lambda < 0)
+            lambda = 0;
+
+        //Get the JS estimate as a weighted combination of target and the MLE
+        Probability probJS (this->m_numBins);
+        probJS.jointProb = this->m_jointTarget*lambda + probMLE.jointProb*(1.0-lambda);
+        probJS.grayProb = this->m_grayTarget*lambda + probMLE.grayProb*(1.0-lambda);
+        probJS.refcProb = this->m_refcTarget*lambda + probMLE.refcProb*(1.0-lambda);
+        probJS.count = probMLE.count;
+        return probJS;
+    }
+
+    Probability MiEvaluator::probability (const Histogram &hist) const
+    {
+        switch (this->m_estimatorType)
+        {
+            case 2: //James-Stein type
+                return probability_JS (probability_MLE (hist));
+            case 3: //Bayes estimator
+                return probability_Bayes (hist);
+            default: //MLE
+                return probability_MLE (hist);
+        }
+    }
+
+    /**
+     * Cells with p below the smallest normal float contribute nothing, as p ln p -> 0.
+     */
+    double MiEvaluator::entropy (const cv::Mat &prob) const
+    {
+        double entropy = 0;
+        for (int r = 0; r < prob.rows; r++) {
+            const float *row = prob.ptr<float> (r);
+            for (int c = 0; c < prob.cols; c++) {
+                const float p = row[c];
+                if (p >= std::numeric_limits<float>::min ()) {
+                    entropy -= p * fast_log (p);
+                }
+            }
+        }
+        return entropy;
+    }
+
+    /**
+     * This function calculates the cost based on mutual information
+     */
+    float MiEvaluator::cost (const MiPose &pose) const
+    {
+        return cost (histogram (pose), pose);
+    }
+
+    float MiEvaluator::cost (const Histogram &hist, const MiPose &pose) const
+    {
+        this->m_numEvaluations++;
+        if (hist.count == 0) {
+            return 0;
+        }
+        Probability prob = probability (hist);
+        if (this->m_debugHook) {
+            #pragma omp critical (mi_debug_hook)
+            this->m_debugHook (pose, hist, prob);
+        }
+
+        double Hx = entropy (prob.grayProb);
+        double Hy = entropy (prob.refcProb);
+        double Hxy = entropy (prob.jointProb);
+        return Hx + Hy - Hxy;
+    }
+
+    std::vector<float> MiEvaluator::cost_batch (const std::vector<MiPose> &poses) const
+    {
+        std::vector<float> costs (poses.size ());
+        const bool pose_parallel = poses.size () >= omp_get_max_threads ();
+        /** with few poses each one is evaluated with all threads over its points instead **/
+        #pragma omp parallel for schedule(dynamic) if (pose_parallel)
+        for (int i = 0; i < poses.size (); i++) {
+            costs[i] = cost (poses[i]);
+        }
+        return costs;
+    }
+}
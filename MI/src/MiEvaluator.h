@@ -0,0 +1,195 @@
+#ifndef _MI_EVALUATOR_H_
+#define _MI_EVALUATOR_H_
+/** basic **/
+#include <vector>
+#include <atomic>
+#include <functional>
+/** openmp **/
+#include <omp.h>
+/** opencv **/
+#include <opencv2/core/core.hpp>
+/** pcl **/
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <Eigen/Core>
+/** shared fisheye projection kernel of the calibration package **/
+#include "omni_projector.h"
+
+namespace perls
+{
+    class Probability
+    {
+        public:
+          Probability (){};
+          Probability (int n)
+          {
+              jointProb = cv::Mat::zeros (n, n, CV_32FC1);
+              refcProb = cv::Mat::zeros (1, n, CV_32FC1);
+              grayProb = cv::Mat::zeros (1, n, CV_32FC1);
+              count = 0;
+          };
+          ~Probability () {};
+          //joint Probability
+          cv::Mat jointProb;
+          //marginal probability reflectivity
+          cv::Mat refcProb;
+          //marginal probability grayscale
+          cv::Mat grayProb;
+          int count;
+    };
+
+    class Histogram
+    {
+        public:
+          Histogram (){};
+          Histogram (int n)
+          {
+              jointHist = cv::Mat::zeros (n, n, CV_32FC1);
+              refcHist = cv::Mat::zeros (1, n, CV_32FC1);
+              grayHist = cv::Mat::zeros (1, n, CV_32FC1);
+              count = 0;
+              gray_sum = 0;
+              refc_sum = 0;
+          };
+          ~Histogram () {};
+          //joint Histogram
+          cv::Mat jointHist;
+          cv::Mat refcHist;
+          cv::Mat grayHist;
+          int count;
+          int gray_sum;
+          int refc_sum;
+    };
+
+    /** candidate extrinsic, translation in xyz and euler angle in zyx order as in Calibration **/
+    struct MiPose
+    {
+        Eigen::Vector3d translation;
+        Eigen::Vector3d euler;
+    };
+
+    /** integer histograms, jointly indexed as gray * num_bins + refc **/
+    struct MiCounts
+    {
+        std::vector<int> joint;
+        std::vector<int> gray;
+        std::vector<int> refc;
+        long count = 0;
+        long gray_sum = 0;
+        long refc_sum = 0;
+
+        void reset (int num_bins)
+        {
+            joint.assign (num_bins * num_bins, 0);
+            gray.assign (num_bins, 0);
+            refc.assign (num_bins, 0);
+            count = gray_sum = refc_sum = 0;
+        }
+    };
+
+    /**
+     * Bin assignment of every point at a reference pose, the base of the histogram deltas.
+     * The position inside the pixel, the radius and the 2x3 pixel jacobian w.r.t. the camera frame point
+     * predict which points can change pixel.
+     **/
+    struct MiState
+    {
+        MiPose pose;
+        Eigen::Matrix3d R;
+        std::vector<int> pixel; /** row * cols + col of the counted points, -1 otherwise **/
+        std::vector<float> frac; /** fractional (u, v) inside the pixel, 2 per point **/
+        std::vector<float> radius;
+        std::vector<float> jacobian; /** 6 per point, row major **/
+        MiCounts counts;
+    };
+
+    /**
+     * In-memory mutual information between the fisheye grayscale and the LiDAR reflectivity.
+     * Points are kept in SoA layout and their reflectivity bins, as well as the grayscale bin of every pixel,
+     * are computed once at construction; a pose evaluation only projects, bins and reduces.
+     * Histograms are accumulated per thread and merged, entropies use a table based logarithm.
+     * Nothing is written to disk, the debug hook receives the histogram and probability of each evaluated pose.
+     **/
+    class MiEvaluator
+    {
+        public:
+          typedef std::function<void (const MiPose &, const Histogram &, const Probability &)> DebugHook;
+
+          /** estimator_type: 1 MLE, 2 James-Stein, 3 Bayes, as Calibration::m_estimatorType **/
+          MiEvaluator (const Eigen::VectorXd &intrinsic,
+                       const cv::Mat &gray_img,
+                       const pcl::PointCloud<pcl::PointXYZI> &cloud,
+                       int num_bins,
+                       int bin_fraction,
+                       int estimator_type);
+
+          /** points count if r_min < radius < r_max, radius before the affine correction **/
+          void set_radius_bounds (double r_min, double r_max);
+          void set_estimator_type (int estimator_type) { m_estimatorType = estimator_type; }
+          void set_debug_hook (DebugHook hook) { m_debugHook = hook; }
+
+          int num_points () const { return m_points.rows (); }
+          /** cost and gradient evaluations since construction, for throughput measurements **/
+          long num_evaluations () const { return m_numEvaluations; }
+
+          Histogram histogram (const MiPose &pose) const;
+          /** MI = H(gray) + H(refc) - H(gray, refc) **/
+          float cost (const MiPose &pose) const;
+          /** one cost per pose, poses are spread over threads when there are enough of them **/
+          std::vector<float> cost_batch (const std::vector<MiPose> &poses) const;
+
+          /** histograms from the reference state, only the points whose projected pixel may change are re-binned **/
+          void init_state (const MiPose &pose, MiState &state) const;
+          Histogram state_histogram (const MiState &state) const { return to_histogram (state.counts); }
+          Histogram delta_histogram (const MiState &state, const MiPose &pose, int *num_rebinned = nullptr) const;
+          float delta_cost (const MiState &state, const MiPose &pose) const;
+          /** cost of a histogram already computed at pose **/
+          float cost (const Histogram &hist, const MiPose &pose) const;
+
+          /**
+           * Analytic gradient of the Parzen-window MI, cubic B-spline kernel over the bilinear grayscale,
+           * in the order tx, ty, tz, euler[0], euler[1], euler[2]. The set of counted points is held fixed.
+           **/
+          Eigen::Matrix<double, 6, 1> parzen_gradient (const MiPose &pose, double *parzen_mi = nullptr) const;
+
+          /** estimators, corr_coeff receives the correlation coefficient of the histogram if given **/
+          static Probability probability_MLE (const Histogram &hist, double *corr_coeff = nullptr);
+          static Probability probability_Bayes (const Histogram &hist, double *corr_coeff = nullptr);
+          Probability probability_JS (const Probability &probMLE) const;
+          Probability probability (const Histogram &hist) const;
+
+          /** -sum p ln p over all cells of a probability matrix **/
+          double entropy (const cv::Mat &prob) const;
+
+        private:
+          static const int kLogTableBits = 10;
+
+          void accumulate (const Eigen::Matrix3d &R, const Eigen::Vector3d &t, int begin, int end, MiCounts &acc) const;
+          Histogram to_histogram (const MiCounts &counts) const;
+          /** linear pixel index of a counted point, -1 if out of the frame or the radius bounds **/
+          inline int pixel_index (double u, double v, double uv_radius) const;
+
+          /** ln(p) from the exponent and a linearly interpolated table over the mantissa, p must be normal **/
+          inline float fast_log (float p) const;
+
+          OmniProjector m_projector;
+          PointsSoA m_points;
+          std::vector<uint16_t> m_refcBins;
+          cv::Mat m_grayBins; /** CV_8UC1, bin of each pixel **/
+          cv::Mat m_grayValue; /** CV_32FC1, grayscale in bin units for the parzen window **/
+          int m_numBins;
+          int m_binFraction;
+          int m_estimatorType;
+          double m_rMin = 400;
+          double m_rMax = 1000;
+          std::vector<float> m_logTable;
+
+          cv::Mat m_jointTarget;
+          cv::Mat m_grayTarget;
+          cv::Mat m_refcTarget;
+
+          DebugHook m_debugHook;
+          mutable std::atomic<long> m_numEvaluations {0};
+    };
+}
+#endif //_MI_EVALUATOR_H_
@@ -5,8 +5,9 @@ std::ofstream outfile;
 
 const bool kOptimization = false;
 const bool kCostViz = true;
+const bool kGridSearch = false; /** hierarchical grid search before the gradient based optimization **/
 
-void DualCost(perls::Calibration calib, Eigen::Vector3d translation, Eigen::Vector3d euler_angle) {
+void DualCost(perls::Calibration &calib, Eigen::Vector3d translation, Eigen::Vector3d euler_angle) {
     /***** Correlation Analysis *****/
     std::vector<double> inputs1, inputs2;
     std::vector<const char*> euler_name = {
@@ -24,8 +25,7 @@ void DualCost(perls::Calibration calib, Eigen::Vector3d translation, Eigen::Vect
     const int modified_idx2 = 0; // tx
     double offset2;
 
-    double cost;
-    std::vector<double> results;
+    std::vector<perls::MiPose> poses;
 
     for (int param1 = 0; param1 <= steps; param1++) {
         Eigen::Vector3d euler_angle_tmp = euler_angle;
@@ -39,12 +39,14 @@ void DualCost(perls::Calibration calib, Eigen::Vector3d translation, Eigen::Vect
 
             inputs1.push_back(euler_angle_tmp(modified_idx1));
             inputs2.push_back(translation_tmp(modified_idx2));
-            /** Evaluate cost funstion **/
-            cost = calib.mi_cost(translation_tmp, euler_angle_tmp);
-            results.push_back(cost);
-            std::cout << "Step: " << param1 << " " << param2 << " Value of " << euler_name[modified_idx1] << ": " << euler_angle_tmp(modified_idx1) << " Value of " << translation_name[modified_idx2] << ": " << translation_tmp(modified_idx2) << " Cost of MI: " << cost << std::endl;
+            poses.push_back({translation_tmp, euler_angle_tmp});
         }
     }
+    /** Evaluate cost funstion on the whole grid at once **/
+    std::vector<float> results = calib.mi_cost_batch(poses);
+    for (int i = 0; i < results.size(); i++) {
+        std::cout << "Step: " << i / (steps + 1) << " " << i % (steps + 1) << " Value of " << euler_name[modified_idx1] << ": " << inputs1[i] << " Value of " << translation_name[modified_idx2] << ": " << inputs2[i] << " Cost of MI: " << results[i] << std::endl;
+    }
     outfile.open(calib.cost_path + "/" + euler_name[modified_idx1] + "_" + translation_name[modified_idx2] + "_result.txt", std::ios::out);
     for (int i = 0; i < (steps + 1) * (steps + 1); i++) {
         outfile << inputs1[i] << "\t" << inputs2[i] << "\t" << results[i] << std::endl;
@@ -52,7 +54,7 @@ void DualCost(perls::Calibration calib, Eigen::Vector3d translation, Eigen::Vect
     outfile.close();
 }
 
-void SingleTranslationCost(perls::Calibration calib, Eigen::Vector3d translation, Eigen::Vector3d euler_angle, int param_idx) {
+void SingleTranslationCost(perls::Calibration &calib, Eigen::Vector3d translation, Eigen::Vector3d euler_angle, int param_idx) {
     /***** Correlation Analysis *****/
     std::vector<double> inputs;
     std::vector<const char*> translation_name = {"tx", "ty", "tz"};
@@ -61,17 +63,18 @@ void SingleTranslationCost(perls::Calibration calib, Eigen::Vector3d translation
     const double step_size = 0.01; /** step in meter **/ /** should be 0.015 **/
     double offset;
 
-    double cost;
-    std::vector<double> results;
+    std::vector<perls::MiPose> poses;
     for (int param = 0; param <= steps; param++) {
         Eigen::Vector3d translation_tmp = translation;
         offset = step_size * (param - (steps/2));
         translation_tmp(param_idx) = translation_tmp(param_idx) + offset;
         inputs.push_back(translation_tmp(param_idx));
-        /** Evaluate cost funstion **/
-        cost = calib.mi_cost(translation_tmp, euler_angle);
-        results.push_back(cost);
-        std::cout << "Step: " << param << " Value of " << translation_name[param_idx] << ": " << translation_tmp(param_idx) << " Cost of MI: " << cost << std::endl;
+        poses.push_back({translation_tmp, euler_angle});
+    }
+    /** Evaluate cost funstion on the whole sweep at once **/
+    std::vector<float> results = calib.mi_cost_batch(poses);
+    for (int param = 0; param <= steps; param++) {
+        std::cout << "Step: " << param << " Value of " << translation_name[param_idx] << ": " << inputs[param] << " Cost of MI: " << results[param] << std::endl;
     }
     outfile.open(calib.cost_path + "/" + translation_name[param_idx] + "_result.txt", std::ios::out);
     for (int i = 0; i < (steps + 1); i++) {
@@ -80,7 +83,7 @@ void SingleTranslationCost(perls::Calibration calib, Eigen::Vector3d translation
     outfile.close();
 }
 
-void SingleRotationCost(perls::Calibration calib, Eigen::Vector3d translation, Eigen::Vector3d euler_angle, int param_idx) {
+void SingleRotationCost(perls::Calibration &calib, Eigen::Vector3d translation, Eigen::Vector3d euler_angle, int param_idx) {
     /***** Correlation Analysis *****/
     std::vector<double> inputs;
     std::vector<const char*> euler_name = {"rz", "ry", "rx"};
@@ -89,17 +92,18 @@ void SingleRotationCost(perls::Calibration calib, Eigen::Vector3d translation, E
     const double step_size = 0.005; /** step in radian **/
     double offset;
 
-    double cost;
-    std::vector<double> results;
+    std::vector<perls::MiPose> poses;
     for (int param = 0; param <= steps; param++) {
         Eigen::Vector3d euler_angle_tmp = euler_angle;
         offset = double(step_size * (param - (steps/2)));
         euler_angle_tmp(param_idx) += offset;
         inputs.push_back(euler_angle_tmp(param_idx));
-        /** Evaluate cost funstion **/
-        cost = calib.mi_cost(translation, euler_angle_tmp);
-        results.push_back(cost);
-        std::cout << "Step: " << param << " Value of " << euler_name[param_idx] << ": " << euler_angle_tmp(param_idx) << " Cost of MI: " << cost << std::endl;
+        poses.push_back({translation, euler_angle_tmp});
+    }
+    /** Evaluate cost funstion on the whole sweep at once **/
+    std::vector<float> results = calib.mi_cost_batch(poses);
+    for (int param = 0; param <= steps; param++) {
+        std::cout << "Step: " << param << " Value of " << euler_name[param_idx] << ": " << inputs[param] << " Cost of MI: " << results[param] << std::endl;
     }
     outfile.open(calib.cost_path + "/" + euler_name[param_idx] + "_result.txt", std::ios::out);
     for (int i = 0; i < (steps + 1); i++) {
@@ -141,7 +145,9 @@ int main (int argc, char** argv)
 
     if (kCostViz) {
         double cost = calib.mi_cost(calib.translation, calib.euler_angle);
-        calib.get_histogram(calib.translation, calib.euler_angle);
+        /** histograms of the reference pose for inspection **/
+        perls::Histogram hist = calib.get_histogram(calib.translation, calib.euler_angle);
+        calib.save_debug_output(hist, calib.get_probability_MLE(hist));
         for (int idx = 0; idx < 3; ++idx) {
             SingleTranslationCost(calib, calib.translation, calib.euler_angle, idx); /** single translation cost analysis **/
             SingleRotationCost(calib, calib.translation, calib.euler_angle, idx); /** single translation cost analysis **/
@@ -151,6 +157,14 @@ int main (int argc, char** argv)
 //        }
     }
 
+    /** pruned parallel grid search, refines the initial extrinsic in place **/
+    if (kGridSearch) {
+        printf ("****************************************************************************\n");
+        printf ("Cost | x (m) | y (m) | z (m) | roll (degree) | pitch (degree) | yaw (degree)\n");
+        printf ("****************************************************************************\n");
+        calib.hierarchical_grid_search (calib.translation, calib.euler_angle);
+    }
+
     /** gradient based optimization **/
     double opt_cost = 0;
     if (kOptimization) {
@@ -0,0 +1,44 @@
+#ifndef CALIB_LOG_H
+#define CALIB_LOG_H
+
+/**
+ * Logging of the core libraries. The node build forwards the ROS_* macros to rosconsole; the headless build
+ * (CALIB_HEADLESS) prints whole lines to stdout / stderr with the same format strings, and a failed assertion aborts
+ * like ROS_ASSERT does, only in builds without NDEBUG.
+ **/
+#ifndef CALIB_HEADLESS
+#include <ros/ros.h>
+#else
+/** basic **/
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+/** one fprintf per line, so lines of concurrent threads do not interleave **/
+inline void calibLog(FILE *stream, const char *level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+inline void calibLog(FILE *stream, const char *level, const char *format, ...) {
+    char line[4096];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    fprintf(stream, "[%s] %s\n", level, line);
+}
+
+#define ROS_INFO(...) calibLog(stdout, " INFO", __VA_ARGS__)
+#define ROS_WARN(...) calibLog(stderr, " WARN", __VA_ARGS__)
+#define ROS_ERROR(...) calibLog(stderr, "ERROR", __VA_ARGS__)
+#define ROS_INFO_STREAM(args) \
+    do { std::ostringstream calib_log_stream; calib_log_stream << args; ROS_INFO("%s", calib_log_stream.str().c_str()); } while (0)
+/** compiled out under NDEBUG, as rosconsole does **/
+#ifndef NDEBUG
+#define ROS_ASSERT_MSG(cond, ...) \
+    do { if (!(cond)) { calibLog(stderr, "FATAL", __VA_ARGS__); fflush(stdout); abort(); } } while (0)
+#else
+#define ROS_ASSERT_MSG(cond, ...) do { } while (0)
+#endif
+#define ROS_ASSERT(cond) ROS_ASSERT_MSG(cond, "assertion failed: %s", #cond)
+#endif
+
+#endif
@@ -14,16 +14,14 @@
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 
-// sensor_msg
-#include <sensor_msgs/PointCloud2.h>
-#include <sensor_msgs/point_cloud_conversion.h>
-
 // headings
 #include "define.h"
+#include "calib_log.h"
+#include "trace.h"
 
 using namespace std;
 
-int CheckFolder(std::string spot_path) {
+inline int CheckFolder(std::string spot_path) {
     int md = 0; /** 0 means the folder is already exist or has been created successfully **/
     if (0 != access(spot_path.c_str(), 0)) {
         /** if this folder not exist, create a new one **/
@@ -55,12 +53,13 @@ template <typename PointType>
 void loadPcd(string filepath, pcl::PointCloud<PointType> &cloud, const char* name="") {
     ROS_INFO("Loading %s cloud.\n Filepath: %s", name, filepath.c_str());
     int status = pcl::io::loadPCDFile<PointType>(filepath, cloud);
+    traceFileRead(filepath);
     if (MESSAGE_EN) {
         ROS_INFO("Loaded %ld points into %s cloud.\n", cloud.points.size(), name);
     }
 }
 
-Eigen::Matrix4f LoadTransMat(std::string trans_path){
+inline Eigen::Matrix4f LoadTransMat(std::string trans_path){
     std::ifstream load_stream;
     load_stream.open(trans_path);
     Eigen::Matrix4f trans_mat = Eigen::Matrix4f::Identity();
@@ -135,7 +134,7 @@ Eigen::Matrix<T, 2, 1> IntrinsicTransform(Eigen::Matrix<T, K_INT, 1> &intrinsic,
     return undistorted_projection;
 }
 
-void saveResults(std::string &record_path, std::vector<double> params, double bandwidth, double initial_cost, double final_cost) {
+inline void saveResults(std::string &record_path, std::vector<double> params, double bandwidth, double initial_cost, double final_cost) {
     const std::vector<const char*> name = {
             "rx", "ry", "rz",
             "tx", "ty", "tz",
@@ -0,0 +1,50 @@
+#ifndef COVERAGE_MONITOR_H
+#define COVERAGE_MONITOR_H
+/** basic **/
+#include <string>
+#include <vector>
+#include <cstdint>
+/** pcl **/
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+/** eigen **/
+#include <Eigen/Core>
+/** opencv **/
+#include <opencv2/opencv.hpp>
+
+/**
+ * Streaming spherical coverage of a LiDAR view on the flat image grid of LidarProcess::sphereToPlane.
+ * A pixel counts as covered once a point falls into it, the coverage is the covered fraction of the region
+ * (non-zero pixels of the mask, or the whole grid without one). One sample of the curve per ingested cloud.
+ **/
+class CoverageMonitor {
+public:
+    CoverageMonitor(int rows, int cols, const Eigen::Matrix3f &rotation, const cv::Mat &mask = cv::Mat());
+
+    /** returns the number of newly covered pixels **/
+    int addCloud(const pcl::PointCloud<pcl::PointXYZI> &cloud);
+
+    double coverage() const;
+    /** coverage gained over the last window clouds **/
+    double recentGain(int window) const;
+    /** the target coverage is reached, or the last window clouds added less than min_gain **/
+    bool saturated(double target, int window, double min_gain) const;
+
+    const std::vector<double> &curve() const {
+        return curve_;
+    }
+    void saveCurve(const std::string &path) const;
+
+private:
+    const int rows_;
+    const int cols_;
+    const float rad_per_pix_;
+    const Eigen::Matrix3f rotation_;
+    std::vector<uint8_t> region_;
+    std::vector<uint8_t> occupied_;
+    long region_size_ = 0;
+    long covered_ = 0;
+    std::vector<double> curve_;
+};
+
+#endif
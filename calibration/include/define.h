@@ -1,14 +1,23 @@
+#ifndef DEFINE_H
+#define DEFINE_H
 #include <Eigen/Core>
 #include <pcl/common/common.h>
 
+/** thread count of the parallel regions, read at every region so benchmarks can sweep it at runtime **/
+inline int &threadCount() {
+    static int num_threads = 16;
+    return num_threads;
+}
+
 #define PI_M                (3.14159265358)
-#define THREADS             (16)
+#define THREADS             (threadCount())
 
 #define K_INT               (10)
 #define KDE_SCALE           (1)
 #define SAMPLING_RADIUS     (0.01)
 #define MESSAGE_EN          (1)
 #define EXTRA_FILE_EN       (0)
+#define LUT_MAX_ERROR       (0.01) /** pixels, interpolation error bound of the fisheye radius table **/
 
 #define MatD(a,b)           Eigen::Matrix<double, (a), (b)>
 #define MatF(a,b)           Eigen::Matrix<float, (a), (b)>
@@ -37,4 +46,6 @@ typedef pcl::PointXYZRGB PointRGB;
 typedef pcl::PointCloud<PointI> CloudI;
 typedef pcl::PointCloud<PointRGB> CloudRGB;
 
-typedef std::pair<int, int> Pair;
\ No newline at end of file
+typedef std::pair<int, int> Pair;
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef EDGE_EXTRACTION_H
+#define EDGE_EXTRACTION_H
+/** basic **/
+#include <string>
+#include <vector>
+/** opencv **/
+#include <opencv2/opencv.hpp>
+/** headings **/
+#include <define.h>
+
+/**
+ * In-process port of python_scripts/image_process/edge_extraction.py.
+ * Inputs are the flat images in memory, outputs are binary edge images (255 on edges).
+ **/
+
+/** settings of the canny stage, the defaults are the values of the script **/
+struct EdgeParams {
+    double canny_low = 25;
+    double canny_high = 50;
+    int len_threshold = 150; /** contour filter, in units of np.size(contour) = 2 x number of points **/
+    /** lidar: mean shift + nl-means with different strength above and below the band split **/
+    double band_split = 0.15;
+    int h_upper = 20;
+    int h_lower = 10;
+    /** omnidirectional camera: gaussian blur **/
+    double sigma = 1;
+};
+
+/** removes short closed loops and tiny fragments, decided independently per contour **/
+std::vector<std::vector<cv::Point>> filterContours(const std::vector<std::vector<cv::Point>> &contours, int len_threshold);
+
+/** edge image of the lidar flat intensity image, the two bands are denoised in parallel **/
+cv::Mat lidarEdgeImage(const cv::Mat &flat_img, const cv::Mat &mask, const EdgeParams &params = EdgeParams());
+
+/** edge image of the omnidirectional camera image **/
+cv::Mat omniEdgeImage(const cv::Mat &flat_img, const cv::Mat &mask, const EdgeParams &params = EdgeParams());
+
+/** logs runtime and pixel agreement of the native and the script edge images **/
+void compareEdgeImages(const cv::Mat &native_edges, const cv::Mat &script_edges, double native_time, double script_time, const char *name);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef EXPOSURE_FUSION_H
+#define EXPOSURE_FUSION_H
+/** basic **/
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+/** opencv **/
+#include <opencv2/opencv.hpp>
+/** headings **/
+#include <define.h>
+
+/**
+ * In-process port of python_scripts/auto_run/exposure_fusion.py:
+ * grab_<t>.bmp exposures -> Debevec response -> Mertens fusion -> partial CLAHE.
+ * The camera response function is computed once per camera serial and kept in memory and on disk.
+ **/
+class ExposureFusion {
+public:
+    /** crf_folder holds crf_<serial>.yml **/
+    explicit ExposureFusion(const std::string &crf_folder);
+
+    /** fused 8-bit BGR image of the exposures in image_folder, empty if an exposure is missing **/
+    cv::Mat fuse(const std::string &image_folder, const std::string &camera_serial);
+
+    /** nominal exposure times of the grab_<t>.bmp files **/
+    const std::vector<float> kExposureTimes = {0.5, 1, 5, 10, 20, 50, 100};
+    const double kClaheWeight = 0.25;
+
+private:
+    std::vector<float> realExposureTimes(const std::string &image_folder);
+    cv::Mat response(const std::string &camera_serial, const std::vector<cv::Mat> &images, const std::vector<float> &times);
+
+    std::string crf_folder_;
+    std::mutex mutex_;
+    std::map<std::string, cv::Mat> responses_;
+};
+
+#endif
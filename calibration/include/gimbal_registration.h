@@ -0,0 +1,93 @@
+#ifndef GIMBAL_REGISTRATION_H
+#define GIMBAL_REGISTRATION_H
+/** basic **/
+#include <vector>
+#include <memory>
+/** pcl **/
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+/** eigen **/
+#include <Eigen/Core>
+/** headings **/
+#include <define.h>
+#include <projective_icp.h>
+
+/**
+ * Joint view registration of all spots constrained to the gimbal kinematics.
+ * A view at the nominal pitch angle v maps into the center view by p -> R(a, v + dv) (p - c) + c, where the pivot c
+ * (nominally {0, 0, -radius}) and the small tilt of the pitch axis a (nominally y) are shared by all views of all spots
+ * and dv is the pitch error of each view. The pivot coordinate along the axis is not observable and stays fixed.
+ * Correspondences come from the projective association of each spot's center view, the parameters are refined by a
+ * few point-to-plane solves per association round.
+ **/
+class GimbalRegistration {
+public:
+    explicit GimbalRegistration(double gimbal_radius);
+
+    /** center view of a spot in its sensor frame, returns the target index **/
+    int addTarget(const CloudI::ConstPtr &target, int rows, int cols);
+    /** view in its sensor frame at the nominal pitch angle (radians), returns the view index **/
+    int addView(int target_idx, const CloudI::ConstPtr &source, double angle);
+
+    void setIterations(int association_rounds, int solver_iterations) {
+        rounds_ = association_rounds;
+        solver_iterations_ = solver_iterations;
+    }
+    void setMaxCorrespondenceDistance(double distance) {
+        max_corr_dist_ = distance;
+    }
+    /** points of a view used in the joint solve **/
+    void setMaxPoints(int max_points) {
+        max_points_ = max_points;
+    }
+
+    void solve();
+
+    Mat4F transform(int view_idx) const;
+    double pitchError(int view_idx) const {
+        return views_[view_idx].pitch_error;
+    }
+    /** rms point-to-plane distance and fraction of associated points after the solve **/
+    double residual(int view_idx) const {
+        return views_[view_idx].rms;
+    }
+    double inlierRatio(int view_idx) const {
+        return views_[view_idx].inlier_ratio;
+    }
+    Eigen::Vector3d pivot() const {
+        return Eigen::Vector3d(pivot_[0], pivot_[1], pivot_[2]);
+    }
+    Eigen::Vector2d tilt() const {
+        return Eigen::Vector2d(tilt_[0], tilt_[1]);
+    }
+
+private:
+    struct View {
+        int target_idx;
+        CloudI::ConstPtr source;
+        std::vector<int> samples;
+        double angle;
+        double pitch_error = 0;
+        double rms = 0;
+        double inlier_ratio = 0;
+    };
+
+    struct Correspondence {
+        Eigen::Vector3d point;
+        Eigen::Vector3d target_point;
+        Eigen::Vector3d normal;
+    };
+
+    void associate(const View &view, std::vector<Correspondence> &correspondences) const;
+
+    std::vector<std::unique_ptr<ProjectiveIcp>> targets_;
+    std::vector<View> views_;
+    double pivot_[3];
+    double tilt_[2] = {0, 0};
+    int rounds_ = 5;
+    int solver_iterations_ = 5;
+    double max_corr_dist_ = 0.2;
+    int max_points_ = 5000;
+};
+
+#endif
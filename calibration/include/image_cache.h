@@ -0,0 +1,66 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+/** basic **/
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <unordered_map>
+/** opencv **/
+#include <opencv2/opencv.hpp>
+
+/**
+ * LRU cache of decoded images keyed by path and modification time, bounded by a memory budget.
+ * Decodes running in the background count against the budget with the file size until they land in the cache.
+ * Images are handed out as shared read-only matrices, clone before drawing on them.
+ * Uncompressed 24-bit BMP files are decoded from a memory mapping, other formats go through cv::imdecode.
+ **/
+class ImageCache {
+public:
+    typedef std::shared_ptr<const cv::Mat> ImagePtr;
+
+    explicit ImageCache(size_t budget_bytes = (size_t(1) << 30));
+    /** waits for the background decodes, they insert into this cache **/
+    ~ImageCache();
+
+    /** decoded image, loaded on a miss or when the file changed since it was cached; empty on failure **/
+    ImagePtr get(const std::string &path, int flags = cv::IMREAD_UNCHANGED);
+
+    /** start decoding in the background, a later get() of the same path waits for it; skipped if the budget is full **/
+    void prefetch(const std::string &path, int flags = cv::IMREAD_UNCHANGED);
+
+    /** cache an image produced in memory under path, e.g. right after writing it to that file **/
+    ImagePtr put(const std::string &path, const cv::Mat &image, int flags = cv::IMREAD_UNCHANGED);
+
+    void setBudget(size_t budget_bytes);
+    void clear();
+    size_t usedBytes();
+
+    /** decode without caching **/
+    static cv::Mat decode(const std::string &path, int flags = cv::IMREAD_UNCHANGED);
+
+private:
+    struct Entry {
+        ImagePtr image;
+        long mtime;
+        size_t bytes;
+        std::list<std::string>::iterator lru_it;
+    };
+
+    static std::string key(const std::string &path, int flags);
+    static long modifiedTime(const std::string &path);
+    void insert(const std::string &key, ImagePtr image, long mtime);
+    void evict();
+    void dropFinished();
+
+    std::mutex mutex_;
+    size_t budget_;
+    size_t used_ = 0;
+    size_t pending_bytes_ = 0; /** reserved by the decodes in flight **/
+    std::list<std::string> lru_; /** most recent first **/
+    std::unordered_map<std::string, Entry> entries_;
+    std::unordered_map<std::string, std::shared_future<ImagePtr>> pending_;
+};
+
+#endif
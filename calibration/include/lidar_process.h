@@ -6,20 +6,23 @@
 #include <thread>
 #include <tuple>
 #include <numeric>
+#include <unordered_map>
 #include "python3.6/Python.h"
-/** ros **/
-#include <ros/ros.h>
+/** ros, the view bags are read by the node build only **/
+#include <calib_log.h>
+#ifndef CALIB_HEADLESS
 #include <ros/package.h>
 #include <rosbag/bag.h>
 #include <rosbag/view.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <sensor_msgs/PointCloud.h>
 #include <sensor_msgs/point_cloud_conversion.h>
+#include <pcl_conversions/pcl_conversions.h>
+#endif
 
 /** pcl **/
 #include <pcl/common/common.h>
 #include <pcl/common/time.h>
-#include <pcl_conversions/pcl_conversions.h>
 
 #include <pcl/point_types.h>
 #include <pcl/filters/filter.h>
@@ -48,6 +51,13 @@
 
 /** headings **/
 #include <define.h>
+#include <edge_extraction.h>
+#include <coverage_monitor.h>
+#include <spherical_normals.h>
+#include <projective_icp.h>
+#include <gimbal_registration.h>
+#include <trace.h>
+#include <param_source.h>
 
 
 /** namespace **/
@@ -71,7 +81,7 @@ class LidarProcess{
 public:
     /** essential params **/
     string topic_name;
-    string kPkgPath = ros::package::getPath("calibration");
+    string kPkgPath;
     string dataset_name;
     string kDatasetPath;
     int spot_idx = 0;
@@ -97,6 +107,10 @@ public:
     // extracted edges in original space
     vector<vector<EdgeCloud>> edge_cloud_vec; /** container of edgeClouds of each pose **/
 
+    /** coarse edge clouds, level l keeps one edge point per 2^l x 2^l block of flat image pixels **/
+    const int kPyramidLevels = 3;
+    vector<vector<vector<EdgeCloud>>> edge_pyramid_vec; /** [spot][view][level - 1] **/
+
     /** rigid transformation generated by ICP at different poses(vertical angle) **/
     vector<vector<Eigen::Matrix4f>> pose_trans_mat_vec;
 
@@ -120,6 +134,7 @@ public:
             this->edge_cloud_path = this->output_folder_path + "/edge_lidar.pcd";
             this->edge_fisheye_projection_path = this->output_folder_path + "/lid_trans.txt";
             this->params_record_path = this->output_folder_path + "/params_record.txt";
+            this->coverage_curve_path = this->output_folder_path + "/coverage_curve.txt";
             
             this->lio_spot_trans_mat_path = this->recon_folder_path + "/lio_spot_trans_mat.txt";
             this->icp_spot_trans_mat_path = this->recon_folder_path + "/icp_spot_trans_mat.txt";
@@ -139,6 +154,7 @@ public:
         string edge_cloud_path;
         string edge_fisheye_projection_path;
         string params_record_path;
+        string coverage_curve_path;
         /** spot **/
         string recon_folder_path;
         string spot_cloud_path;
@@ -153,9 +169,62 @@ public:
     /** Degree Map **/
     std::map<int, int> degree_map;
 
+    /** flat and edge images kept in memory for the native edge stage, valid for the pose they were made of **/
+    cv::Mat flat_img;
+    cv::Mat edge_img;
+    std::pair<int, int> flat_img_pose = {-1, -1};
+    std::pair<int, int> edge_img_pose = {-1, -1};
+    bool kNativeEdge = true; /** false runs python_scripts/image_process/edge_extraction.py **/
+    bool kEdgeCompare = false; /** run both and log timing and agreement **/
+
+    /** view cloud integration stops once the spherical coverage saturates **/
+    bool kAdaptiveIntegration = false;
+    double kTargetCoverage = 0.95; /** covered fraction of the flat image mask **/
+    int kCoverageWindow = 50; /** messages **/
+    double kMinCoverageGain = 0.001; /** over the window **/
+
+    /** normals and gicp covariances from the spherical grid instead of kd-tree searches **/
+    bool kOrganizedNormals = false;
+    /** view stitching by projective association in the target range image instead of gicp **/
+    bool kProjectiveIcp = false;
+    bool kIcpCompare = false; /** run both, timing and difference of the results are appended to log/icp_compare.csv **/
+
+    /** gimbal kinematics of the views, the constrained fit falls back to 6-DoF above these bounds **/
+    const float kGimbalRadius = 0.15f;
+    double kGimbalMaxRms = 0.02; /** meters, point-to-plane **/
+    double kGimbalMinInliers = 0.5; /** fraction of associated points **/
+
+    /** settings of the constructor, filled from the parameter server by paramServerConfig **/
+    struct Config {
+        string pkg_path; /** data is read from pkg_path/data/dataset_name **/
+        string topic_name;
+        string dataset_name;
+        int num_spots = 1;
+        int num_views = 1;
+        int view_angle_init = 0;
+        int view_angle_step = 1;
+        bool native_edge = true;
+        bool edge_compare = false;
+        bool adaptive_integration = false;
+        double target_coverage = 0.95;
+        int coverage_window = 50;
+        double min_coverage_gain = 0.001;
+        bool organized_normals = false;
+        bool projective_icp = false;
+        bool icp_compare = false;
+        double gimbal_max_rms = 0.02;
+        double gimbal_min_inliers = 0.5;
+    };
+
 public:
     /***** LiDAR Class *****/
+    explicit LidarProcess(const Config &config);
+    /** parameters under their parameter server names, from the server or a calibration.yaml **/
+    static Config loadConfig(const ParamSource &params, const string &pkg_path);
+#ifndef CALIB_HEADLESS
     LidarProcess();
+    static Config paramServerConfig();
+#endif
     void setSpot(int spot_idx) {
         this->spot_idx = spot_idx;
     }
@@ -174,13 +243,19 @@ public:
     /***** Edge Process *****/
     void edgeExtraction();
     void ReadEdge();
+    void buildEdgePyramid();
+    EdgeCloud &edgeCloud(int level);
 
     /***** Registration and Mapping *****/
     Mat4F alignCloud(CloudI::Ptr cloud_tgt, CloudI::Ptr cloud_src, Mat4F init_trans_mat, int cloud_type, const bool kIcpViz);
-    void getEdgeDistance(EdgeCloud::Ptr cloud_tgt, EdgeCloud::Ptr cloud_src, float max_range);
+    Mat4F alignProjective(CloudI::Ptr cloud_tgt, CloudI::Ptr cloud_src, Mat4F init_trans_mat);
+    CloudI::Ptr sampleViewCloud(CloudI::Ptr cloud, float uniform_radius, bool range_filter);
+    float getEdgeDistance(EdgeCloud::Ptr cloud_tgt, EdgeCloud::Ptr cloud_src, float max_range);
+    float getEdgeDistance(const cv::Mat &dist_img, EdgeCloud::Ptr cloud_src, float max_range);
 
     void generateViewCloud();
     void stitchViewCloud();
+    void stitchGimbalViews(vector<int> spot_vec);
     void generateSpotCloud();
     void stitchSpotCloud();
     void stitchFineToCoarse();
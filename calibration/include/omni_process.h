@@ -14,10 +14,13 @@
 #include <opencv2/highgui/highgui.hpp>
 /** pcl **/
 #include <pcl/common/common.h>
+#include <pcl/common/time.h>
 #include <Eigen/Core>
 /** ros **/
-#include <ros/ros.h>
+#include <calib_log.h>
+#ifndef CALIB_HEADLESS
 #include <ros/package.h>
+#endif
 /** mlpack **/
 #include <mlpack/core.hpp>
 #include <mlpack/methods/kde/kde.hpp>
@@ -26,6 +29,11 @@
 
 /** headings **/
 #include <define.h>
+#include <image_cache.h>
+#include <edge_extraction.h>
+#include <exposure_fusion.h>
+#include <trace.h>
+#include <param_source.h>
 
 using namespace std;
 
@@ -39,7 +47,7 @@ typedef pcl::PointCloud<pcl::PointXYZ> EdgeCloud;
 class OmniProcess{
 public:
     /** essential params **/
-    string kPkgPath = ros::package::getPath("calibration");
+    string kPkgPath;
     string dataset_name;
     string kDatasetPath;
     int spot_idx = 0;
@@ -54,6 +62,11 @@ public:
     Pair kImageSize = {2048, 2448};
     Pair kEffectiveRadius = {300, 1100};
     int kExcludeRadius = 200;
+    double kDistTruncation = 20; /** distance transform cost saturates beyond this many pixels **/
+
+    /** occlusion test of the colorization **/
+    int kDepthCell = 4; /** pixels per depth buffer cell **/
+    double kDepthTolerance = 0.05; /** relative to the nearest range of the cell, 0 disables **/
 
     /** coordinates of edge pixels in fisheye images **/
     vector<vector<EdgeCloud>> edge_cloud_vec;
@@ -90,13 +103,54 @@ public:
     /** Degree Map **/
     std::map<int, int> degree_map;
 
+    /** decoded images shared by all users of this camera **/
+    std::shared_ptr<ImageCache> image_cache;
+
+    /** edge image kept in memory for the edge cloud, valid for the pose it was made of **/
+    cv::Mat edge_img;
+    std::pair<int, int> edge_img_pose = {-1, -1};
+    bool kNativeEdge = true; /** false runs python_scripts/image_process/edge_extraction.py **/
+    bool kEdgeCompare = false; /** run both and log timing and agreement **/
+
+    /** exposure fusion, the response function is cached per camera serial, per dataset without one **/
+    string kCameraSerial;
+    std::shared_ptr<ExposureFusion> exposure_fusion;
+
+    /** settings of the constructor, filled from the parameter server by paramServerConfig **/
+    struct Config {
+        string pkg_path; /** data is read from pkg_path/data/dataset_name **/
+        string dataset_name;
+        int num_spots = 1;
+        int num_views = 1;
+        int view_angle_init = 0;
+        int view_angle_step = 1;
+        Pair image_size = {2048, 2448};
+        int depth_cell = 4;
+        double depth_tolerance = 0.05;
+        bool native_edge = true;
+        bool edge_compare = false;
+        int image_cache_mb = 1024;
+        string camera_serial; /** empty keys the response function by the dataset **/
+    };
+
 public:
+    explicit OmniProcess(const Config &config);
+    /** parameters under their parameter server names, from the server or a calibration.yaml **/
+    static Config loadConfig(const ParamSource &params, const string &pkg_path);
+#ifndef CALIB_HEADLESS
     OmniProcess();
+    static Config paramServerConfig();
+#endif
     cv::Mat loadImage(bool output=false);
+    ImageCache::ImagePtr getImage();
+    void prefetchImage(int view_idx);
     void ReadEdge();
     void generateEdgeCloud();
     std::vector<double> Kde(double bandwidth, double scale);
+    cv::Mat DistanceImage(double scale);
+    std::vector<double> DistanceMap(double truncation, double scale);
     void edgeExtraction();
+    void fuseExposures();
 
     void setSpot(int spot_idx) {
         this->spot_idx = spot_idx;
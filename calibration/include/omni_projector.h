@@ -0,0 +1,235 @@
+#ifndef OMNI_PROJECTOR_H
+#define OMNI_PROJECTOR_H
+/** basic **/
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+/** openmp **/
+#include <omp.h>
+/** eigen **/
+#include <Eigen/Core>
+
+/** points and pixels in structure-of-arrays layout, one contiguous column per coordinate **/
+typedef Eigen::Matrix<double, Eigen::Dynamic, 3> PointsSoA;
+typedef Eigen::Matrix<double, Eigen::Dynamic, 2> PixelsSoA;
+
+/** copy the xyz fields of a pcl-like cloud into SoA layout **/
+template <typename CloudT>
+inline void toPointsSoA(const CloudT &cloud, PointsSoA &points) {
+    const int n = cloud.points.size();
+    points.resize(n, 3);
+    for (int i = 0; i < n; ++i) {
+        points(i, 0) = cloud.points[i].x;
+        points(i, 1) = cloud.points[i].y;
+        points(i, 2) = cloud.points[i].z;
+    }
+}
+
+/**
+ * Batch version of IntrinsicTransform in common_lib.h, intrinsic = {u0, v0, a0, a1, a2, a3, a4, c, d, e}.
+ * The affine inverse is computed once per intrinsic, the radius polynomial is evaluated with Horner.
+ * Only depends on Eigen, so the MI package shares it.
+ **/
+class OmniProjector {
+public:
+    OmniProjector() = default;
+
+    template <typename Derived>
+    explicit OmniProjector(const Eigen::MatrixBase<Derived> &intrinsic) {
+        setIntrinsic(intrinsic);
+    }
+
+    template <typename Derived>
+    void setIntrinsic(const Eigen::MatrixBase<Derived> &intrinsic) {
+        u0_ = intrinsic(0);
+        v0_ = intrinsic(1);
+        for (int i = 0; i < 5; ++i) {
+            a_[i] = intrinsic(2 + i);
+        }
+        /** inverse of the affine [[c, d], [e, 1]] **/
+        const double c = intrinsic(7), d = intrinsic(8), e = intrinsic(9);
+        const double det = c - d * e;
+        inv_[0] = 1 / det;
+        inv_[1] = -d / det;
+        inv_[2] = -e / det;
+        inv_[3] = c / det;
+    }
+
+    /** points are valid if r_min < |(u, v) - (u0, v0)| < r_max **/
+    void setBounds(double r_min, double r_max) {
+        r_min_sq_ = r_min * r_min;
+        r_max_sq_ = r_max * r_max;
+    }
+
+    double u0() const { return u0_; }
+    double v0() const { return v0_; }
+
+    /** theta -> radius polynomial **/
+    inline double polynomial(double theta) const {
+        return a_[0] + theta * (a_[1] + theta * (a_[2] + theta * (a_[3] + theta * a_[4])));
+    }
+
+    /**
+     * Fixed-intrinsic fast path: table of cos(theta) -> radius with linear interpolation, no acos per point.
+     * The table is refined until the interpolation error at the interval midpoints is below max_error (pixels)
+     * over [-0.99, 0.99]; acos is singular at +-1, so cosines outside the checked range use the exact polynomial.
+     * Returns false if max_size nodes are not enough, the table then covers a narrower range.
+     * Call again after setIntrinsic.
+     **/
+    bool enableLut(double max_error, int max_size = (1 << 20)) {
+        const double kCover = 0.99;
+        bool covered = false;
+        for (int n = 1024; n <= max_size && !covered; n *= 2) {
+            const double step = 2.0 / n;
+            std::vector<double> table(n + 1);
+            for (int i = 0; i <= n; ++i) {
+                table[i] = polynomial(acos(std::min(1.0, -1.0 + i * step)));
+            }
+            auto valid = [&](int i) {
+                double mid = polynomial(acos(-1.0 + (i + 0.5) * step));
+                return fabs(0.5 * (table[i] + table[i + 1]) - mid) <= max_error;
+            };
+            /** contiguous run of accurate intervals, grown outwards from cos(theta) = 0 **/
+            int lo = n / 2, hi = n / 2;
+            while (lo > 0 && valid(lo - 1)) {
+                --lo;
+            }
+            while (hi < n && valid(hi)) {
+                ++hi;
+            }
+            lut_ = std::move(table);
+            lut_step_inv_ = 1 / step;
+            lut_lo_ = -1.0 + lo * step;
+            lut_hi_ = -1.0 + hi * step;
+            covered = (lut_lo_ <= -kCover && lut_hi_ >= kCover);
+        }
+        use_lut_ = true;
+        return covered;
+    }
+
+    void disableLut() {
+        use_lut_ = false;
+    }
+
+    /** fraction of [-1, 1] in cos(theta) served by the table **/
+    double lutCoverage() const {
+        return use_lut_ ? (lut_hi_ - lut_lo_) / 2 : 0;
+    }
+
+    /** cos(theta) -> radius, table lookup inside the table range, exact elsewhere **/
+    inline double radius(double cos_theta) const {
+        if (use_lut_ && cos_theta >= lut_lo_ && cos_theta < lut_hi_) {
+            const double pos = (cos_theta + 1.0) * lut_step_inv_;
+            const int i = int(pos);
+            const double w = pos - i;
+            return lut_[i] + w * (lut_[i + 1] - lut_[i]);
+        }
+        return polynomial(acos(cos_theta));
+    }
+
+    inline bool inBounds(double u, double v) const {
+        const double du = u - u0_;
+        const double dv = v - v0_;
+        const double r_sq = du * du + dv * dv;
+        return r_sq > r_min_sq_ && r_sq < r_max_sq_;
+    }
+
+    /** single point in the camera frame, uv_radius is the radius before the affine correction **/
+    inline void project(double x, double y, double z, double &u, double &v, double &uv_radius) const {
+        const double xy_sq = x * x + y * y;
+        uv_radius = radius(z / sqrt(xy_sq + z * z));
+        const double ratio = uv_radius / sqrt(xy_sq);
+        const double pu = ratio * x + u0_;
+        const double pv = ratio * y + v0_;
+        u = inv_[0] * pu + inv_[1] * pv;
+        v = inv_[2] * pu + inv_[3] * pv;
+    }
+
+    /** d(u, v) / d(x, y, z) of a point in the camera frame, row major 2x3, always the exact polynomial **/
+    inline void jacobian(double x, double y, double z, double *J) const {
+        const double xy_sq = x * x + y * y;
+        const double rho = sqrt(xy_sq);
+        const double norm_sq = xy_sq + z * z;
+        const double theta = atan2(rho, z);
+        const double r = polynomial(theta);
+        const double dr = a_[1] + theta * (2 * a_[2] + theta * (3 * a_[3] + theta * 4 * a_[4]));
+        const double rho_cb = rho * xy_sq;
+        const double dtheta[3] = {z * x / (rho * norm_sq), z * y / (rho * norm_sq), -rho / norm_sq};
+        /** derivatives of the azimuth direction (x, y) / rho **/
+        const double dcx[3] = {y * y / rho_cb, -x * y / rho_cb, 0};
+        const double dcy[3] = {-x * y / rho_cb, x * x / rho_cb, 0};
+        for (int k = 0; k < 3; ++k) {
+            const double dpu = dr * dtheta[k] * x / rho + r * dcx[k];
+            const double dpv = dr * dtheta[k] * y / rho + r * dcy[k];
+            J[k] = inv_[0] * dpu + inv_[1] * dpv;
+            J[3 + k] = inv_[2] * dpu + inv_[3] * dpv;
+        }
+    }
+
+    /**
+     * Fused rigid transform and projection of SoA points, pixels(i) = {u, v}.
+     * mask (1 if inside the bounds) and radius (before the affine correction) are optional, n entries each.
+     * Runs in parallel unless called from inside a parallel region.
+     **/
+    void transformProject(const Eigen::Matrix3d &R,
+                          const Eigen::Vector3d &t,
+                          const PointsSoA &points,
+                          PixelsSoA &pixels,
+                          uint8_t *mask = nullptr,
+                          double *radius = nullptr) const {
+        const int n = points.rows();
+        pixels.resize(n, 2);
+        const double *x = points.col(0).data();
+        const double *y = points.col(1).data();
+        const double *z = points.col(2).data();
+        double *u = pixels.col(0).data();
+        double *v = pixels.col(1).data();
+        const double r00 = R(0, 0), r01 = R(0, 1), r02 = R(0, 2);
+        const double r10 = R(1, 0), r11 = R(1, 1), r12 = R(1, 2);
+        const double r20 = R(2, 0), r21 = R(2, 1), r22 = R(2, 2);
+        const double t0 = t(0), t1 = t(1), t2 = t(2);
+
+        #pragma omp parallel for simd if (n >= kParallelSize && !omp_in_parallel())
+        for (int i = 0; i < n; ++i) {
+            const double px = r00 * x[i] + r01 * y[i] + r02 * z[i] + t0;
+            const double py = r10 * x[i] + r11 * y[i] + r12 * z[i] + t1;
+            const double pz = r20 * x[i] + r21 * y[i] + r22 * z[i] + t2;
+            double uv_radius;
+            project(px, py, pz, u[i], v[i], uv_radius);
+            if (mask != nullptr) {
+                mask[i] = inBounds(u[i], v[i]);
+            }
+            if (radius != nullptr) {
+                radius[i] = uv_radius;
+            }
+        }
+    }
+
+    /** SoA points already in the camera frame **/
+    void project(const PointsSoA &points,
+                 PixelsSoA &pixels,
+                 uint8_t *mask = nullptr,
+                 double *radius = nullptr) const {
+        transformProject(Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero(), points, pixels, mask, radius);
+    }
+
+private:
+    static const int kParallelSize = 4096; /** smaller batches are not worth a thread team **/
+
+    double u0_ = 0;
+    double v0_ = 0;
+    double a_[5] = {0, 0, 0, 0, 0};
+    double inv_[4] = {1, 0, 0, 1};
+    double r_min_sq_ = 0;
+    double r_max_sq_ = std::numeric_limits<double>::max();
+
+    bool use_lut_ = false;
+    std::vector<double> lut_;
+    double lut_step_inv_ = 0;
+    double lut_lo_ = 0;
+    double lut_hi_ = 0;
+};
+
+#endif
@@ -4,12 +4,15 @@
 #include <string>
 #include <vector>
 #include <thread>
+#include <memory>
+#include <future>
+#include <random>
+#include <atomic>
+#include <cstring>
 // eigen
 #include <Eigen/Core>
 // ros
-#include <ros/ros.h>
-#include <std_msgs/Header.h>
-#include <ros/package.h>
+#include <calib_log.h>
 // opencv
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
@@ -31,11 +34,14 @@
 #include <omni_process.h>
 #include <lidar_process.h>
 #include <define.h>
+#include <omni_projector.h>
 
 using namespace std;
 
 #define Q_LIM   (0.15)
 
+typedef MatD(K_INT+(6+1), 1) QParam_D; /** quaternion, translation and intrinsic parameters **/
+
 inline double getDouble(double x) {
     return static_cast<double>(x);
 }
@@ -45,7 +51,123 @@ inline double getDouble(const ceres::Jet<SCALAR, N> &x) {
     return static_cast<double>(x.a);
 }
 
-void project2Image(OmniProcess &fisheye, LidarProcess &lidar, std::vector<double> &params, double bandwidth);
+/** sources of the density map: kernel density estimate, or the truncated distance transform of the fisheye edges **/
+enum MapBackend {
+    KDE_BACKEND = 0,
+    DT_BACKEND = 1
+};
+
+/** density map of the fisheye edges on the (scaled) image grid, shared read-only by the cost terms **/
+struct DensityMap {
+    std::vector<double> values;
+    double ref_val = 0;
+    double scale = KDE_SCALE;
+    int rows = 0;
+    int cols = 0;
+    std::unique_ptr<ceres::Grid2D<double>> grid;
+    std::unique_ptr<ceres::BiCubicInterpolator<ceres::Grid2D<double>>> interpolator;
+
+    void setValues(std::vector<double> &&vals, int map_rows, int map_cols, double map_scale) {
+        values = std::move(vals);
+        scale = map_scale;
+        rows = map_rows;
+        cols = map_cols;
+        ref_val = *std::max_element(values.begin(), values.end());
+        grid.reset(new ceres::Grid2D<double>(values.data(), 0, rows, 0, cols));
+        interpolator.reset(new ceres::BiCubicInterpolator<ceres::Grid2D<double>>(*grid));
+    }
+
+    /** (u, v) in full resolution pixels **/
+    template <typename T>
+    void Evaluate(const T &u, const T &v, T *val) const {
+        interpolator->Evaluate(u * T(scale), v * T(scale), val);
+    }
+};
+
+/** nearest range per cell of a view, written concurrently with an atomic minimum on the float bits **/
+struct DepthBuffer {
+    int rows;
+    int cols;
+    std::unique_ptr<std::atomic<uint32_t>[]> cells;
+
+    DepthBuffer(int buffer_rows, int buffer_cols)
+        : rows(buffer_rows), cols(buffer_cols), cells(new std::atomic<uint32_t>[buffer_rows * buffer_cols]) {
+        const uint32_t far = toBits(std::numeric_limits<float>::max());
+        for (int i = 0; i < rows * cols; ++i) {
+            cells[i].store(far, std::memory_order_relaxed);
+        }
+    }
+
+    /** non-negative floats order like their bit patterns **/
+    static uint32_t toBits(float depth) {
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits;
+    }
+
+    void update(int row, int col, float depth) {
+        if (row < 0 || row >= rows || col < 0 || col >= cols) {
+            return;
+        }
+        std::atomic<uint32_t> &cell = cells[row * cols + col];
+        const uint32_t bits = toBits(depth);
+        uint32_t current = cell.load(std::memory_order_relaxed);
+        while (bits < current && !cell.compare_exchange_weak(current, bits, std::memory_order_relaxed)) {}
+    }
+
+    float at(int row, int col) const {
+        if (row < 0 || row >= rows || col < 0 || col >= cols) {
+            return std::numeric_limits<float>::max();
+        }
+        const uint32_t bits = cells[row * cols + col].load(std::memory_order_relaxed);
+        float depth;
+        memcpy(&depth, &bits, sizeof(depth));
+        return depth;
+    }
+};
+
+/** settings of one bandwidth stage of the continuation solver **/
+struct CalibStage {
+    double bandwidth;
+    int max_iterations;
+    double function_tolerance;
+    double gradient_tolerance;
+    double parameter_tolerance;
+    int plateau_window; /** early exit once the cost drops less than plateau_ratio over this many iterations, 0 disables **/
+    double plateau_ratio;
+    double sample_ratio = 1.0; /** fraction of the edge points used, stratified over the fisheye annulus **/
+    MapBackend backend = KDE_BACKEND; /** the distance transform ignores the bandwidth **/
+    int level = 0; /** pyramid level, density maps and lidar edges at 1/2^level resolution, the final stage runs at 0 **/
+};
+
+struct CalibReport {
+    double total_time = 0;
+    double final_cost = 0;
+    double setup_time = 0; /** density maps of the first stage **/
+    std::vector<double> stage_time; /** solve and density map swap of each stage **/
+    std::vector<int> stage_iterations;
+    std::vector<int> stage_evaluations; /** residual and jacobian evaluations of the solver **/
+    std::vector<double> stage_cost;
+};
+
+/** one axis of a cost landscape, sampled symmetrically around the result value **/
+struct SweepAxis {
+    int param_idx; /** index in {rx, ry, rz, tx, ty, tz, u0, v0, a0, a1, a2, a3, a4, c, d, e} **/
+    int steps;
+    double step_size;
+};
+
+/**
+ * Cost of one lidar edge point (QuaternionFunctor) as the calibrations add it,
+ * parameter blocks {q (x, y, z, w), t, intrinsic}; weight and map are referenced, not copied.
+ **/
+ceres::CostFunction *edgeCostFunction(const Vec3D &lid_point, const double &weight, const DensityMap &kde_map);
+
+void loadDensityMaps(OmniProcess &omnicam, std::vector<int> &spot_vec, double bandwidth, std::vector<DensityMap> &maps,
+                     MapBackend backend = KDE_BACKEND, int level = 0);
+
+void project2Image(OmniProcess &fisheye, LidarProcess &lidar, std::vector<double> &params, double bandwidth,
+                   MapBackend backend = KDE_BACKEND);
 
 void SpotColorization(OmniProcess &fisheye, LidarProcess &lidar, std::vector<double> &params);
 
@@ -56,11 +178,52 @@ std::vector<double> QuaternionCalib(OmniProcess &fisheye,
                                     std::vector<double> init_params_vec,
                                     std::vector<double> lb,
                                     std::vector<double> ub,
-                                    bool lock_intrinsic);
+                                    bool lock_intrinsic,
+                                    MapBackend backend = KDE_BACKEND);
+
+std::vector<double> ContinuationCalib(OmniProcess &omnicam,
+                                      LidarProcess &lidar,
+                                      std::vector<CalibStage> stages,
+                                      std::vector<int> spot_vec,
+                                      std::vector<double> init_params_vec,
+                                      std::vector<double> lb,
+                                      std::vector<double> ub,
+                                      bool lock_intrinsic,
+                                      CalibReport *report = nullptr,
+                                      const std::vector<DensityMap> *first_maps = nullptr, /** maps of stages[0], reused if given **/
+                                      bool visualize = true);
+
+std::vector<double> MultiStartCalib(OmniProcess &omnicam,
+                                    LidarProcess &lidar,
+                                    std::vector<CalibStage> stages,
+                                    std::vector<int> spot_vec,
+                                    std::vector<double> init_params_vec,
+                                    std::vector<double> lb,
+                                    std::vector<double> ub,
+                                    int num_starts,
+                                    int num_promoted);
+
+void projectorBenchmark(OmniProcess &omnicam, LidarProcess &lidar, std::vector<double> params_vec);
+
+void compareCostMaps(OmniProcess &omnicam,
+                     LidarProcess &lidar,
+                     std::vector<int> spot_vec,
+                     std::vector<double> params_vec,
+                     std::vector<double> lb,
+                     std::vector<double> ub,
+                     double bandwidth);
 
 void costAnalysis(OmniProcess &fisheye,
                         LidarProcess &lidar,
                         std::vector<int> spot_vec,
                         std::vector<double> init_params_vec,
                         std::vector<double> result_vec,
-                        double bandwidth);
\ No newline at end of file
+                        double bandwidth);
+
+void costLandscape(OmniProcess &omnicam,
+                   LidarProcess &lidar,
+                   std::vector<int> spot_vec,
+                   std::vector<double> init_params_vec,
+                   std::vector<double> result_vec,
+                   double bandwidth,
+                   std::vector<SweepAxis> axes);
\ No newline at end of file
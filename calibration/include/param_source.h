@@ -0,0 +1,50 @@
+#ifndef PARAM_SOURCE_H
+#define PARAM_SOURCE_H
+/** basic **/
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Read access to the calibration parameters under their parameter server names, e.g. "essential/kNumSpots".
+ * get() leaves the value untouched and returns false when the key is missing, as ros::param::get does,
+ * so the defaults stay in the config structs.
+ **/
+class ParamSource {
+public:
+    virtual ~ParamSource() = default;
+    virtual bool get(const std::string &key, std::string &value) const = 0;
+    virtual bool get(const std::string &key, double &value) const = 0;
+    virtual bool get(const std::string &key, int &value) const = 0;
+    virtual bool get(const std::string &key, bool &value) const = 0;
+    virtual bool get(const std::string &key, std::vector<int> &value) const = 0;
+};
+
+/**
+ * Parameters of a calibration.yaml file without a parameter server: sections of scalar "key: value" entries and
+ * flow sequences of integers, which is the subset of YAML the package uses.
+ **/
+class YamlParams : public ParamSource {
+public:
+    explicit YamlParams(const std::string &path);
+
+    bool good() const {
+        return good_;
+    }
+    /** override or add an entry, e.g. from the command line **/
+    void set(const std::string &key, const std::string &value) {
+        values_[key] = value;
+    }
+
+    bool get(const std::string &key, std::string &value) const override;
+    bool get(const std::string &key, double &value) const override;
+    bool get(const std::string &key, int &value) const override;
+    bool get(const std::string &key, bool &value) const override;
+    bool get(const std::string &key, std::vector<int> &value) const override;
+
+private:
+    std::map<std::string, std::string> values_;
+    bool good_ = false;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+/** basic **/
+#include <string>
+#include <vector>
+/** headings **/
+#include <lidar_process.h>
+#include <omni_process.h>
+#include <param_source.h>
+
+/** stages of a calibration run and the settings of both processes, see config/calibration.yaml **/
+struct PipelineConfig {
+    LidarProcess::Config lidar;
+    OmniProcess::Config omni;
+
+    /** registration, colorization and mapping **/
+    bool generate_view_cloud = false;
+    bool stitch_view_cloud = false;
+    bool gimbal_stitch = false;
+    bool generate_spot_cloud = false;
+    bool spot_colorization = false;
+    bool projector_benchmark = false;
+    bool stitch_spot_cloud = false;
+    bool global_mapping = false;
+    bool global_colored_mapping = false;
+    bool uniform_sampling = false;
+
+    /** data process **/
+    bool exposure_fusion = false;
+    bool generate_lidar_edge = false;
+    bool generate_omni_edge = false;
+
+    /** calibration and cost analysis **/
+    bool ceres_optimization = false;
+    bool multi_spots_optimization = false;
+    bool continuation = false;
+    bool subsampling = false;
+    bool subsampling_compare = false;
+    bool multi_start = false;
+    int num_starts = 64;
+    int num_promoted = 3;
+    bool dt_refinement = false;
+    bool pyramid = false;
+    bool cost_map_compare = false;
+    bool params_analysis = false;
+    std::vector<int> landscape_params; /** parameter indices of an extra 2-D/3-D cost landscape **/
+
+    int one_spot = -1; /** -1 means run all the spots, other means run a specific spot **/
+    bool trace = false;
+    std::string trace_file = "trace.json"; /** in data/<dataset>/log **/
+
+    static PipelineConfig load(const ParamSource &params, const std::string &pkg_path);
+};
+
+/** all enabled stages on one dataset, without ros; returns the exit code of the run **/
+int runPipeline(const PipelineConfig &config);
+
+#endif
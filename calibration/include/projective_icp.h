@@ -0,0 +1,81 @@
+#ifndef PROJECTIVE_ICP_H
+#define PROJECTIVE_ICP_H
+/** basic **/
+#include <vector>
+/** pcl **/
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+/** eigen **/
+#include <Eigen/Core>
+#include <Eigen/Dense>
+/** headings **/
+#include <define.h>
+#include <spherical_normals.h>
+
+/**
+ * Point-to-plane ICP with projective data association for co-centered scans, e.g. the gimbal views of one spot.
+ * The target is rasterized once into a spherical range image (nearest point per cell, the sphereToPlane layout)
+ * with normals from the organized grid. A transformed source point is looked up in its cell and the 3 x 3
+ * neighbourhood, so the association is O(1) per point. The normal equations are accumulated in parallel.
+ **/
+class ProjectiveIcp {
+public:
+    ProjectiveIcp(int rows, int cols);
+
+    void setMaxIterations(int iterations) {
+        max_iterations_ = iterations;
+    }
+    void setMaxCorrespondenceDistance(double distance) {
+        max_corr_dist_ = distance;
+    }
+    /** stops once the update is below epsilon in radians and meters **/
+    void setTransformationEpsilon(double epsilon) {
+        epsilon_ = epsilon;
+    }
+    void setNormalRadius(double radius) {
+        normal_radius_ = radius;
+    }
+
+    /** target in its sensor frame **/
+    void setInputTarget(const CloudI::ConstPtr &target);
+
+    /** source in its sensor frame, init and result map the source into the target frame; false without enough correspondences **/
+    bool align(const CloudI &source, const Mat4F &init_trans_mat, Mat4F &result_trans_mat);
+
+    /** target point and normal associated with a point in the target frame, false if none within the distance **/
+    bool correspondence(const Eigen::Vector3d &point, Eigen::Vector3d &target_point, Eigen::Vector3d &normal) const;
+
+    /** mean squared point-to-point distance of the final correspondences **/
+    double getFitnessScore() const {
+        return fitness_;
+    }
+    int getIterations() const {
+        return iterations_;
+    }
+    int getCorrespondences() const {
+        return correspondences_;
+    }
+
+private:
+    bool cell(const Eigen::Vector3d &point, int &row, int &col) const;
+    int associate(const Eigen::Vector3d &point, double &dist_sq) const;
+
+    const int rows_;
+    const int cols_;
+    const double row_step_;
+    const double col_step_;
+    int max_iterations_ = 50;
+    double max_corr_dist_ = 0.2;
+    double epsilon_ = 1e-6;
+    double normal_radius_ = 0.15;
+
+    CloudI::ConstPtr target_;
+    std::vector<int> range_image_; /** index of the nearest target point per cell, -1 if empty **/
+    pcl::PointCloud<pcl::Normal> normals_;
+
+    double fitness_ = 0;
+    int iterations_ = 0;
+    int correspondences_ = 0;
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef ROS_PARAMS_H
+#define ROS_PARAMS_H
+/** ros **/
+#include <ros/ros.h>
+/** headings **/
+#include <param_source.h>
+
+/** parameters of the ros parameter server, used by the node wrappers only **/
+class RosParams : public ParamSource {
+public:
+    bool get(const std::string &key, std::string &value) const override {
+        return ros::param::get(key, value);
+    }
+    bool get(const std::string &key, double &value) const override {
+        return ros::param::get(key, value);
+    }
+    bool get(const std::string &key, int &value) const override {
+        return ros::param::get(key, value);
+    }
+    bool get(const std::string &key, bool &value) const override {
+        return ros::param::get(key, value);
+    }
+    bool get(const std::string &key, std::vector<int> &value) const override {
+        return ros::param::get(key, value);
+    }
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef SPHERICAL_NORMALS_H
+#define SPHERICAL_NORMALS_H
+/** basic **/
+#include <vector>
+/** pcl **/
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+/** eigen **/
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include <Eigen/Eigenvalues>
+/** headings **/
+#include <define.h>
+
+/**
+ * Normal and covariance estimation on the organized spherical grid of sphereToPlane instead of a kd-tree search.
+ * Every grid cell accumulates the moments {n, x, y, z, xx, xy, xz, yy, yz, zz, r, rr} of its points, integral images
+ * of the moments give the covariance of any window in O(1). The window of a point spans the search radius at its
+ * range, it is halved while the range spread or the surface variation inside it indicates a depth discontinuity.
+ * The grid wraps around in azimuth. Points are expected in the sensor frame.
+ **/
+class SphericalNormalEstimation {
+public:
+    typedef std::vector<Eigen::Matrix3d, Eigen::aligned_allocator<Eigen::Matrix3d>> Covariances;
+
+    SphericalNormalEstimation(int rows, int cols);
+
+    /** metric neighbourhood radius, as setRadiusSearch of pcl::NormalEstimation **/
+    void setRadius(double radius) {
+        radius_ = radius;
+    }
+    /** largest half window in cells **/
+    void setMaxHalfWindow(int half_window) {
+        max_half_window_ = half_window;
+    }
+    /** windows whose range spread exceeds max(tolerance * range, radius) are treated as discontinuous **/
+    void setDepthTolerance(double tolerance) {
+        depth_tolerance_ = tolerance;
+    }
+    /** windows with a larger surface variation lambda_0 / (lambda_0 + lambda_1 + lambda_2) are shrunk **/
+    void setMaxVariation(double variation) {
+        max_variation_ = variation;
+    }
+    /** gicp covariances get the eigenvalues {1, 1, epsilon}, as in pcl::GeneralizedIterativeClosestPoint **/
+    void setGicpEpsilon(double epsilon) {
+        gicp_epsilon_ = epsilon;
+    }
+
+    /** builds the grid and its integral images **/
+    void setInputCloud(const CloudI::ConstPtr &cloud);
+
+    /** normals oriented towards the sensor, NaN where fewer than 3 points are left; covariances are optional **/
+    void compute(pcl::PointCloud<pcl::Normal> &normals, Covariances *covariances = nullptr);
+
+    /** covariances only, for the gicp of clouds without normal fields **/
+    void computeCovariances(Covariances &covariances);
+
+private:
+    static const int kChannels = 12;
+
+    bool cell(const PointI &point, int &row, int &col, double &range) const;
+    void windowSum(int row, int col, int half_window, double *sum) const;
+    void rectSum(int row_0, int row_1, int col_0, int col_1, double *sum) const;
+    bool windowCovariance(int point_idx, Eigen::Matrix3d &covariance, Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> &solver) const;
+
+    const int rows_;
+    const int cols_;
+    const double row_step_;
+    const double col_step_;
+    double radius_ = 0.15;
+    int max_half_window_ = 32;
+    double depth_tolerance_ = 0.03;
+    double max_variation_ = 0.02;
+    double gicp_epsilon_ = 0.001;
+
+    CloudI::ConstPtr cloud_;
+    std::vector<int> point_rows_;
+    std::vector<int> point_cols_;
+    std::vector<double> point_ranges_;
+    std::vector<double> integral_; /** (rows + 1) x (cols + 1) x kChannels **/
+};
+
+#endif
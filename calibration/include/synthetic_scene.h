@@ -0,0 +1,125 @@
+#ifndef SYNTHETIC_SCENE_H
+#define SYNTHETIC_SCENE_H
+/** basic **/
+#include <cmath>
+#include <cstdint>
+#include <vector>
+/** eigen **/
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+/** opencv **/
+#include <opencv2/core/core.hpp>
+/** headings **/
+#include <define.h>
+
+/** procedural texture, modulates the albedo over the two in-plane coordinates of the hit point **/
+enum TextureType {
+    TEXTURE_UNIFORM = 0,
+    TEXTURE_CHECKER = 1,
+    TEXTURE_STRIPES = 2
+};
+
+struct SceneMaterial {
+    double albedo = 0.5;
+    TextureType texture = TEXTURE_UNIFORM;
+    double texture_size = 0.5; /** meters per checker cell or stripe **/
+};
+
+struct SceneHit {
+    double range = 0;
+    Vec3D point;
+    Vec3D normal; /** facing the ray origin **/
+    double albedo = 0; /** after the texture **/
+};
+
+/**
+ * Ray-cast scene of boxes and rectangles for synthetic datasets, the room is a box seen from the inside.
+ * Lidar and camera see the same textured albedo, so edges and reflectivity agree as in the real data.
+ **/
+class SyntheticScene {
+public:
+    void addBox(const Vec3D &lo, const Vec3D &hi, const SceneMaterial &material, bool inside = false);
+    void addRect(const Vec3D &center, const Vec3D &axis_u, const Vec3D &axis_v,
+                 double half_u, double half_v, const SceneMaterial &material);
+
+    /** nearest hit within max_range, dir is normalized **/
+    bool raycast(const Vec3D &origin, const Vec3D &dir, double max_range, SceneHit &hit) const;
+
+    /** hall around the spots with textured walls, seeded boxes and panels kept clear of the spots **/
+    static SyntheticScene hall(const std::vector<Vec3D> &spot_positions, unsigned int seed);
+
+    int size() const {
+        return boxes_.size() + rects_.size();
+    }
+
+private:
+    struct Box {
+        Vec3D lo;
+        Vec3D hi;
+        SceneMaterial material;
+        bool inside;
+    };
+    struct Rect {
+        Vec3D center;
+        Vec3D axis_u;
+        Vec3D axis_v;
+        Vec3D normal;
+        double half_u;
+        double half_v;
+        SceneMaterial material;
+    };
+
+    static double textured(const SceneMaterial &material, double s, double t);
+
+    std::vector<Box> boxes_;
+    std::vector<Rect> rects_;
+};
+
+/**
+ * Non-repetitive scan directions of a Livox Mid-360, 360 deg around z and [-7, 52] deg in elevation.
+ * An R2 low-discrepancy sequence, uniform on the sphere band, stands in for the rosette pattern:
+ * the covered fraction of the field of view keeps growing with the integration time.
+ **/
+class Mid360Pattern {
+public:
+    explicit Mid360Pattern(uint64_t offset = 0) : index_(offset) {}
+
+    Vec3D next() {
+        return direction(index_++);
+    }
+
+    /** direction of the index-th point of the sequence, so frames can be filled in parallel **/
+    static Vec3D direction(uint64_t index) {
+        const double kAlpha1 = 0.7548776662466927; /** 1 / plastic number and its square **/
+        const double kAlpha2 = 0.5698402909980532;
+        const double s = fmod(0.5 + kAlpha1 * index, 1.0);
+        const double t = fmod(0.5 + kAlpha2 * index, 1.0);
+        const double azimuth = 2 * M_PI * s;
+        const double sin_el = sin(kMinElevation) + t * (sin(kMaxElevation) - sin(kMinElevation));
+        const double cos_el = sqrt(1 - sin_el * sin_el);
+        return Vec3D(cos_el * cos(azimuth), cos_el * sin(azimuth), sin_el);
+    }
+
+    static constexpr double kMinElevation = -7.0 * M_PI / 180;
+    static constexpr double kMaxElevation = 52.0 * M_PI / 180;
+    static constexpr int kPointsPerFrame = 20000; /** 200k points/s at 10 Hz **/
+    static constexpr double kMinRange = 0.1;
+    static constexpr double kMaxRange = 40.0;
+
+private:
+    uint64_t index_;
+};
+
+/** deterministic standard normal of a key, independent of the thread that asks for it **/
+double hashNormal(uint64_t key);
+
+/**
+ * Fisheye image of the scene from camera_pose (camera to world), the inverse of IntrinsicTransform:
+ * the affine is undone, then theta is read from a radius -> theta table of the polynomial.
+ * Rays beyond max_theta from the optical axis (-z, where the radius vanishes) are black.
+ * Lambertian shading with one light, gray levels with seeded noise, 3 channels as the grab images.
+ **/
+cv::Mat renderFisheye(const SyntheticScene &scene, const Int_D &intrinsic, const Mat4D &camera_pose,
+                      int rows, int cols, double max_theta, double noise, unsigned int seed);
+
+#endif
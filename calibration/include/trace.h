@@ -0,0 +1,105 @@
+#ifndef TRACE_H
+#define TRACE_H
+/** basic **/
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** one closed span, times in microseconds since the tracer was created **/
+struct TraceEvent {
+    std::string name;
+    int spot = -1;
+    int view = -1;
+    int tid = 0;
+    int depth = 0; /** spans open on the same thread when it started **/
+    double start_us = 0;
+    double dur_us = 0;
+    long points_in = 0;
+    long points_out = 0;
+    long bytes_read = 0;
+    long bytes_written = 0;
+    long rss_kb = 0; /** process memory when the span closed **/
+    long hwm_kb = 0;
+};
+
+/**
+ * Stage level tracing of the pipeline. TraceSpan times its scope on the calling thread together with the spot and view it
+ * works on; points and bytes are counted on the span and the memory high-water mark is sampled when it closes.
+ * While disabled a span costs one atomic load. Once enabled, a Chrome trace-event file (chrome://tracing, Perfetto) is
+ * written and a per-stage summary is printed at exit.
+ **/
+class Tracer {
+public:
+    static Tracer &instance();
+
+    /** start recording, trace_path is written at exit **/
+    void enable(const std::string &trace_path);
+    bool enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    double nowUs() const;
+    void record(TraceEvent &&event);
+
+    void writeTrace(const std::string &path) const;
+    void printSummary() const;
+    /** trace file and summary once, also called at exit **/
+    void finish();
+
+    /** small sequential id of the calling thread **/
+    static int threadId();
+
+private:
+    Tracer();
+
+    std::atomic<bool> enabled_ {false};
+    std::chrono::steady_clock::time_point origin_;
+    double enable_us_ = 0;
+    int enable_tid_ = 0;
+    std::string trace_path_;
+    mutable std::mutex mutex_;
+    std::vector<TraceEvent> events_;
+    bool finished_ = false;
+};
+
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name, int spot = -1, int view = -1);
+    ~TraceSpan();
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    void pointsIn(long num) {
+        event_.points_in += num;
+    }
+    void pointsOut(long num) {
+        event_.points_out += num;
+    }
+    void bytesRead(long bytes) {
+        event_.bytes_read += bytes;
+    }
+    void bytesWritten(long bytes) {
+        event_.bytes_written += bytes;
+    }
+
+    /** innermost open span of the calling thread, nullptr if there is none or tracing is off **/
+    static TraceSpan *current();
+
+private:
+    bool active_;
+    TraceSpan *parent_ = nullptr;
+    TraceEvent event_;
+};
+
+/** size of a file read or written, counted on the innermost open span of the calling thread **/
+void traceFileRead(const std::string &path);
+void traceFileWritten(const std::string &path);
+
+/** file size in bytes, 0 if it does not exist **/
+long fileBytes(const std::string &path);
+
+/** resident set size and its high-water mark in kB, from /proc/self/status **/
+void processMemory(long &rss_kb, long &hwm_kb);
+
+#endif
@@ -0,0 +1,285 @@
+/**
+ * Headless benchmark of the two calibration backends on one dataset spot:
+ * KDE edge alignment (ContinuationCalib) and mutual information (MI/src/Calibration).
+ * Both processes are configured from the command line, no ros master or parameter server is needed.
+ * Per stage wall time, evaluations per second, peak memory and the parameter error against a reference
+ * are appended to <output>.csv and written to <output>.json.
+ *
+ * usage: backend_benchmark <pkg_path> <dataset> <num_spots> <spot> [reference_params] [output]
+ *        reference_params: text file with rx ry rz tx ty tz u0 v0 a0 a1 a2 a3 a4 c d e
+ **/
+/** basic **/
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+/** headings **/
+#include <define.h>
+#include <omni_process.h>
+#include <lidar_process.h>
+#include <optimization.h>
+#include <common_lib.h>
+/** mutual information backend **/
+#include "Calibration.h"
+
+using namespace std;
+
+struct BenchRecord {
+    string backend;
+    string stage;
+    double time = 0;
+    long evaluations = 0;
+    double peak_mb = 0;
+    double cost = std::numeric_limits<double>::quiet_NaN();
+    double rot_err = std::numeric_limits<double>::quiet_NaN(); /** degrees **/
+    double trans_err = std::numeric_limits<double>::quiet_NaN(); /** meters **/
+    double center_err = std::numeric_limits<double>::quiet_NaN(); /** pixels, u0 v0 **/
+};
+
+/** peak resident set of the process since the last reset, in MB **/
+double peakMemory() {
+    std::ifstream status("/proc/self/status");
+    string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stod(line.substr(6)) / 1024;
+        }
+    }
+    return 0;
+}
+
+/** writing 5 to clear_refs resets the peak resident set (linux >= 4.0), so each backend reports its own peak **/
+void resetPeakMemory() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+bool loadReference(const string &path, std::vector<double> &ref) {
+    std::ifstream file(path);
+    ref.clear();
+    double val;
+    while (file >> val) {
+        ref.push_back(val);
+    }
+    return ref.size() == 6 + K_INT;
+}
+
+void paramsError(const std::vector<double> &est, const std::vector<double> &ref, BenchRecord &record) {
+    if (ref.size() != 6 + K_INT) {
+        return;
+    }
+    Ext_D est_ext = Eigen::Map<const Param_D>(est.data()).head(6);
+    Ext_D ref_ext = Eigen::Map<const Param_D>(ref.data()).head(6);
+    Mat4D est_mat = transformMat(est_ext);
+    Mat4D ref_mat = transformMat(ref_ext);
+    Mat3D rot_diff = est_mat.topLeftCorner(3, 3).transpose() * ref_mat.topLeftCorner(3, 3);
+    record.rot_err = Eigen::AngleAxisd(rot_diff).angle() * 180 / M_PI;
+    record.trans_err = (est_mat.topRightCorner(3, 1) - ref_mat.topRightCorner(3, 1)).norm();
+    record.center_err = Vec2D(est[6] - ref[6], est[7] - ref[7]).norm();
+}
+
+/** json has no nan, missing values are written as null **/
+string jsonNumber(double val) {
+    return std::isfinite(val) ? to_string(val) : "null";
+}
+
+void writeResults(const string &output, const string &dataset, int spot, const std::vector<BenchRecord> &records) {
+    char stamp[32];
+    time_t now = time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    const int threads = omp_get_max_threads();
+
+    /** csv accumulates the runs, the header is written once **/
+    const string csv_path = output + ".csv";
+    const bool new_file = !std::ifstream(csv_path).good();
+    std::ofstream csv(csv_path, ios::app);
+    if (new_file) {
+        csv << "timestamp,dataset,spot,threads,backend,stage,time_s,evaluations,evals_per_s,peak_mb,cost,"
+               "rot_err_deg,trans_err_m,center_err_px\n";
+    }
+    for (auto &r : records) {
+        csv << stamp << "," << dataset << "," << spot << "," << threads << "," << r.backend << "," << r.stage << ","
+            << r.time << "," << r.evaluations << "," << (r.time > 0 ? r.evaluations / r.time : 0) << ","
+            << r.peak_mb << "," << r.cost << "," << r.rot_err << "," << r.trans_err << "," << r.center_err << "\n";
+    }
+
+    std::ofstream json(output + ".json");
+    json << "{\n  \"timestamp\": \"" << stamp << "\",\n  \"dataset\": \"" << dataset << "\",\n"
+         << "  \"spot\": " << spot << ",\n  \"threads\": " << threads << ",\n  \"records\": [\n";
+    for (int i = 0; i < records.size(); ++i) {
+        const BenchRecord &r = records[i];
+        json << "    {\"backend\": \"" << r.backend << "\", \"stage\": \"" << r.stage << "\""
+             << ", \"time_s\": " << r.time
+             << ", \"evaluations\": " << r.evaluations
+             << ", \"evals_per_s\": " << (r.time > 0 ? r.evaluations / r.time : 0)
+             << ", \"peak_mb\": " << r.peak_mb
+             << ", \"cost\": " << jsonNumber(r.cost)
+             << ", \"rot_err_deg\": " << jsonNumber(r.rot_err)
+             << ", \"trans_err_m\": " << jsonNumber(r.trans_err)
+             << ", \"center_err_px\": " << jsonNumber(r.center_err) << "}"
+             << (i + 1 < records.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
+    cout << "Benchmark results written to " << output << ".csv/.json" << endl;
+}
+
+/** KDE edge alignment through the continuation stages of main **/
+void benchKde(OmniProcess &omnicam, LidarProcess &lidar, int spot,
+              const std::vector<double> &params_init, const std::vector<double> &dev,
+              const std::vector<double> &ref, std::vector<BenchRecord> &records) {
+    resetPeakMemory();
+    pcl::StopWatch timer;
+    omnicam.setSpot(spot);
+    lidar.setSpot(spot);
+    omnicam.setView(omnicam.fullview_idx);
+    lidar.setView(lidar.center_view_idx);
+    omnicam.ReadEdge();
+    lidar.ReadEdge();
+    BenchRecord load{"kde", "load_edges", timer.getTimeSeconds()};
+    load.peak_mb = peakMemory();
+    records.push_back(load);
+
+    std::vector<CalibStage> stages = {
+        {32, 50, 1e-6, 1e-4, 1e-6, 5, 1e-3},
+        {16, 50, 1e-6, 1e-4, 1e-6, 5, 1e-3},
+        {4, 100, 1e-8, 1e-5, 1e-8, 5, 1e-4},
+        {1, 200, 1e-12, 1e-6, 1e-8, 0, 0}
+    };
+    std::vector<int> levels = {2, 1, 0, 0};
+    for (int i = 0; i < stages.size(); ++i) {
+        stages[i].level = levels[i];
+    }
+    std::vector<double> lb(dev.size()), ub(dev.size());
+    for (int i = 0; i < dev.size(); ++i) {
+        ub[i] = params_init[i] + dev[i];
+        lb[i] = params_init[i] - dev[i];
+    }
+
+    CalibReport report;
+    timer.reset();
+    std::vector<double> result = ContinuationCalib(omnicam, lidar, stages, {spot}, params_init, lb, ub, false, &report);
+    const double total_time = timer.getTimeSeconds();
+
+    records.push_back({"kde", "density_maps", report.setup_time});
+    for (int i = 0; i < report.stage_time.size(); ++i) {
+        BenchRecord stage{"kde", "stage" + to_string(i) + "_bw" + to_string(int(stages[i].bandwidth)),
+                          report.stage_time[i], report.stage_evaluations[i]};
+        stage.cost = report.stage_cost[i];
+        records.push_back(stage);
+    }
+    BenchRecord total{"kde", "total", total_time};
+    for (int evals : report.stage_evaluations) {
+        total.evaluations += evals;
+    }
+    total.peak_mb = peakMemory();
+    total.cost = report.final_cost;
+    paramsError(result, ref, total);
+    records.push_back(total);
+}
+
+/** mutual information, hierarchical grid search refined by gradient descent **/
+void benchMi(OmniProcess &omnicam, LidarProcess &lidar, int spot,
+             const std::vector<double> &params_init, const std::vector<double> &ref,
+             std::vector<BenchRecord> &records) {
+    resetPeakMemory();
+    pcl::StopWatch timer, total_timer;
+    const string img_path = omnicam.file_path_vec[spot][omnicam.fullview_idx].hdr_img_path;
+    const string cloud_path = lidar.file_path_vec[spot][lidar.center_view_idx].view_cloud_path;
+    /** the intrinsics of the kde backend, so both backends project with the same camera model **/
+    const Eigen::VectorXd intrinsic = Eigen::Map<const Eigen::VectorXd>(params_init.data() + 6, K_INT);
+    perls::Calibration calib(img_path, cloud_path, intrinsic);
+    BenchRecord load{"mi", "load_evaluator", timer.getTimeSeconds()};
+    load.peak_mb = peakMemory();
+    records.push_back(load);
+
+    Eigen::Vector3d translation(params_init[3], params_init[4], params_init[5]);
+    Eigen::Vector3d euler(params_init[2], params_init[1], params_init[0]); /** zyx **/
+
+    timer.reset();
+    long evals = calib.num_evaluations();
+    BenchRecord grid{"mi", "grid_search"};
+    grid.cost = calib.hierarchical_grid_search(translation, euler);
+    grid.time = timer.getTimeSeconds();
+    grid.evaluations = calib.num_evaluations() - evals;
+    records.push_back(grid);
+
+    timer.reset();
+    evals = calib.num_evaluations();
+    calib.translation = translation;
+    calib.euler_angle = euler;
+    BenchRecord descent{"mi", "gradient_descent"};
+    calib.gradient_descent_search(translation, euler);
+    descent.time = timer.getTimeSeconds();
+    descent.evaluations = calib.num_evaluations() - evals;
+    descent.cost = calib.mi_cost(calib.translation, calib.euler_angle);
+    records.push_back(descent);
+
+    BenchRecord total{"mi", "total", total_timer.getTimeSeconds(), calib.num_evaluations()};
+    total.peak_mb = peakMemory();
+    total.cost = descent.cost;
+    std::vector<double> result = {calib.euler_angle[2], calib.euler_angle[1], calib.euler_angle[0],
+                                  calib.translation[0], calib.translation[1], calib.translation[2]};
+    result.insert(result.end(), calib.intrinsic_vec.data(), calib.intrinsic_vec.data() + K_INT);
+    paramsError(result, ref, total);
+    records.push_back(total);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 5) {
+        cout << "usage: " << argv[0] << " <pkg_path> <dataset> <num_spots> <spot> [reference_params] [output]" << endl;
+        return 1;
+    }
+    google::InitGoogleLogging(argv[0]);
+
+    LidarProcess::Config lidar_config;
+    lidar_config.pkg_path = argv[1];
+    lidar_config.dataset_name = argv[2];
+    lidar_config.num_spots = std::stoi(argv[3]);
+    lidar_config.num_views = 5; /** gimbal views of calibration.yaml **/
+    lidar_config.view_angle_init = -50;
+    lidar_config.view_angle_step = 25;
+    OmniProcess::Config omni_config;
+    omni_config.pkg_path = lidar_config.pkg_path;
+    omni_config.dataset_name = lidar_config.dataset_name;
+    omni_config.num_spots = lidar_config.num_spots;
+    omni_config.num_views = lidar_config.num_views;
+    omni_config.view_angle_init = lidar_config.view_angle_init;
+    omni_config.view_angle_step = lidar_config.view_angle_step;
+    const int spot = std::stoi(argv[4]);
+    const string output = (argc > 6) ? argv[6] : "benchmark";
+
+    std::vector<double> ref;
+    if (argc > 5 && !loadReference(argv[5], ref)) {
+        cout << "Reference " << argv[5] << " needs " << 6 + K_INT << " parameters, errors are not reported." << endl;
+    }
+
+    /** same initial values and bounds as main **/
+    std::vector<double> params_init = {
+        M_PI + 0.02, 0.02, -M_PI/2, /** Rx Ry Rz **/
+        0.27, 0.00, 0.03, /** tx ty tz **/
+        1023.0, 1201.0, /** u0 v0 **/
+        616.7214056132 * M_PI, -616.7214056132, 0.0, 0.0, 0.0,
+        1, 0, 0 /** c, d, e **/
+    };
+    std::vector<double> dev = {
+        1e-1, 1e-1, 1e-1,
+        5e-2, 5e-2, 5e-2,
+        5e+0, 5e+0,
+        160e+0, 80e+0, 40e+0, 20+0, 10e+0,
+        1e-2, 1e-2, 1e-2
+    };
+
+    OmniProcess omnicam(omni_config);
+    LidarProcess lidar(lidar_config);
+    lidar.ext_ = Eigen::Map<Param_D>(params_init.data()).head(6);
+    omnicam.int_ = Eigen::Map<Param_D>(params_init.data()).tail(K_INT);
+
+    std::vector<BenchRecord> records;
+    benchKde(omnicam, lidar, spot, params_init, dev, ref, records);
+    benchMi(omnicam, lidar, spot, params_init, ref, records);
+    writeResults(output, lidar_config.dataset_name, spot, records);
+    return 0;
+}
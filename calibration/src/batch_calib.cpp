@@ -0,0 +1,220 @@
+/**
+ * Headless batch run of the pipeline over several datasets, no ros master or catkin environment is needed.
+ * Every dataset runs in a child process configured from the yaml file, so a failing dataset does not stop the others.
+ * The thread budget is split evenly over the concurrent jobs; a job is started only while the resident memory of the
+ * running ones leaves a fair share (memory / jobs) of the memory budget, which also bounds the image cache of each job.
+ * The output of a job goes to data/<dataset>/log/batch.log.
+ *
+ * usage: batch_calib <calibration.yaml> <pkg_path> [--threads N] [--memory-mb M] [--jobs J]
+ *                    [--set section/key=value]... <dataset>[:num_spots]...
+ **/
+/** basic **/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+/** posix **/
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+/** openmp **/
+#include <omp.h>
+
+#include "glog/logging.h"
+/** headings **/
+#include <define.h>
+#include <pipeline.h>
+#include <common_lib.h>
+
+using namespace std;
+
+struct BatchJob {
+    string dataset;
+    int num_spots = 0; /** 0 keeps the value of the yaml file **/
+    PipelineConfig config;
+    pid_t pid = -1;
+    int status = 0;
+    double start_time = 0;
+    double time = 0;
+    long peak_kb = 0;
+};
+
+static long residentKb(pid_t pid) {
+    std::ifstream status("/proc/" + to_string(pid) + "/status");
+    string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+    return 0;
+}
+
+static string exitStatus(int status) {
+    if (WIFEXITED(status)) {
+        return "exit " + to_string(WEXITSTATUS(status));
+    }
+    if (WIFSIGNALED(status)) {
+        return string("signal ") + strsignal(WTERMSIG(status));
+    }
+    return "unknown";
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        cout << "usage: batch_calib <calibration.yaml> <pkg_path> [--threads N] [--memory-mb M] [--jobs J] "
+                "[--set section/key=value]... <dataset>[:num_spots]..." << endl;
+        return 1;
+    }
+    const string yaml_path = argv[1];
+    const string pkg_path = argv[2];
+    int num_threads = omp_get_num_procs();
+    long memory_mb = sysconf(_SC_PHYS_PAGES) / 1024 * sysconf(_SC_PAGE_SIZE) / 1024 * 8 / 10;
+    int num_jobs = 0;
+    std::vector<std::pair<string, string>> overrides;
+    std::vector<BatchJob> jobs;
+    for (int i = 3; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg.compare(0, 2, "--") == 0 && i + 1 < argc) {
+            const string value = argv[++i];
+            if (arg == "--threads") { num_threads = std::max(1, std::stoi(value)); }
+            else if (arg == "--memory-mb") { memory_mb = std::stol(value); }
+            else if (arg == "--jobs") { num_jobs = std::stoi(value); }
+            else if (arg == "--set" && value.find('=') != string::npos) {
+                overrides.push_back({value.substr(0, value.find('=')), value.substr(value.find('=') + 1)});
+            }
+            else {
+                cout << "unknown option " << arg << " " << value << endl;
+                return 1;
+            }
+            continue;
+        }
+        BatchJob job;
+        const size_t colon = arg.find(':');
+        job.dataset = arg.substr(0, colon);
+        job.num_spots = (colon == string::npos) ? 0 : std::stoi(arg.substr(colon + 1));
+        jobs.push_back(job);
+    }
+    if (jobs.empty()) {
+        cout << "no dataset given" << endl;
+        return 1;
+    }
+
+    /** about 4 threads per job unless set, every job gets an even share of the budgets **/
+    if (num_jobs <= 0) {
+        num_jobs = std::max(1, num_threads / 4);
+    }
+    num_jobs = std::min<int>(num_jobs, jobs.size());
+    const int job_threads = std::max(1, num_threads / num_jobs);
+    const long share_mb = memory_mb / num_jobs;
+
+    YamlParams params(yaml_path);
+    if (!params.good()) {
+        cout << "can not read " << yaml_path << endl;
+        return 1;
+    }
+    for (auto &entry : overrides) {
+        params.set(entry.first, entry.second);
+    }
+    for (BatchJob &job : jobs) {
+        params.set("essential/kDatasetName", job.dataset);
+        if (job.num_spots > 0) {
+            params.set("essential/kNumSpots", to_string(job.num_spots));
+        }
+        job.config = PipelineConfig::load(params, pkg_path);
+        job.num_spots = job.config.lidar.num_spots;
+        /** the decoded images are the largest cache of a job, a quarter of its share at most **/
+        job.config.omni.image_cache_mb = std::max<long>(64, std::min<long>(job.config.omni.image_cache_mb, share_mb / 4));
+    }
+    cout << jobs.size() << " datasets, " << num_jobs << " concurrent jobs of " << job_threads << " threads, memory budget "
+         << memory_mb << " MB" << endl;
+
+    /********* Scheduling, the parent only forks and watches, it never starts an openmp team itself *********/
+    const auto origin = std::chrono::steady_clock::now();
+    auto now = [&origin]() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+    };
+    std::deque<int> queue;
+    for (int i = 0; i < jobs.size(); ++i) {
+        queue.push_back(i);
+    }
+    std::map<pid_t, int> running;
+    bool over_budget = false;
+
+    while (!queue.empty() || !running.empty()) {
+        int status = 0;
+        pid_t pid;
+        while (!running.empty() && (pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            BatchJob &job = jobs[running[pid]];
+            job.status = status;
+            job.time = now() - job.start_time;
+            running.erase(pid);
+            cout << "[" << job.dataset << "] " << exitStatus(status) << " after " << job.time << " s" << endl;
+        }
+
+        long used_kb = 0;
+        for (auto &entry : running) {
+            BatchJob &job = jobs[entry.second];
+            const long rss_kb = residentKb(entry.first);
+            job.peak_kb = std::max(job.peak_kb, rss_kb);
+            used_kb += rss_kb;
+        }
+        if (used_kb / 1024 > memory_mb && !over_budget) {
+            cout << "resident memory of the running jobs " << used_kb / 1024 << " MB exceeds the budget" << endl;
+        }
+        over_budget = used_kb / 1024 > memory_mb;
+
+        if (!queue.empty() && running.size() < num_jobs && (running.empty() || used_kb / 1024 + share_mb <= memory_mb)) {
+            BatchJob &job = jobs[queue.front()];
+            const string dataset_path = pkg_path + "/data/" + job.dataset;
+            CheckFolder(pkg_path + "/data");
+            CheckFolder(dataset_path);
+            CheckFolder(dataset_path + "/log");
+            fflush(stdout);
+            job.start_time = now();
+            job.pid = fork();
+            if (job.pid == 0) {
+                const string log_path = dataset_path + "/log/batch.log";
+                if (freopen(log_path.c_str(), "w", stdout) != nullptr) {
+                    dup2(fileno(stdout), STDERR_FILENO);
+                }
+                threadCount() = job_threads;
+                omp_set_num_threads(job_threads);
+                google::InitGoogleLogging("batch_calib");
+                /** exit, not _exit, so the trace of the job is written **/
+                exit(runPipeline(job.config));
+            }
+            if (job.pid < 0) {
+                cout << "[" << job.dataset << "] fork failed" << endl;
+                job.status = -1;
+            }
+            else {
+                running[job.pid] = queue.front();
+                cout << "[" << job.dataset << "] started, " << job.num_spots << " spots, log in "
+                     << dataset_path << "/log/batch.log" << endl;
+            }
+            queue.pop_front();
+            continue;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    /********* Summary *********/
+    int num_failed = 0;
+    printf("%-24s %6s %-20s %12s %14s\n", "dataset", "spots", "status", "time [s]", "peak rss [MB]");
+    for (BatchJob &job : jobs) {
+        const bool ok = job.pid > 0 && WIFEXITED(job.status) && WEXITSTATUS(job.status) == 0;
+        num_failed += !ok;
+        printf("%-24s %6d %-20s %12.1f %14.1f\n", job.dataset.c_str(), job.num_spots,
+               (job.pid > 0) ? exitStatus(job.status).c_str() : "not started", job.time, job.peak_kb / 1024.0);
+    }
+    printf("%d of %ld datasets failed, total %.1f s\n", num_failed, jobs.size(), now());
+    return (num_failed > 0) ? 1 : 0;
+}
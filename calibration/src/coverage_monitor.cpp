@@ -0,0 +1,77 @@
+/** headings **/
+#include <coverage_monitor.h>
+/** basic **/
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+using namespace std;
+
+CoverageMonitor::CoverageMonitor(int rows, int cols, const Eigen::Matrix3f &rotation, const cv::Mat &mask)
+    : rows_(rows), cols_(cols), rad_per_pix_((M_PI * 2) / cols), rotation_(rotation),
+      region_(rows * cols, 1), occupied_(rows * cols, 0) {
+    const bool kMasked = (mask.rows == rows && mask.cols == cols && mask.type() == CV_8UC1);
+    for (int u = 0; u < rows; ++u) {
+        for (int v = 0; v < cols; ++v) {
+            region_[u * cols + v] = kMasked ? (mask.at<uchar>(u, v) > 0) : 1;
+        }
+    }
+    region_size_ = std::count(region_.begin(), region_.end(), 1);
+}
+
+int CoverageMonitor::addCloud(const pcl::PointCloud<pcl::PointXYZI> &cloud) {
+    int new_pixels = 0;
+    for (const auto &point : cloud.points) {
+        Eigen::Vector3f p = rotation_ * point.getVector3fMap();
+        float radius = p.norm();
+        if (!std::isfinite(radius) || radius == 0) {
+            continue;
+        }
+        /** same pixel centers as sphereToPlane: theta from pi downwards, phi from -pi upwards **/
+        float theta = acos(p.z() / radius);
+        float phi = atan2(p.y(), p.x());
+        int u = std::min(rows_ - 1, int((M_PI - theta) / rad_per_pix_));
+        int v = std::min(cols_ - 1, int((phi + M_PI) / rad_per_pix_));
+        if (u < 0 || v < 0) {
+            continue;
+        }
+        const int idx = u * cols_ + v;
+        if (!occupied_[idx]) {
+            occupied_[idx] = 1;
+            if (region_[idx]) {
+                ++new_pixels;
+            }
+        }
+    }
+    covered_ += new_pixels;
+    curve_.push_back(coverage());
+    return new_pixels;
+}
+
+double CoverageMonitor::coverage() const {
+    return region_size_ > 0 ? double(covered_) / region_size_ : 0;
+}
+
+double CoverageMonitor::recentGain(int window) const {
+    if (curve_.empty()) {
+        return 0;
+    }
+    if (window >= curve_.size()) {
+        return curve_.back();
+    }
+    return curve_.back() - curve_[curve_.size() - 1 - window];
+}
+
+bool CoverageMonitor::saturated(double target, int window, double min_gain) const {
+    if (coverage() >= target) {
+        return true;
+    }
+    return window > 0 && curve_.size() > window && recentGain(window) < min_gain;
+}
+
+void CoverageMonitor::saveCurve(const string &path) const {
+    ofstream outfile(path, ios::out);
+    for (int i = 0; i < curve_.size(); ++i) {
+        outfile << i << "\t" << curve_[i] << endl;
+    }
+}
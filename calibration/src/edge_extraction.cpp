@@ -0,0 +1,108 @@
+/** headings **/
+#include <edge_extraction.h>
+/** ros **/
+#include <calib_log.h>
+
+using namespace std;
+
+vector<vector<cv::Point>> filterContours(const vector<vector<cv::Point>> &contours, int len_threshold) {
+    vector<uint8_t> keep(contours.size(), 0);
+
+    #pragma omp parallel for num_threads(THREADS) schedule(dynamic, 64)
+    for (int i = 0; i < contours.size(); ++i) {
+        const vector<cv::Point> &contour = contours[i];
+        const int dist = 2 * contour.size();
+        const cv::Point ends = contour.front() - contour.back();
+        const int end_dist = abs(ends.x) + abs(ends.y);
+        const bool closed_short = (dist < len_threshold) && (8 * end_dist < dist);
+        const bool tiny = dist < len_threshold / 8.0;
+        keep[i] = !(closed_short || tiny);
+    }
+
+    vector<vector<cv::Point>> filtered;
+    for (int i = 0; i < contours.size(); ++i) {
+        if (keep[i]) {
+            filtered.push_back(contours[i]);
+        }
+    }
+    return filtered;
+}
+
+/** canny within the mask, then contour filter and redraw **/
+static cv::Mat cannyContours(const cv::Mat &filtered, const cv::Mat &mask, const EdgeParams &params) {
+    cv::Mat edges;
+    cv::Canny(filtered, edges, params.canny_low, params.canny_high);
+    if (!mask.empty()) {
+        cv::bitwise_and(edges, mask, edges);
+    }
+
+    vector<vector<cv::Point>> contours;
+    cv::findContours(edges, contours, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+    contours = filterContours(contours, params.len_threshold);
+
+    cv::Mat edge_img = cv::Mat::zeros(edges.size(), CV_8UC1);
+    cv::drawContours(edge_img, contours, -1, cv::Scalar(255), 1);
+    return edge_img;
+}
+
+static cv::Mat toGray(const cv::Mat &img) {
+    cv::Mat gray;
+    if (img.channels() == 3) {
+        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        gray = img;
+    }
+    return gray;
+}
+
+cv::Mat lidarEdgeImage(const cv::Mat &flat_img, const cv::Mat &mask, const EdgeParams &params) {
+    cv::Mat color;
+    if (flat_img.channels() == 1) {
+        cv::cvtColor(flat_img, color, cv::COLOR_GRAY2BGR);
+    }
+    else {
+        color = flat_img;
+    }
+
+    /** upper and lower bands are filtered independently, then stacked again **/
+    const int split = int(params.band_split * color.rows);
+    const cv::Range bands[2] = {cv::Range(0, split), cv::Range(split, color.rows)};
+    const int h_vals[2] = {params.h_upper, params.h_lower};
+    cv::Mat band_imgs[2];
+
+    #pragma omp parallel for num_threads(2)
+    for (int i = 0; i < 2; ++i) {
+        cv::Mat shifted, gray;
+        cv::pyrMeanShiftFiltering(color.rowRange(bands[i]), shifted, h_vals[i], 2 * h_vals[i]);
+        cv::cvtColor(shifted, gray, cv::COLOR_BGR2GRAY);
+        /** the script uses the lower band strength for both bands **/
+        cv::fastNlMeansDenoising(gray, band_imgs[i], params.h_lower, 7, 21);
+    }
+
+    cv::Mat filtered;
+    cv::vconcat(band_imgs[0], band_imgs[1], filtered);
+    return cannyContours(filtered, mask, params);
+}
+
+cv::Mat omniEdgeImage(const cv::Mat &flat_img, const cv::Mat &mask, const EdgeParams &params) {
+    cv::Mat filtered;
+    cv::GaussianBlur(toGray(flat_img), filtered, cv::Size(5, 5), params.sigma, params.sigma);
+    return cannyContours(filtered, mask, params);
+}
+
+void compareEdgeImages(const cv::Mat &native_edges, const cv::Mat &script_edges, double native_time, double script_time, const char *name) {
+    if (script_edges.empty() || script_edges.size() != native_edges.size()) {
+        ROS_WARN("%s edges: no comparable script output.", name);
+        return;
+    }
+    cv::Mat native_mask = native_edges > 127;
+    cv::Mat script_mask = toGray(script_edges) > 127;
+    cv::Mat both, either;
+    cv::bitwise_and(native_mask, script_mask, both);
+    cv::bitwise_or(native_mask, script_mask, either);
+    const int num_either = cv::countNonZero(either);
+    ROS_INFO("%s edges: native %f s (%d px), script %f s (%d px), IoU %f.",
+             name, native_time, cv::countNonZero(native_mask), script_time, cv::countNonZero(script_mask),
+             num_either > 0 ? double(cv::countNonZero(both)) / num_either : 1.0);
+}
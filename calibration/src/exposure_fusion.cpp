@@ -0,0 +1,117 @@
+/** headings **/
+#include <exposure_fusion.h>
+#include <image_cache.h>
+/** basic **/
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+/** ros **/
+#include <calib_log.h>
+
+using namespace std;
+
+ExposureFusion::ExposureFusion(const string &crf_folder) : crf_folder_(crf_folder) {}
+
+/** file name of an exposure, integral times are written without decimals like the script does **/
+static string exposureName(float exp_time) {
+    ostringstream name;
+    name << "grab_";
+    if (exp_time == int(exp_time)) {
+        name << int(exp_time);
+    }
+    else {
+        name << exp_time;
+    }
+    name << ".bmp";
+    return name.str();
+}
+
+/** exposure.txt maps nominal to measured times (tab separated), nominal times are used without it **/
+vector<float> ExposureFusion::realExposureTimes(const string &image_folder) {
+    vector<pair<float, float>> records;
+    ifstream record_file(image_folder + "/exposure.txt");
+    float nominal, real;
+    while (record_file >> nominal >> real) {
+        records.push_back({nominal, real});
+    }
+    if (records.empty()) {
+        ROS_INFO("Exposure time record file not found, set to default values.");
+        return kExposureTimes;
+    }
+
+    vector<float> times;
+    for (float exp_time : kExposureTimes) {
+        auto nearest = min_element(records.begin(), records.end(), [exp_time](const pair<float, float> &a, const pair<float, float> &b) {
+            return fabs(a.first - exp_time) < fabs(b.first - exp_time);
+        });
+        times.push_back(nearest->second);
+    }
+    return times;
+}
+
+cv::Mat ExposureFusion::response(const string &camera_serial, const vector<cv::Mat> &images, const vector<float> &times) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = responses_.find(camera_serial);
+    if (it != responses_.end()) {
+        return it->second;
+    }
+
+    cv::Mat crf;
+    string crf_path = crf_folder_ + "/crf_" + camera_serial + ".yml";
+    cv::FileStorage crf_file(crf_path, cv::FileStorage::READ);
+    if (crf_file.isOpened()) {
+        crf_file["response"] >> crf;
+        crf_file.release();
+    }
+    if (crf.empty()) {
+        ROS_INFO("Calculating Camera Response Function (CRF) of camera %s ... ", camera_serial.c_str());
+        cv::Ptr<cv::CalibrateDebevec> calibrate = cv::createCalibrateDebevec();
+        calibrate->process(images, crf, times);
+        cv::FileStorage output(crf_path, cv::FileStorage::WRITE);
+        if (output.isOpened()) {
+            output << "response" << crf;
+        }
+    }
+    responses_[camera_serial] = crf;
+    return crf;
+}
+
+cv::Mat ExposureFusion::fuse(const string &image_folder, const string &camera_serial) {
+    const int kNumExposures = kExposureTimes.size();
+    vector<cv::Mat> images(kNumExposures);
+
+    /** exposures are decoded in parallel **/
+    #pragma omp parallel for num_threads(kNumExposures)
+    for (int i = 0; i < kNumExposures; ++i) {
+        images[i] = ImageCache::decode(image_folder + "/" + exposureName(kExposureTimes[i]), cv::IMREAD_COLOR);
+    }
+    for (int i = 0; i < kNumExposures; ++i) {
+        if (images[i].empty()) {
+            ROS_WARN("Missing exposure %s in %s.", exposureName(kExposureTimes[i]).c_str(), image_folder.c_str());
+            return cv::Mat();
+        }
+    }
+
+    vector<float> times = realExposureTimes(image_folder);
+    cv::Mat crf = response(camera_serial, images, times);
+
+    /** Mertens fusion, the response is passed like the script does although the fusion does not use it **/
+    cv::Mat fused, fused_8bit;
+    cv::Ptr<cv::MergeMertens> merge_mertens = cv::createMergeMertens();
+    merge_mertens->process(images, fused, times, crf);
+    fused.convertTo(fused_8bit, CV_8UC3, 255);
+
+    /** blend of the clahe and the plain fusion per channel **/
+    cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(1, cv::Size(8, 8));
+    vector<cv::Mat> channels;
+    cv::split(fused_8bit, channels);
+    for (auto &channel : channels) {
+        cv::Mat equalized;
+        clahe->apply(channel, equalized);
+        cv::addWeighted(equalized, kClaheWeight, channel, 1 - kClaheWeight, 0, channel);
+    }
+    cv::Mat result;
+    cv::merge(channels, result);
+    return result;
+}
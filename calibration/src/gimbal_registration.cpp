@@ -0,0 +1,162 @@
+/** headings **/
+#include <gimbal_registration.h>
+/** basic **/
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+/** ceres **/
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+
+using namespace std;
+
+/** p -> R(a, angle) (p - c) + c with the axis a = normalize({tilt_0, 1, tilt_1}) **/
+template <typename T>
+static void gimbalTransformPoint(const T *pivot, const T *tilt, const T &angle, const T *point, T *result) {
+    const T norm = sqrt(tilt[0] * tilt[0] + T(1) + tilt[1] * tilt[1]);
+    const T angle_axis[3] = {angle * tilt[0] / norm, angle / norm, angle * tilt[1] / norm};
+    const T relative[3] = {point[0] - pivot[0], point[1] - pivot[1], point[2] - pivot[2]};
+    ceres::AngleAxisRotatePoint(angle_axis, relative, result);
+    for (int i = 0; i < 3; ++i) {
+        result[i] += pivot[i];
+    }
+}
+
+struct GimbalPlaneFunctor {
+    template <typename T>
+    bool operator()(const T *const pivot, const T *const tilt, const T *const pitch_error, T *residual) const {
+        const T point[3] = {T(point_(0)), T(point_(1)), T(point_(2))};
+        T transformed[3];
+        gimbalTransformPoint(pivot, tilt, T(angle_) + pitch_error[0], point, transformed);
+        residual[0] = T(normal_(0)) * (transformed[0] - T(target_(0)))
+                    + T(normal_(1)) * (transformed[1] - T(target_(1)))
+                    + T(normal_(2)) * (transformed[2] - T(target_(2)));
+        return true;
+    }
+
+    GimbalPlaneFunctor(const Eigen::Vector3d &point, const Eigen::Vector3d &target, const Eigen::Vector3d &normal, double angle)
+        : point_(point), target_(target), normal_(normal), angle_(angle) {}
+
+    static ceres::CostFunction *Create(const Eigen::Vector3d &point, const Eigen::Vector3d &target,
+                                       const Eigen::Vector3d &normal, double angle) {
+        return new ceres::AutoDiffCostFunction<GimbalPlaneFunctor, 1, 3, 2, 1>(
+                new GimbalPlaneFunctor(point, target, normal, angle));
+    }
+
+    const Eigen::Vector3d point_;
+    const Eigen::Vector3d target_;
+    const Eigen::Vector3d normal_;
+    const double angle_;
+};
+
+GimbalRegistration::GimbalRegistration(double gimbal_radius) : pivot_{0, 0, -gimbal_radius} {}
+
+int GimbalRegistration::addTarget(const CloudI::ConstPtr &target, int rows, int cols) {
+    targets_.emplace_back(new ProjectiveIcp(rows, cols));
+    targets_.back()->setMaxCorrespondenceDistance(max_corr_dist_);
+    targets_.back()->setInputTarget(target);
+    return targets_.size() - 1;
+}
+
+int GimbalRegistration::addView(int target_idx, const CloudI::ConstPtr &source, double angle) {
+    View view;
+    view.target_idx = target_idx;
+    view.source = source;
+    view.angle = angle;
+    /** evenly strided subset for the joint solve **/
+    const int kStride = std::max<int>(1, source->size() / max_points_);
+    for (int i = 0; i < source->size(); i += kStride) {
+        view.samples.push_back(i);
+    }
+    views_.push_back(view);
+    return views_.size() - 1;
+}
+
+void GimbalRegistration::associate(const View &view, std::vector<Correspondence> &correspondences) const {
+    correspondences.clear();
+    const double angle = view.angle + view.pitch_error;
+    for (int idx : view.samples) {
+        Correspondence corr;
+        corr.point = view.source->points[idx].getVector3fMap().cast<double>();
+        Eigen::Vector3d transformed;
+        gimbalTransformPoint(pivot_, tilt_, angle, corr.point.data(), transformed.data());
+        if (targets_[view.target_idx]->correspondence(transformed, corr.target_point, corr.normal)) {
+            correspondences.push_back(corr);
+        }
+    }
+}
+
+void GimbalRegistration::solve() {
+    const int kNumViews = views_.size();
+    std::vector<std::vector<Correspondence>> correspondences(kNumViews);
+    for (auto &target : targets_) {
+        target->setMaxCorrespondenceDistance(max_corr_dist_);
+    }
+
+    for (int round = 0; round < rounds_; ++round) {
+        #pragma omp parallel for num_threads(THREADS)
+        for (int i = 0; i < kNumViews; ++i) {
+            associate(views_[i], correspondences[i]);
+        }
+
+        ceres::Problem problem;
+        ceres::LossFunction *loss_function = new ceres::HuberLoss(0.02);
+        problem.AddParameterBlock(pivot_, 3, new ceres::SubsetManifold(3, {1}));
+        problem.AddParameterBlock(tilt_, 2);
+        for (int k = 0; k < 2; ++k) {
+            problem.SetParameterLowerBound(tilt_, k, -0.1);
+            problem.SetParameterUpperBound(tilt_, k, 0.1);
+        }
+        for (int i = 0; i < kNumViews; ++i) {
+            View &view = views_[i];
+            problem.AddParameterBlock(&view.pitch_error, 1);
+            problem.SetParameterLowerBound(&view.pitch_error, 0, -0.1);
+            problem.SetParameterUpperBound(&view.pitch_error, 0, 0.1);
+            for (auto &corr : correspondences[i]) {
+                problem.AddResidualBlock(GimbalPlaneFunctor::Create(corr.point, corr.target_point, corr.normal, view.angle),
+                                         loss_function, pivot_, tilt_, &view.pitch_error);
+            }
+        }
+
+        ceres::Solver::Options options;
+        options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY; /** 5 + one parameter per view, many residuals **/
+        options.max_num_iterations = solver_iterations_;
+        options.num_threads = THREADS;
+        ceres::Solver::Summary summary;
+        ceres::Solve(options, &problem, &summary);
+        if (MESSAGE_EN) {
+            std::cout << "Gimbal round " << round << ": " << summary.BriefReport() << std::endl;
+        }
+    }
+
+    /** per view quality with the final parameters **/
+    #pragma omp parallel for num_threads(THREADS)
+    for (int i = 0; i < kNumViews; ++i) {
+        View &view = views_[i];
+        associate(view, correspondences[i]);
+        const double angle = view.angle + view.pitch_error;
+        double sum_sq = 0;
+        for (auto &corr : correspondences[i]) {
+            Eigen::Vector3d transformed;
+            gimbalTransformPoint(pivot_, tilt_, angle, corr.point.data(), transformed.data());
+            const double dist = corr.normal.dot(transformed - corr.target_point);
+            sum_sq += dist * dist;
+        }
+        const int num_corr = correspondences[i].size();
+        view.rms = num_corr > 0 ? sqrt(sum_sq / num_corr) : std::numeric_limits<double>::max();
+        view.inlier_ratio = view.samples.empty() ? 0 : double(num_corr) / view.samples.size();
+    }
+}
+
+Mat4F GimbalRegistration::transform(int view_idx) const {
+    const View &view = views_[view_idx];
+    const double angle = view.angle + view.pitch_error;
+    Eigen::Vector3d axis(tilt_[0], 1, tilt_[1]);
+    Mat3D R = Eigen::AngleAxisd(angle, axis.normalized()).toRotationMatrix();
+    Vec3D c(pivot_[0], pivot_[1], pivot_[2]);
+    Mat4D trans_mat = Mat4D::Identity();
+    trans_mat.topLeftCorner(3, 3) = R;
+    trans_mat.topRightCorner(3, 1) = c - R * c;
+    return trans_mat.cast<float>();
+}
@@ -0,0 +1,247 @@
+/** headings **/
+#include <image_cache.h>
+/** basic **/
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/** header fields of an uncompressed 24-bit BMP, see BITMAPFILEHEADER and BITMAPINFOHEADER **/
+struct BmpLayout {
+    int width;
+    int height; /** negative for top-down row order **/
+    size_t offset;
+    size_t stride;
+};
+
+template <typename T>
+static T readLittle(const uint8_t *data) {
+    T val;
+    memcpy(&val, data, sizeof(T));
+    return val;
+}
+
+static bool plainBmpLayout(const uint8_t *data, size_t size, BmpLayout &layout) {
+    const size_t kHeaderSize = 14 + 40;
+    if (size < kHeaderSize || data[0] != 'B' || data[1] != 'M') {
+        return false;
+    }
+    layout.offset = readLittle<uint32_t>(data + 10);
+    uint32_t info_size = readLittle<uint32_t>(data + 14);
+    layout.width = readLittle<int32_t>(data + 18);
+    layout.height = readLittle<int32_t>(data + 22);
+    uint16_t bits = readLittle<uint16_t>(data + 28);
+    uint32_t compression = readLittle<uint32_t>(data + 30);
+    if (info_size < 40 || bits != 24 || compression != 0 || layout.width <= 0 || layout.height == 0) {
+        return false;
+    }
+    layout.stride = (size_t(layout.width) * 3 + 3) & ~size_t(3); /** rows are padded to 4 bytes **/
+    return layout.offset + layout.stride * abs(layout.height) <= size;
+}
+
+ImageCache::ImageCache(size_t budget_bytes) : budget_(budget_bytes) {}
+
+ImageCache::~ImageCache() {
+    std::vector<std::shared_future<ImagePtr>> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &entry : pending_) {
+            pending.push_back(entry.second);
+        }
+    }
+    for (auto &future : pending) {
+        future.wait();
+    }
+}
+
+cv::Mat ImageCache::decode(const string &path, int flags) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return cv::Mat();
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        return cv::Mat();
+    }
+    const size_t size = file_stat.st_size;
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return cv::imread(path, flags);
+    }
+    madvise(addr, size, MADV_SEQUENTIAL);
+    const uint8_t *data = static_cast<const uint8_t *>(addr);
+
+    cv::Mat image;
+    BmpLayout layout;
+    if ((flags == cv::IMREAD_UNCHANGED || flags == cv::IMREAD_COLOR) && plainBmpLayout(data, size, layout)) {
+        /** the pixel array is wrapped in place, one copy (flipped for bottom-up files) out of the mapping **/
+        cv::Mat pixels(abs(layout.height), layout.width, CV_8UC3, const_cast<uint8_t *>(data + layout.offset), layout.stride);
+        if (layout.height > 0) {
+            cv::flip(pixels, image, 0);
+        }
+        else {
+            image = pixels.clone();
+        }
+    }
+    else if (size <= size_t(std::numeric_limits<int>::max())) {
+        cv::Mat buffer(1, int(size), CV_8UC1, const_cast<uint8_t *>(data));
+        image = cv::imdecode(buffer, flags);
+    }
+    else {
+        /** a 1 x size matrix can not address it, decoded from the file instead **/
+        munmap(addr, size);
+        return cv::imread(path, flags);
+    }
+    munmap(addr, size);
+    return image;
+}
+
+string ImageCache::key(const string &path, int flags) {
+    return path + "#" + to_string(flags);
+}
+
+long ImageCache::modifiedTime(const string &path) {
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0) {
+        return -1;
+    }
+    return file_stat.st_mtim.tv_sec * 1000000000L + file_stat.st_mtim.tv_nsec;
+}
+
+ImageCache::ImagePtr ImageCache::get(const string &path, int flags) {
+    const string image_key = key(path, flags);
+    const long mtime = modifiedTime(path);
+    std::shared_future<ImagePtr> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(image_key);
+        if (it != entries_.end()) {
+            if (it->second.mtime == mtime) {
+                lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+                return it->second.image;
+            }
+            /** stale, the file was rewritten **/
+            used_ -= it->second.bytes;
+            lru_.erase(it->second.lru_it);
+            entries_.erase(it);
+        }
+        auto pending_it = pending_.find(image_key);
+        if (pending_it != pending_.end()) {
+            pending = pending_it->second;
+        }
+    }
+
+    ImagePtr image = pending.valid() ? pending.get() : ImagePtr(new cv::Mat(decode(path, flags)));
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.erase(image_key);
+    dropFinished();
+    if (image->empty()) {
+        return ImagePtr();
+    }
+    if (entries_.find(image_key) == entries_.end()) {
+        insert(image_key, image, mtime);
+    }
+    return image;
+}
+
+void ImageCache::prefetch(const string &path, int flags) {
+    const string image_key = key(path, flags);
+    const long mtime = modifiedTime(path);
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0) {
+        return;
+    }
+    /** the file size, exact for plain BMP, a lower bound for compressed formats **/
+    const size_t reserved = file_stat.st_size;
+    std::lock_guard<std::mutex> lock(mutex_);
+    dropFinished();
+    if (entries_.count(image_key) > 0 || pending_.count(image_key) > 0 || pending_bytes_ + reserved > budget_) {
+        return;
+    }
+    pending_bytes_ += reserved;
+    evict();
+    /** the decode lands in the cache itself, so an image that is never asked for is still counted and evicted **/
+    pending_[image_key] = std::async(std::launch::async, [this, path, flags, image_key, mtime, reserved]() {
+        ImagePtr image(new cv::Mat(decode(path, flags)));
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_bytes_ -= reserved;
+        if (!image->empty() && entries_.find(image_key) == entries_.end()) {
+            insert(image_key, image, mtime);
+        }
+        return image;
+    }).share();
+}
+
+/** forgets the decodes that have landed, from the caller side since a task can not release its own state **/
+void ImageCache::dropFinished() {
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            it = pending_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+ImageCache::ImagePtr ImageCache::put(const string &path, const cv::Mat &image, int flags) {
+    const string image_key = key(path, flags);
+    ImagePtr cached(new cv::Mat(image));
+    const long mtime = modifiedTime(path);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(image_key);
+    if (it != entries_.end()) {
+        used_ -= it->second.bytes;
+        lru_.erase(it->second.lru_it);
+        entries_.erase(it);
+    }
+    insert(image_key, cached, mtime);
+    return cached;
+}
+
+void ImageCache::insert(const string &image_key, ImagePtr image, long mtime) {
+    Entry entry;
+    entry.image = image;
+    entry.mtime = mtime;
+    entry.bytes = image->total() * image->elemSize();
+    lru_.push_front(image_key);
+    entry.lru_it = lru_.begin();
+    used_ += entry.bytes;
+    entries_[image_key] = entry;
+    evict();
+}
+
+/** drop the least recently used images until the budget holds with the decodes in flight, the newest one always stays **/
+void ImageCache::evict() {
+    while (used_ + pending_bytes_ > budget_ && lru_.size() > 1) {
+        auto it = entries_.find(lru_.back());
+        used_ -= it->second.bytes;
+        entries_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+void ImageCache::setBudget(size_t budget_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = budget_bytes;
+    evict();
+}
+
+void ImageCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    lru_.clear();
+    used_ = 0;
+}
+
+size_t ImageCache::usedBytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_;
+}
@@ -0,0 +1,359 @@
+/**
+ * Micro benchmarks of the calibration kernels over input sizes and thread counts.
+ * Inputs are generated from a seeded synthetic scene (synthetic_scene.h) and written to a scratch dataset where a
+ * kernel reads or writes files, so file access is part of lidarToSphere, sphereToPlane and generateEdgeCloud.
+ * Each case is timed over several repeats after one untimed run; median, minimum, ns per point and the scaling
+ * against the first thread count are appended to <output>.csv and written to <output>.json.
+ *
+ * usage: kernel_benchmark [--sizes 10000,100000,1000000] [--threads 1,2,4,8] [--repeats 3]
+ *                         [--kernels name,...] [--work /tmp/kernel_benchmark] [--output kernel_benchmark]
+ **/
+/** basic **/
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+/** pcl **/
+#include <pcl/io/pcd_io.h>
+#include <pcl/common/io.h>
+#include <pcl/common/time.h>
+/** openmp **/
+#include <omp.h>
+/** headings **/
+#include <define.h>
+#include <omni_process.h>
+#include <lidar_process.h>
+#include <optimization.h>
+#include <synthetic_scene.h>
+#include <common_lib.h>
+
+using namespace std;
+
+struct KernelCase {
+    string name;
+    std::function<void(int)> prepare; /** builds the inputs of a size, untimed **/
+    std::function<void()> run;
+    bool cloud_input = true; /** processes the synthetic cloud, false for inputs of exactly size points **/
+};
+
+struct KernelResult {
+    string kernel;
+    int size;
+    int points; /** processed, the synthetic cloud keeps only the rays that hit the scene **/
+    int threads;
+    int repeats;
+    double median;
+    double min;
+    double speedup;
+    double efficiency; /** speedup over the thread ratio to the first thread count **/
+};
+
+std::vector<double> parseList(const string &arg) {
+    std::vector<double> values;
+    std::stringstream stream(arg);
+    string item;
+    while (std::getline(stream, item, ',')) {
+        values.push_back(std::stod(item));
+    }
+    return values;
+}
+
+/** points of the center view of a spot in a synthetic hall, the same for every run of a size **/
+CloudI::Ptr syntheticCloud(int size, unsigned int seed) {
+    SyntheticScene scene = SyntheticScene::hall({Vec3D::Zero()}, seed);
+    CloudI::Ptr cloud(new CloudI);
+    cloud->points.resize(size);
+    std::vector<char> valid(size, 0);
+    #pragma omp parallel for
+    for (int i = 0; i < size; ++i) {
+        const Vec3D dir = Mid360Pattern::direction(i);
+        SceneHit hit;
+        if (scene.raycast(Vec3D::Zero(), dir, Mid360Pattern::kMaxRange, hit)) {
+            const double range = hit.range + 0.01 * hashNormal(seed + 2 * uint64_t(i));
+            cloud->points[i].x = dir(0) * range;
+            cloud->points[i].y = dir(1) * range;
+            cloud->points[i].z = dir(2) * range;
+            cloud->points[i].intensity = 255 * hit.albedo;
+            valid[i] = 1;
+        }
+    }
+    int num_valid = 0;
+    for (int i = 0; i < size; ++i) {
+        if (valid[i]) {
+            cloud->points[num_valid++] = cloud->points[i];
+        }
+    }
+    cloud->points.resize(num_valid);
+    cloud->width = num_valid;
+    cloud->height = 1;
+    return cloud;
+}
+
+void writeResults(const string &output, const std::vector<KernelResult> &results) {
+    char stamp[32];
+    time_t now = time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    const string csv_path = output + ".csv";
+    const bool new_file = !std::ifstream(csv_path).good();
+    std::ofstream csv(csv_path, ios::app);
+    if (new_file) {
+        csv << "timestamp,kernel,size,points,threads,repeats,median_s,min_s,ns_per_point,speedup,efficiency\n";
+    }
+    std::ofstream json(output + ".json");
+    json << "{\n  \"timestamp\": \"" << stamp << "\",\n  \"results\": [\n";
+    for (int i = 0; i < results.size(); ++i) {
+        const KernelResult &r = results[i];
+        const double ns_per_point = r.median / r.points * 1e9;
+        csv << stamp << "," << r.kernel << "," << r.size << "," << r.points << "," << r.threads << "," << r.repeats << ","
+            << r.median << "," << r.min << "," << ns_per_point << "," << r.speedup << "," << r.efficiency << "\n";
+        json << "    {\"kernel\": \"" << r.kernel << "\", \"size\": " << r.size << ", \"points\": " << r.points
+             << ", \"threads\": " << r.threads
+             << ", \"repeats\": " << r.repeats << ", \"median_s\": " << r.median << ", \"min_s\": " << r.min
+             << ", \"ns_per_point\": " << ns_per_point << ", \"speedup\": " << r.speedup
+             << ", \"efficiency\": " << r.efficiency << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
+    cout << "Kernel benchmark results written to " << output << ".csv/.json" << endl;
+}
+
+int main(int argc, char **argv) {
+    std::vector<double> sizes = {1e4, 1e5, 1e6};
+    std::vector<double> thread_counts;
+    for (int n = 1; n <= omp_get_num_procs(); n *= 2) {
+        thread_counts.push_back(n);
+    }
+    int repeats = 3;
+    string kernel_filter;
+    string work_path = "/tmp/kernel_benchmark";
+    string output = "kernel_benchmark";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const string key = argv[i], value = argv[i + 1];
+        if (key == "--sizes") { sizes = parseList(value); }
+        else if (key == "--threads") { thread_counts = parseList(value); }
+        else if (key == "--repeats") { repeats = std::stoi(value); }
+        else if (key == "--kernels") { kernel_filter = "," + value + ","; }
+        else if (key == "--work") { work_path = value; }
+        else if (key == "--output") { output = value; }
+        else {
+            cout << "unknown option " << key << endl;
+            return 1;
+        }
+    }
+    const unsigned int kSeed = 42;
+
+    /** scratch dataset of one spot and one view **/
+    LidarProcess::Config lidar_config;
+    lidar_config.pkg_path = work_path;
+    lidar_config.dataset_name = "bench";
+    OmniProcess::Config omni_config;
+    omni_config.pkg_path = work_path;
+    omni_config.dataset_name = "bench";
+    LidarProcess lidar(lidar_config);
+    OmniProcess omnicam(omni_config);
+    const string view_path = lidar.folder_path_vec[0][0];
+    for (const string &folder : {work_path, work_path + "/data", lidar.kDatasetPath, lidar.kDatasetPath + "/spot0",
+                                 lidar.file_path_vec[0][0].recon_folder_path, view_path, view_path + "/outputs",
+                                 lidar.file_path_vec[0][0].output_folder_path}) {
+        CheckFolder(folder);
+    }
+
+    std::vector<double> params_init = {
+        M_PI + 0.02, 0.02, -M_PI/2, /** Rx Ry Rz **/
+        0.27, 0.00, 0.03, /** tx ty tz **/
+        1023.0, 1201.0, /** u0 v0 **/
+        616.7214056132 * M_PI, -616.7214056132, 0.0, 0.0, 0.0,
+        1, 0, 0 /** c, d, e **/
+    };
+    Param_D params = Eigen::Map<Param_D>(params_init.data());
+    lidar.ext_ = params.head(6);
+    omnicam.int_ = params.tail(K_INT);
+    Ext_D ext = params.head(6);
+    const Mat4D lidar_to_camera = transformMat(ext);
+
+    /** inputs shared by the cases of a size **/
+    CloudI::Ptr cloud, polar_cloud(new CloudI), shifted_cloud(new CloudI);
+    std::vector<Vec3D> camera_points;
+    DensityMap density_map;
+    cv::Mat edge_pattern;
+    const double kWeight = 1.0;
+    double sink = 0; /** keeps the results of the pure kernels alive **/
+
+    std::vector<KernelCase> cases = {
+        {"intrinsic_transform",
+         [&](int size) {
+             camera_points.resize(cloud->size());
+             for (int i = 0; i < cloud->size(); ++i) {
+                 Vec4D point(cloud->points[i].x, cloud->points[i].y, cloud->points[i].z, 1);
+                 camera_points[i] = (lidar_to_camera * point).head(3);
+             }
+         },
+         [&]() {
+             const int n = camera_points.size();
+             double sum = 0;
+             #pragma omp parallel for num_threads(THREADS) reduction(+:sum)
+             for (int i = 0; i < n; ++i) {
+                 Int_D intrinsic = omnicam.int_;
+                 Vec3D point = camera_points[i];
+                 sum += IntrinsicTransform(intrinsic, point)(0);
+             }
+             sink += sum;
+         }},
+        {"transform_mat",
+         [&](int size) {},
+         [&]() {
+             const int n = cloud->size();
+             double sum = 0;
+             #pragma omp parallel for num_threads(THREADS) reduction(+:sum)
+             for (int i = 0; i < n; ++i) {
+                 Ext_D extrinsic = lidar.ext_;
+                 extrinsic(0) += 1e-9 * i;
+                 sum += transformMat(extrinsic)(0, 1);
+             }
+             sink += sum;
+         }},
+        {"lidar_to_sphere",
+         [&](int size) {
+             pcl::io::savePCDFileBinary(lidar.file_path_vec[0][0].spot_cloud_path, *cloud);
+         },
+         [&]() {
+             CloudI::Ptr cart_cloud(new CloudI);
+             lidar.lidarToSphere(cart_cloud, polar_cloud);
+         }},
+        {"sphere_to_plane",
+         [&](int size) {
+             CloudI::Ptr cart_cloud(new CloudI);
+             lidar.lidarToSphere(cart_cloud, polar_cloud);
+         },
+         [&]() {
+             lidar.sphereToPlane(polar_cloud);
+         }},
+        {"generate_edge_cloud",
+         [&](int size) {
+             CloudI::Ptr cart_cloud(new CloudI);
+             lidar.lidarToSphere(cart_cloud, polar_cloud);
+             lidar.sphereToPlane(polar_cloud);
+             /** fixed pattern marking about 9% of the flat image as edges **/
+             edge_pattern = cv::Mat::zeros(lidar.kFlatRows, lidar.kFlatCols, CV_8UC1);
+             for (int u = 0; u < lidar.kFlatRows; ++u) {
+                 for (int v = 0; v < lidar.kFlatCols; ++v) {
+                     edge_pattern.at<uchar>(u, v) = ((7 * u + 13 * v) % 11 == 0) ? 255 : 0;
+                 }
+             }
+         },
+         [&]() {
+             /** generateEdgeCloud releases the in-memory edge image, hand it over on every run **/
+             lidar.edge_img = edge_pattern;
+             lidar.edge_img_pose = {lidar.spot_idx, lidar.view_idx};
+             lidar.generateEdgeCloud(cloud);
+         }},
+        {"kde",
+         [&](int size) {
+             /** edge pixels uniform over the effective annulus of the fisheye **/
+             EdgeCloud &edges = omnicam.edge_cloud_vec[0][0];
+             edges.clear();
+             std::mt19937 rng(kSeed);
+             std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+             std::uniform_real_distribution<double> radius(omnicam.kEffectiveRadius.first, omnicam.kEffectiveRadius.second);
+             for (int i = 0; i < size; ++i) {
+                 const double a = angle(rng), r = radius(rng);
+                 edges.push_back(pcl::PointXYZ(omnicam.int_(0) + r * cos(a), omnicam.int_(1) + r * sin(a), 0));
+             }
+         },
+         [&]() {
+             sink += omnicam.Kde(4, 0.25)[0];
+         },
+         false},
+        {"quaternion_functor",
+         [&](int size) {
+             const int rows = omnicam.kImageSize.first, cols = omnicam.kImageSize.second;
+             std::vector<double> values(rows * cols);
+             for (int u = 0; u < rows; ++u) {
+                 for (int v = 0; v < cols; ++v) {
+                     values[u * cols + v] = 1 + sin(u / 37.0) * cos(v / 53.0);
+                 }
+             }
+             density_map.setValues(std::move(values), rows, cols, 1.0);
+         },
+         [&]() {
+             const Eigen::Quaterniond q(lidar_to_camera.topLeftCorner<3, 3>());
+             const double q_param[4] = {q.x(), q.y(), q.z(), q.w()};
+             const double t_param[3] = {lidar.ext_(3), lidar.ext_(4), lidar.ext_(5)};
+             const double *blocks[3] = {q_param, t_param, omnicam.int_.data()};
+             const int n = cloud->size();
+             double sum = 0;
+             /** residuals and jacobians, as in the solver **/
+             #pragma omp parallel for num_threads(THREADS) reduction(+:sum)
+             for (int i = 0; i < n; ++i) {
+                 Vec3D point(cloud->points[i].x, cloud->points[i].y, cloud->points[i].z);
+                 std::unique_ptr<ceres::CostFunction> cost(edgeCostFunction(point, kWeight, density_map));
+                 double residuals[3], jac_q[3 * 4], jac_t[3 * 3], jac_int[3 * K_INT];
+                 double *jacobians[3] = {jac_q, jac_t, jac_int};
+                 cost->Evaluate(blocks, residuals, jacobians);
+                 sum += residuals[0];
+             }
+             sink += sum;
+         }},
+        {"get_fitness_score",
+         [&](int size) {
+             pcl::copyPointCloud(*cloud, *shifted_cloud);
+             for (int i = 0; i < shifted_cloud->size(); ++i) {
+                 shifted_cloud->points[i].x += 0.01 * hashNormal(kSeed + 3 * uint64_t(i));
+                 shifted_cloud->points[i].y += 0.01 * hashNormal(kSeed + 3 * uint64_t(i) + 1);
+                 shifted_cloud->points[i].z += 0.01 * hashNormal(kSeed + 3 * uint64_t(i) + 2);
+             }
+         },
+         [&]() {
+             sink += lidar.getFitnessScore(cloud, shifted_cloud, 0.5);
+         }}
+    };
+
+    std::vector<KernelResult> results;
+    for (double size_value : sizes) {
+        const int size = size_value;
+        cloud = syntheticCloud(size, kSeed);
+        for (KernelCase &kernel : cases) {
+            if (!kernel_filter.empty() && kernel_filter.find("," + kernel.name + ",") == string::npos) {
+                continue;
+            }
+            kernel.prepare(size);
+            const int points = kernel.cloud_input ? cloud->size() : size;
+            double base_time = 0;
+            int base_threads = 0;
+            for (double threads_value : thread_counts) {
+                const int threads = threads_value;
+                threadCount() = threads;
+                omp_set_num_threads(threads); /** libraries using the default team, mlpack in Kde **/
+                kernel.run();
+                std::vector<double> times;
+                pcl::StopWatch timer;
+                for (int r = 0; r < repeats; ++r) {
+                    timer.reset();
+                    kernel.run();
+                    times.push_back(timer.getTimeSeconds());
+                }
+                std::sort(times.begin(), times.end());
+                KernelResult result = {kernel.name, size, points, threads, repeats, times[times.size() / 2], times.front(), 1.0, 1.0};
+                if (base_time == 0) {
+                    base_time = result.median;
+                    base_threads = threads;
+                }
+                result.speedup = base_time / result.median;
+                result.efficiency = result.speedup * base_threads / threads;
+                results.push_back(result);
+                cout << kernel.name << " size " << size << " threads " << threads << ": "
+                     << result.median * 1e3 << " ms, " << result.median / points * 1e9 << " ns/point, speedup "
+                     << result.speedup << endl;
+            }
+        }
+    }
+    cout << "checksum " << sink << endl;
+    writeResults(output, results);
+    return 0;
+}
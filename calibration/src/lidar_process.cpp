@@ -1,20 +1,65 @@
 /** headings **/
 #include <lidar_process.h>
 #include <common_lib.h>
+#ifndef CALIB_HEADLESS
+#include <ros_params.h>
+#endif
 
 /** namespace **/
 using namespace std;
 using namespace cv;
 using namespace Eigen;
 
-LidarProcess::LidarProcess() {
-    /** parameter server **/
-    ros::param::get("essential/kLidarTopic", topic_name);
-    ros::param::get("essential/kDatasetName", dataset_name);
-    ros::param::get("essential/kNumSpots", num_spots);
-    ros::param::get("essential/kNumViews", num_views);
-    ros::param::get("essential/kAngleInit", view_angle_init);
-    ros::param::get("essential/kAngleStep", view_angle_step);
+#ifndef CALIB_HEADLESS
+LidarProcess::LidarProcess() : LidarProcess(paramServerConfig()) {}
+
+LidarProcess::Config LidarProcess::paramServerConfig() {
+    return loadConfig(RosParams(), ros::package::getPath("calibration"));
+}
+#endif
+
+LidarProcess::Config LidarProcess::loadConfig(const ParamSource &params, const string &pkg_path) {
+    Config config;
+    config.pkg_path = pkg_path;
+    params.get("essential/kLidarTopic", config.topic_name);
+    params.get("essential/kDatasetName", config.dataset_name);
+    params.get("essential/kNumSpots", config.num_spots);
+    params.get("essential/kNumViews", config.num_views);
+    params.get("essential/kAngleInit", config.view_angle_init);
+    params.get("essential/kAngleStep", config.view_angle_step);
+    params.get("switch/kNativeEdge", config.native_edge);
+    params.get("switch/kEdgeCompare", config.edge_compare);
+    params.get("switch/kAdaptiveIntegration", config.adaptive_integration);
+    params.get("switch/kOrganizedNormals", config.organized_normals);
+    params.get("switch/kProjectiveIcp", config.projective_icp);
+    params.get("switch/kIcpCompare", config.icp_compare);
+    params.get("gimbal/kMaxRms", config.gimbal_max_rms);
+    params.get("gimbal/kMinInlierRatio", config.gimbal_min_inliers);
+    params.get("coverage/kTargetCoverage", config.target_coverage);
+    params.get("coverage/kWindow", config.coverage_window);
+    params.get("coverage/kMinGain", config.min_coverage_gain);
+    return config;
+}
+
+LidarProcess::LidarProcess(const Config &config) {
+    kPkgPath = config.pkg_path;
+    topic_name = config.topic_name;
+    dataset_name = config.dataset_name;
+    num_spots = config.num_spots;
+    num_views = config.num_views;
+    view_angle_init = config.view_angle_init;
+    view_angle_step = config.view_angle_step;
+    kNativeEdge = config.native_edge;
+    kEdgeCompare = config.edge_compare;
+    kAdaptiveIntegration = config.adaptive_integration;
+    kTargetCoverage = config.target_coverage;
+    kCoverageWindow = config.coverage_window;
+    kMinCoverageGain = config.min_coverage_gain;
+    kOrganizedNormals = config.organized_normals;
+    kProjectiveIcp = config.projective_icp;
+    kIcpCompare = config.icp_compare;
+    kGimbalMaxRms = config.gimbal_max_rms;
+    kGimbalMinInliers = config.gimbal_min_inliers;
     kDatasetPath = kPkgPath + "/data/" + dataset_name;
     center_view_idx = (num_views - 1) / 2;
 
@@ -22,11 +67,13 @@ LidarProcess::LidarProcess() {
     vector<vector<PoseFilePath>> file_path_vec_tmp(num_spots, vector<PoseFilePath>(num_views));
     vector<vector<EdgeCloud>> edge_cloud_vec_tmp(num_spots, vector<EdgeCloud>(num_views));
     vector<vector<TagsMap>> tags_map_vec_tmp(num_spots, vector<TagsMap>(num_views));
+    vector<vector<vector<EdgeCloud>>> edge_pyramid_vec_tmp(num_spots, vector<vector<EdgeCloud>>(num_views, vector<EdgeCloud>(kPyramidLevels - 1)));
     vector<vector<Mat4F>> pose_trans_mat_vec_tmp(num_spots, vector<Mat4F>(num_views));
     this->folder_path_vec = folder_path_vec_tmp;
     this->file_path_vec = file_path_vec_tmp;
     this->edge_cloud_vec = edge_cloud_vec_tmp;
     this->tags_map_vec = tags_map_vec_tmp;
+    this->edge_pyramid_vec = edge_pyramid_vec_tmp;
     this->pose_trans_mat_vec = pose_trans_mat_vec_tmp;
 
     for (int i = 0; i < num_spots; ++i) {
@@ -44,11 +91,13 @@ LidarProcess::LidarProcess() {
 
 /** Data Pre-processing **/
 void LidarProcess::lidarToSphere(CloudI::Ptr &cart_cloud, CloudI::Ptr &polar_cloud) {
-
+    TraceSpan span("lidar.lidarToSphere", spot_idx, view_idx);
     float theta_min = M_PI, theta_max = -M_PI;
 
     string fullview_cloud_path = file_path_vec[spot_idx][view_idx].spot_cloud_path;
     pcl::io::loadPCDFile(fullview_cloud_path, *cart_cloud);
+    traceFileRead(fullview_cloud_path);
+    span.pointsIn(cart_cloud->size());
 
     /** Initial Transformation **/
     Ext_D extrinsic_vec;
@@ -66,12 +115,15 @@ void LidarProcess::lidarToSphere(CloudI::Ptr &cart_cloud, CloudI::Ptr &polar_clo
         if (theta > theta_max) { theta_max = theta; }
         else if (theta < theta_min) { theta_min = theta; }
     }
+    span.pointsOut(polar_cloud->size());
     if (MESSAGE_EN) {
         ROS_INFO("Polar cloud generated. \ntheta: (min, max) = (%f, %f)", theta_min, theta_max);
     }
 }
 
 void LidarProcess::sphereToPlane(CloudI::Ptr& polar_cloud) {
+    TraceSpan span("lidar.sphereToPlane", spot_idx, view_idx);
+    span.pointsIn(polar_cloud->size());
     cout << "----- LiDAR: SphereToPlane -----" << " Spot Index: " << spot_idx << endl;
     /** define the data container **/
     cv::Mat flat_img = cv::Mat::zeros(kFlatRows, kFlatCols, CV_8U); /** define the flat image **/
@@ -155,22 +207,61 @@ void LidarProcess::sphereToPlane(CloudI::Ptr& polar_cloud) {
     /** add the tags_map of this specific pose to maps **/
     tags_map_vec[spot_idx][view_idx] = tags_map;
 
+    this->flat_img = flat_img;
+    this->flat_img_pose = {spot_idx, view_idx};
     string flat_img_path = this->file_path_vec[spot_idx][view_idx].flat_img_path;
     cv::imwrite(flat_img_path, flat_img);
-
+    traceFileWritten(flat_img_path);
 }
 
 void LidarProcess::edgeExtraction() {
+    TraceSpan span("lidar.edgeExtraction", spot_idx, view_idx);
     string script_path = kPkgPath + "/python_scripts/image_process/edge_extraction.py";
-    string kSpots = to_string(spot_idx);
-    string cmd_str = "python3 " + script_path + " " + kDatasetPath + " " + "lidar" + " " + kSpots;
-    int status = system(cmd_str.c_str());
+    pcl::StopWatch timer;
+    double native_time = 0;
+
+    if (kNativeEdge || kEdgeCompare) {
+        string mask_path = kPkgPath + "/python_scripts/image_process/flat_lidar_image_mask.png";
+        cv::Mat mask = cv::imread(mask_path, cv::IMREAD_GRAYSCALE);
+        if (this->flat_img_pose != std::make_pair(spot_idx, view_idx)) {
+            this->flat_img = cv::imread(file_path_vec[spot_idx][view_idx].flat_img_path, cv::IMREAD_GRAYSCALE);
+        }
+        timer.reset();
+        this->edge_img = lidarEdgeImage(this->flat_img, mask);
+        native_time = timer.getTimeSeconds();
+        /** the flat image is not needed after the edges **/
+        this->flat_img.release();
+        this->flat_img_pose = {-1, -1};
+        /** written for the runs that start from generateEdgeCloud, the in-memory copy saves the read back **/
+        cv::imwrite(file_path_vec[spot_idx][view_idx].edge_img_path, this->edge_img);
+    }
+
+    if (!kNativeEdge || kEdgeCompare) {
+        string kSpots = to_string(spot_idx);
+        string cmd_str = "python3 " + script_path + " " + kDatasetPath + " " + "lidar" + " " + kSpots;
+        timer.reset();
+        int status = system(cmd_str.c_str());
+        double script_time = timer.getTimeSeconds();
+        cv::Mat script_edges = cv::imread(file_path_vec[spot_idx][view_idx].edge_img_path, cv::IMREAD_GRAYSCALE);
+        if (kEdgeCompare) {
+            compareEdgeImages(this->edge_img, script_edges, native_time, script_time, "LiDAR");
+        }
+        if (!kNativeEdge) {
+            this->edge_img = script_edges;
+        }
+    }
+    this->edge_img_pose = {spot_idx, view_idx};
 }
 
 void LidarProcess::generateEdgeCloud(CloudI::Ptr& cart_cloud) {
+    TraceSpan span("lidar.generateEdgeCloud", spot_idx, view_idx);
+    span.pointsIn(cart_cloud->size());
     PoseFilePath &path_vec = this->file_path_vec[spot_idx][view_idx];
     string edge_img_path = this->file_path_vec[spot_idx][view_idx].edge_img_path;
-    cv::Mat edge_img = cv::imread(edge_img_path, cv::IMREAD_UNCHANGED);
+    cv::Mat edge_img = (this->edge_img_pose == std::make_pair(spot_idx, view_idx)) ?
+                       this->edge_img : cv::imread(edge_img_path, cv::IMREAD_UNCHANGED);
+    this->edge_img.release();
+    this->edge_img_pose = {-1, -1};
 
     ROS_ASSERT_MSG((edge_img.rows != 0 && edge_img.cols != 0), "size of original fisheye image is 0, check the path and filename! \nView Index: %d \nPath: %s", view_idx, edge_img_path.c_str());
     ROS_ASSERT_MSG((edge_img.rows == kFlatRows || edge_img.cols == kFlatCols), "size of original fisheye image is incorrect! View Index: %d", view_idx);
@@ -197,6 +288,8 @@ void LidarProcess::generateEdgeCloud(CloudI::Ptr& cart_cloud) {
     us.filter(*edge_xyzi);
 
     pcl::copyPointCloud(*edge_xyzi, this->edge_cloud_vec[spot_idx][view_idx]);
+    span.pointsOut(edge_xyzi->size());
+    buildEdgePyramid();
     string edge_cloud_path = file_path_vec[spot_idx][view_idx].edge_cloud_path;
     if (kColorMap) {
         pcl::io::savePCDFileBinary(edge_cloud_path, *edge_xyzi);
@@ -205,16 +298,82 @@ void LidarProcess::generateEdgeCloud(CloudI::Ptr& cart_cloud) {
         pcl::copyPointCloud(*edge_xyzi, *edge_cloud);
         pcl::io::savePCDFileBinary(edge_cloud_path, *edge_cloud);
     }
+    traceFileWritten(edge_cloud_path);
 
 }
 
 void LidarProcess::ReadEdge() {
     string edge_cloud_path = this->file_path_vec[spot_idx][view_idx].edge_cloud_path;
     loadPcd(edge_cloud_path, this->edge_cloud_vec[spot_idx][view_idx], "lidar edge");
+    buildEdgePyramid();
+}
+
+/** 
+ * The edge points are binned on the flat image grid of lidarToSphere, level l uses blocks of 2^l x 2^l pixels,
+ * which matches a tags map of 1/2^l resolution. The point nearest to the block center represents the block,
+ * an actual edge point rather than an average across a depth discontinuity.
+ **/
+void LidarProcess::buildEdgePyramid() {
+    EdgeCloud &edge_cloud = this->edge_cloud_vec[spot_idx][view_idx];
+    Ext_D extrinsic_vec;
+    extrinsic_vec << ext_.head(3), 0, 0, 0;
+    Mat3F rotation = transformMat(extrinsic_vec).topLeftCorner(3, 3).cast<float>();
+
+    /** continuous flat image coordinates of each edge point **/
+    const int kNumPoints = edge_cloud.size();
+    vector<float> rows(kNumPoints), cols(kNumPoints);
+    for (int i = 0; i < kNumPoints; ++i) {
+        Eigen::Vector3f point = rotation * edge_cloud.points[i].getVector3fMap();
+        float theta = acos(point.z() / point.norm());
+        float phi = atan2(point.y(), point.x());
+        rows[i] = (M_PI - theta) / kRadPerPix;
+        cols[i] = (phi + M_PI) / kRadPerPix;
+    }
+
+    for (int level = 1; level < kPyramidLevels; ++level) {
+        const int kBlock = 1 << level;
+        const int kBlockRows = (kFlatRows + kBlock - 1) / kBlock;
+        const long kBlockCols = (kFlatCols + kBlock - 1) / kBlock;
+        std::unordered_map<long, pair<int, float>> blocks; /** block index -> nearest point, squared distance **/
+        for (int i = 0; i < kNumPoints; ++i) {
+            long row = std::clamp(int(rows[i] / kBlock), 0, kBlockRows - 1);
+            long col = std::clamp(int(cols[i] / kBlock), 0, int(kBlockCols - 1));
+            float du = rows[i] - (row + 0.5f) * kBlock;
+            float dv = cols[i] - (col + 0.5f) * kBlock;
+            float dist = du * du + dv * dv;
+            auto it = blocks.emplace(row * kBlockCols + col, make_pair(i, dist)).first;
+            if (dist < it->second.second) {
+                it->second = make_pair(i, dist);
+            }
+        }
+
+        vector<int> indices;
+        indices.reserve(blocks.size());
+        for (auto &block : blocks) {
+            indices.push_back(block.second.first);
+        }
+        std::sort(indices.begin(), indices.end());
+        EdgeCloud &coarse_cloud = this->edge_pyramid_vec[spot_idx][view_idx][level - 1];
+        pcl::copyPointCloud(edge_cloud, indices, coarse_cloud);
+        if (MESSAGE_EN) {
+            ROS_INFO("Edge pyramid level %d: %ld of %d points.", level, coarse_cloud.size(), kNumPoints);
+        }
+    }
+}
+
+/** edge cloud of the current pose at a pyramid level, level 0 is the full cloud **/
+EdgeCloud &LidarProcess::edgeCloud(int level) {
+    level = std::clamp(level, 0, kPyramidLevels - 1);
+    if (level == 0) {
+        return this->edge_cloud_vec[spot_idx][view_idx];
+    }
+    return this->edge_pyramid_vec[spot_idx][view_idx][level - 1];
 }
 
 /** Point Cloud Registration **/
 Mat4F LidarProcess::alignCloud(CloudI::Ptr cloud_tgt, CloudI::Ptr cloud_src, Mat4F init_trans_mat, int cloud_type, const bool kIcpViz) {
+    TraceSpan span("lidar.alignCloud", spot_idx, view_idx);
+    span.pointsIn(cloud_tgt->size() + cloud_src->size());
     /** params **/
     float uniform_radius = 0.05;
     float normal_radius = 0.15;
@@ -345,21 +504,33 @@ Mat4F LidarProcess::alignCloud(CloudI::Ptr cloud_tgt, CloudI::Ptr cloud_src, Mat
     timer.reset();
     ROS_INFO("Normal estimation ... \n");
 
-    pcl::NormalEstimationOMP<PointI, pcl::Normal> normal_est;
-    pcl::search::KdTree<PointI>::Ptr kdtree(new pcl::search::KdTree<PointI>);
-    normal_est.setRadiusSearch(normal_radius);
-    normal_est.setSearchMethod(kdtree);
-
     CloudIN::Ptr cloud_tgt_in(new CloudIN);
     CloudN::Ptr tgt_norms(new CloudN);
-    normal_est.setInputCloud(cloud_us_tgt_effe);
-    normal_est.compute(*tgt_norms);
-    pcl::concatenateFields(*cloud_us_tgt_effe, *tgt_norms, *cloud_tgt_in);
-
     CloudIN::Ptr cloud_src_in(new CloudIN);
     CloudN::Ptr src_norms(new CloudN);
-    normal_est.setInputCloud(cloud_us_src_effe);
-    normal_est.compute(*src_norms);
+    MatricesVectorPtr tgt_covs(new MatricesVector);
+    MatricesVectorPtr src_covs(new MatricesVector);
+
+    if (kOrganizedNormals) {
+        /** both clouds are in their sensor frames, the grid is a quarter of the flat image for the sampled clouds **/
+        SphericalNormalEstimation normal_est(kFlatRows / 4, kFlatCols / 4);
+        normal_est.setRadius(normal_radius);
+        normal_est.setInputCloud(cloud_us_tgt_effe);
+        normal_est.compute(*tgt_norms, tgt_covs.get());
+        normal_est.setInputCloud(cloud_us_src_effe);
+        normal_est.compute(*src_norms, src_covs.get());
+    }
+    else {
+        pcl::NormalEstimationOMP<PointI, pcl::Normal> normal_est;
+        pcl::search::KdTree<PointI>::Ptr kdtree(new pcl::search::KdTree<PointI>);
+        normal_est.setRadiusSearch(normal_radius);
+        normal_est.setSearchMethod(kdtree);
+        normal_est.setInputCloud(cloud_us_tgt_effe);
+        normal_est.compute(*tgt_norms);
+        normal_est.setInputCloud(cloud_us_src_effe);
+        normal_est.compute(*src_norms);
+    }
+    pcl::concatenateFields(*cloud_us_tgt_effe, *tgt_norms, *cloud_tgt_in);
     pcl::concatenateFields(*cloud_us_src_effe, *src_norms, *cloud_src_in);
     ROS_INFO("Run time: %f s\n", timer.getTimeSeconds());
     
@@ -374,6 +545,11 @@ Mat4F LidarProcess::alignCloud(CloudI::Ptr cloud_tgt, CloudI::Ptr cloud_src, Mat
     align.setMaxCorrespondenceDistance(max_corr_dis);
     align.setEuclideanFitnessEpsilon(eucidean_epsilon);
     align.setRotationEpsilon(eucidean_epsilon);
+    if (kOrganizedNormals) {
+        /** skips the k-nearest covariance search of gicp **/
+        align.setSourceCovariances(src_covs);
+        align.setTargetCovariances(tgt_covs);
+    }
     align.align(*cloud_icp_trans_n, init_trans_mat);
     pcl::copyPointCloud(*cloud_icp_trans_n, *cloud_icp_trans_us);
 
@@ -391,11 +567,27 @@ Mat4F LidarProcess::alignCloud(CloudI::Ptr cloud_tgt, CloudI::Ptr cloud_src, Mat
     return align_trans_mat;
 }
 
-void LidarProcess::getEdgeDistance(EdgeCloud::Ptr cloud_tgt, EdgeCloud::Ptr cloud_src, float max_range) {
-    pcl::StopWatch timer_fs;
-    vector<float> dists;
+/** mean of the smallest distances, the largest outlier_percentage are left out **/
+static float trimmedMeanDistance(vector<float> &dists, float outlier_percentage) {
     int valid_cnt = 0;
     float avg_dist = 0;
+    if (dists.size() * outlier_percentage > 1) {
+        sort(dists.data(), dists.data()+dists.size());
+        for (size_t i = 0; i < dists.size() * (1-outlier_percentage); i++) {
+            avg_dist += dists[i];
+            ++valid_cnt;
+        }
+        if (valid_cnt > 0) {
+            avg_dist /= valid_cnt;
+            ROS_INFO("Average projection error: %f", avg_dist);
+        } 
+    }
+    return avg_dist;
+}
+
+float LidarProcess::getEdgeDistance(EdgeCloud::Ptr cloud_tgt, EdgeCloud::Ptr cloud_src, float max_range) {
+    pcl::StopWatch timer_fs;
+    vector<float> dists;
     float outlier_percentage = 0.1;
 
     std::vector<int> nn_indices(1);
@@ -408,31 +600,52 @@ void LidarProcess::getEdgeDistance(EdgeCloud::Ptr cloud_tgt, EdgeCloud::Ptr clou
 
     for (auto &pt : cloud_src->points) {
         kdtree.nearestKSearch(pt, 1, nn_indices, nn_dists);
-        if (nn_dists[0] <= max_range) {
-            dists.push_back(nn_dists[0]);
+        /** flann returns squared distances **/
+        float dist = sqrt(nn_dists[0]);
+        if (dist <= max_range) {
+            dists.push_back(dist);
         }
     }
 
-    if (dists.size() * outlier_percentage > 1) {
-        sort(dists.data(), dists.data()+dists.size());
-        for (size_t i = 0; i < dists.size() * (1-outlier_percentage); i++) {
-            avg_dist += dists[i];
-            ++valid_cnt;
+    return trimmedMeanDistance(dists, outlier_percentage);
+}
+
+/** O(1) lookup per point in a distance image of the target edges, see OmniProcess::DistanceImage **/
+float LidarProcess::getEdgeDistance(const cv::Mat &dist_img, EdgeCloud::Ptr cloud_src, float max_range) {
+    vector<float> dists;
+    float outlier_percentage = 0.1;
+
+    for (auto &pt : cloud_src->points) {
+        int u = (int)round(pt.x);
+        int v = (int)round(pt.y);
+        if (u < 0 || u >= dist_img.rows || v < 0 || v >= dist_img.cols) {
+            continue;
+        }
+        float dist = dist_img.at<float>(u, v);
+        if (dist <= max_range) {
+            dists.push_back(dist);
         }
-        if (valid_cnt > 0) {
-            avg_dist /= valid_cnt;
-            ROS_INFO("Average projection error: %f", avg_dist);
-        } 
     }
 
+    return trimmedMeanDistance(dists, outlier_percentage);
 }
 
 void LidarProcess::generateViewCloud() {
+    TraceSpan span("lidar.generateViewCloud", spot_idx, view_idx);
     if (MESSAGE_EN) {
         ROS_INFO("----------------- generate view cloud ---------------------");
     }
     /** bag to pcd **/
     string pcd_path = file_path_vec[spot_idx][view_idx].view_cloud_path;
+#ifdef CALIB_HEADLESS
+    /** no bag reader without ros, a view cloud written elsewhere (e.g. by synthetic_dataset) is used as it is **/
+    /** a missing input, not an assertion, so NDEBUG builds stop here as well **/
+    if (fileBytes(pcd_path) <= 0) {
+        ROS_ERROR("View bags are read by the ROS build only, %s is missing.", pcd_path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    ROS_INFO("Headless build, using the existing view cloud %s", pcd_path.c_str());
+#else
     string bag_path = file_path_vec[spot_idx][view_idx].bag_folder_path 
                     + "/" + dataset_name + "_spot" + to_string(spot_idx) 
                     + "_" + to_string(view_angle_init + view_angle_step * view_idx)
@@ -451,7 +664,7 @@ void LidarProcess::generateViewCloud() {
     while (iterator != view.end()) {
         iterator++;
         cnt_pcds++;
-        ROS_ASSERT_MSG((cnt_pcds > 3.6e4), "More than 36000 pcds in a bag, aborted.");
+        ROS_ASSERT_MSG((cnt_pcds <= 3.6e4), "More than 36000 pcds in a bag, aborted.");
     }
 
     uint32_t num_pcds = (float)cnt_pcds * ((float)95 / 100);
@@ -459,6 +672,14 @@ void LidarProcess::generateViewCloud() {
     uint32_t idx_end = idx_start + num_pcds;
     iterator = view.begin();
 
+    /** coverage on the flat image grid, with the sphereToPlane rotation and the edge extraction mask **/
+    Ext_D extrinsic_vec;
+    extrinsic_vec << ext_.head(3), 0, 0, 0;
+    Mat3F rotation = transformMat(extrinsic_vec).topLeftCorner(3, 3).cast<float>();
+    cv::Mat mask = cv::imread(kPkgPath + "/python_scripts/image_process/flat_lidar_image_mask.png", cv::IMREAD_GRAYSCALE);
+    CoverageMonitor monitor(kFlatRows, kFlatCols, rotation, mask);
+    int saturated_idx = -1;
+
     for (uint32_t i = 0; iterator != view.end(); iterator++, i++) {
         if (i >= idx_start && i < idx_end) {
             auto m = *iterator;
@@ -466,11 +687,25 @@ void LidarProcess::generateViewCloud() {
             pcl_conversions::toPCL(*input, pcl_pc2);
             pcl::fromPCLPointCloud2(pcl_pc2, *bag_cloud);
             *view_cloud += *bag_cloud;
+            span.bytesRead(m.size());
+            span.pointsIn(bag_cloud->size());
+
+            monitor.addCloud(*bag_cloud);
+            if (saturated_idx < 0 && monitor.saturated(kTargetCoverage, kCoverageWindow, kMinCoverageGain)) {
+                saturated_idx = i - idx_start + 1;
+                if (MESSAGE_EN) {
+                    ROS_INFO("Coverage %f saturated after %d of %d messages, capture can stop.", monitor.coverage(), saturated_idx, num_pcds);
+                }
+                if (kAdaptiveIntegration) {
+                    break;
+                }
+            }
         }
     }
+    monitor.saveCurve(file_path_vec[spot_idx][view_idx].coverage_curve_path);
 
     if (MESSAGE_EN){
-        ROS_INFO("Loaded %ld points at viewpoint #%d, view#%d", view_cloud->size(), spot_idx, view_idx);   
+        ROS_INFO("Loaded %ld points at viewpoint #%d, view#%d, coverage %f", view_cloud->size(), spot_idx, view_idx, monitor.coverage());
     }
 
     /** range filter **/
@@ -486,13 +721,130 @@ void LidarProcess::generateViewCloud() {
     /** invalid point filter **/
     removeInvalidPoints(view_cloud);
     pcl::io::savePCDFileBinary(pcd_path, *view_cloud);
+    traceFileWritten(pcd_path);
+    span.pointsOut(view_cloud->size());
 
     if (MESSAGE_EN){
         ROS_INFO("Saved %ld points at viewpoint #%d, view#%d", view_cloud->size(), spot_idx, view_idx);   
     }
+#endif
+}
+
+/** uniformly sampled copy for the view registration, the range effective filter of alignCloud is optional **/
+CloudI::Ptr LidarProcess::sampleViewCloud(CloudI::Ptr cloud, float uniform_radius, bool range_filter) {
+    const float squared_range_limit = pow(10, 2);
+    CloudI::Ptr cloud_us(new CloudI);
+    pcl::UniformSampling<PointI> us;
+    us.setRadiusSearch(uniform_radius);
+    us.setInputCloud(cloud);
+    us.filter(*cloud_us);
+    removeInvalidPoints(cloud_us);
+
+    if (range_filter) {
+        vector<int> indices;
+        for (int idx = 0; idx < cloud_us->size(); ++idx) {
+            auto &pt = cloud_us->points[idx];
+            if (pt.getVector3fMap().squaredNorm() < squared_range_limit && pt.z > -1) {
+                indices.push_back(idx);
+            }
+        }
+        pcl::copyPointCloud(*cloud_us, indices, *cloud_us);
+    }
+    return cloud_us;
+}
+
+/** point-to-plane icp with projective association, for views sharing the gimbal center **/
+Mat4F LidarProcess::alignProjective(CloudI::Ptr cloud_tgt, CloudI::Ptr cloud_src, Mat4F init_trans_mat) {
+    TraceSpan span("lidar.alignProjective", spot_idx, view_idx);
+    const float uniform_radius = 0.05;
+    pcl::StopWatch timer;
+    CloudI::Ptr cloud_us_tgt = sampleViewCloud(cloud_tgt, uniform_radius, false);
+    CloudI::Ptr cloud_us_src = sampleViewCloud(cloud_src, uniform_radius, true);
+
+    /** quarter resolution of the flat image, about one sampled point per cell at a few meters **/
+    ProjectiveIcp icp(kFlatRows / 4, kFlatCols / 4);
+    icp.setMaxIterations(100);
+    icp.setMaxCorrespondenceDistance(0.2);
+    icp.setNormalRadius(uniform_radius * 3);
+    icp.setInputTarget(cloud_us_tgt);
+    Mat4F align_trans_mat;
+    bool converged = icp.align(*cloud_us_src, init_trans_mat, align_trans_mat);
+
+    if (MESSAGE_EN) {
+        ROS_INFO("Projective ICP: %s in %d iterations, %f s, %d correspondences, fitness score: %f",
+                 converged ? "converged" : "failed", icp.getIterations(), timer.getTimeSeconds(),
+                 icp.getCorrespondences(), icp.getFitnessScore());
+        cout << align_trans_mat << endl;
+    }
+    return converged ? align_trans_mat : init_trans_mat;
+}
+
+/**
+ * View registration of several spots at once, constrained to the gimbal kinematics (see GimbalRegistration).
+ * Views whose constrained fit stays poor get a 6-DoF projective refinement from the constrained pose.
+ **/
+void LidarProcess::stitchGimbalViews(vector<int> spot_vec) {
+    TraceSpan span("lidar.stitchGimbalViews");
+    if (MESSAGE_EN) {
+        ROS_INFO("----------------- stitch gimbal views ---------------------");
+    }
+    const float uniform_radius = 0.05;
+    pcl::StopWatch timer;
+    GimbalRegistration gimbal(kGimbalRadius);
+    vector<CloudI::Ptr> targets;
+    vector<Pair> view_keys; /** (spot, view) of each registration view **/
+
+    for (int spot : spot_vec) {
+        CloudI::Ptr view_cloud_tgt(new CloudI);
+        loadPcd(file_path_vec[spot][center_view_idx].view_cloud_path, *view_cloud_tgt, "target view");
+        targets.push_back(view_cloud_tgt);
+        int target_idx = gimbal.addTarget(sampleViewCloud(view_cloud_tgt, uniform_radius, false), kFlatRows / 4, kFlatCols / 4);
+        for (int view = 0; view < num_views; ++view) {
+            if (view == center_view_idx) {
+                continue;
+            }
+            CloudI::Ptr view_cloud_src(new CloudI);
+            loadPcd(file_path_vec[spot][view].view_cloud_path, *view_cloud_src, "source view");
+            gimbal.addView(target_idx, sampleViewCloud(view_cloud_src, uniform_radius, true), DEG2RAD(degree_map[view]));
+            view_keys.push_back({spot, view});
+        }
+    }
+    {
+        TraceSpan solve_span("gimbal.solve");
+        gimbal.solve();
+    }
+    if (MESSAGE_EN) {
+        ROS_INFO("Gimbal fit of %ld views in %f s, pivot: (%f, %f, %f), axis tilt: (%f, %f)",
+                 view_keys.size(), timer.getTimeSeconds(), gimbal.pivot()(0), gimbal.pivot()(1), gimbal.pivot()(2),
+                 gimbal.tilt()(0), gimbal.tilt()(1));
+    }
+
+    for (int i = 0; i < view_keys.size(); ++i) {
+        const int spot = view_keys[i].first;
+        const int view = view_keys[i].second;
+        Mat4F align_trans_mat = gimbal.transform(i);
+        const bool kPoorFit = gimbal.residual(i) > kGimbalMaxRms || gimbal.inlierRatio(i) < kGimbalMinInliers;
+        if (MESSAGE_EN) {
+            ROS_INFO("Spot %d view %d: pitch error %f deg, rms %f m, inliers %f%s", spot, view,
+                     RAD2DEG(gimbal.pitchError(i)), gimbal.residual(i), gimbal.inlierRatio(i),
+                     kPoorFit ? ", 6-DoF refinement" : "");
+        }
+        if (kPoorFit) {
+            CloudI::Ptr view_cloud_src(new CloudI);
+            loadPcd(file_path_vec[spot][view].view_cloud_path, *view_cloud_src, "source view");
+            int target_idx = std::find(spot_vec.begin(), spot_vec.end(), spot) - spot_vec.begin();
+            align_trans_mat = alignProjective(targets[target_idx], view_cloud_src, align_trans_mat);
+        }
+
+        std::ofstream mat_out;
+        mat_out.open(file_path_vec[spot][view].pose_trans_mat_path);
+        mat_out << align_trans_mat << endl;
+        mat_out.close();
+    }
 }
 
 void LidarProcess::stitchViewCloud() {
+    TraceSpan span("lidar.stitchViewCloud", spot_idx, view_idx);
     if (MESSAGE_EN) {
         ROS_INFO("----------------- stitch view cloud ---------------------");
     }
@@ -502,10 +854,11 @@ void LidarProcess::stitchViewCloud() {
     CloudI::Ptr view_cloud_src(new CloudI);
     loadPcd(tgt_pcd_path, *view_cloud_tgt, "target view");
     loadPcd(src_pcd_path, *view_cloud_src, "source view");
+    span.pointsIn(view_cloud_tgt->size() + view_cloud_src->size());
 
     /** initial rigid transformation **/
     float v_angle = (float)DEG2RAD(degree_map[view_idx]);
-    float gimbal_radius = 0.15f;
+    float gimbal_radius = kGimbalRadius;
     Ext_F trans_params;
     trans_params << 0.0f, v_angle, 0.0f,
                     gimbal_radius * (sin(v_angle) - 0.0f), 0.0f, gimbal_radius * (cos(v_angle) - 1.0f); /** LiDAR x-axis: car front; Gimbal positive angle: car front **/
@@ -513,7 +866,38 @@ void LidarProcess::stitchViewCloud() {
     Mat4F align_trans_mat = init_trans_mat;
 
     /** ICP **/
-    align_trans_mat = alignCloud(view_cloud_tgt, view_cloud_src, init_trans_mat, 0, false);
+    pcl::StopWatch timer;
+    if (kProjectiveIcp || kIcpCompare) {
+        timer.reset();
+        align_trans_mat = alignProjective(view_cloud_tgt, view_cloud_src, init_trans_mat);
+        double projective_time = timer.getTimeSeconds();
+        if (kIcpCompare) {
+            timer.reset();
+            Mat4F gicp_trans_mat = alignCloud(view_cloud_tgt, view_cloud_src, init_trans_mat, 0, false);
+            double gicp_time = timer.getTimeSeconds();
+            Mat4F diff_mat = gicp_trans_mat.inverse() * align_trans_mat;
+            float angle_diff = Eigen::AngleAxisf(Mat3F(diff_mat.topLeftCorner(3, 3))).angle();
+            ROS_INFO("View %d registration, projective: %f s, gicp: %f s, difference: %f deg, %f m",
+                     view_idx, projective_time, gicp_time, RAD2DEG(angle_diff), diff_mat.topRightCorner(3, 1).norm());
+            /** kept across runs, one row per view **/
+            CheckFolder(kDatasetPath + "/log");
+            string compare_path = kDatasetPath + "/log/icp_compare.csv";
+            const bool new_file = !std::ifstream(compare_path).good();
+            std::ofstream compare_out(compare_path, ios::app);
+            if (new_file) {
+                compare_out << "dataset,spot,view,source_points,target_points,projective_s,gicp_s,rotation_diff_deg,translation_diff_m\n";
+            }
+            compare_out << dataset_name << "," << spot_idx << "," << view_idx << "," << view_cloud_src->size() << ","
+                        << view_cloud_tgt->size() << "," << projective_time << "," << gicp_time << ","
+                        << RAD2DEG(angle_diff) << "," << diff_mat.topRightCorner(3, 1).norm() << "\n";
+            if (!kProjectiveIcp) {
+                align_trans_mat = gicp_trans_mat;
+            }
+        }
+    }
+    else {
+        align_trans_mat = alignCloud(view_cloud_tgt, view_cloud_src, init_trans_mat, 0, false);
+    }
     CloudI::Ptr view_cloud_icp_trans(new CloudI);
     pcl::transformPointCloud(*view_cloud_src, *view_cloud_icp_trans, align_trans_mat);
 
@@ -532,6 +916,7 @@ void LidarProcess::stitchViewCloud() {
 }
 
 void LidarProcess::generateSpotCloud() {
+    TraceSpan span("lidar.generateSpotCloud", spot_idx);
     if (MESSAGE_EN) {
         ROS_INFO("----------------- generate spot cloud ---------------------");
     }
@@ -554,6 +939,7 @@ void LidarProcess::generateSpotCloud() {
         }
         *spot_cloud = *spot_cloud + *view_cloud;
     }
+    span.pointsIn(spot_cloud->size());
 
     /** radius outlier filter **/
     pcl::RadiusOutlierRemoval<PointI> radius_outlier_filter;
@@ -565,12 +951,15 @@ void LidarProcess::generateSpotCloud() {
     radius_outlier_filter.filter(*spot_cloud);
 
     pcl::io::savePCDFileBinary(spot_cloud_path, *spot_cloud);
+    traceFileWritten(spot_cloud_path);
+    span.pointsOut(spot_cloud->size());
     if (MESSAGE_EN){
         ROS_INFO("Saved %ld points at viewpoint #%d.", spot_cloud->size(), spot_idx);   
     }
 }
 
 void LidarProcess::stitchSpotCloud() {
+    TraceSpan span("lidar.stitchSpotCloud", spot_idx);
     if (MESSAGE_EN) {
         ROS_INFO("----------------- stitch spot cloud ---------------------");
     }
@@ -587,6 +976,7 @@ void LidarProcess::stitchSpotCloud() {
     string spot_cloud_src_path = file_path_vec[src_idx][0].spot_cloud_path;
     loadPcd(spot_cloud_tgt_path, *spot_cloud_tgt, "target spot");
     loadPcd(spot_cloud_src_path, *spot_cloud_src, "source spot");
+    span.pointsIn(spot_cloud_tgt->size() + spot_cloud_src->size());
 
     /** initial transformation and initial score **/
     string lio_trans_path = file_path_vec[src_idx][0].lio_spot_trans_mat_path;
@@ -649,6 +1039,7 @@ void LidarProcess::stitchFineToCoarse() {
 }
 
 void LidarProcess::generateColoredFineMap(bool kGlobalUniformSampling) {
+    TraceSpan span("lidar.generateColoredFineMap");
     if (MESSAGE_EN) {
         ROS_INFO("----------------- generate colored fine map ---------------------");
     }
@@ -694,9 +1085,12 @@ void LidarProcess::generateColoredFineMap(bool kGlobalUniformSampling) {
     string rgb_fine_map_path = file_path_vec[0][0].recon_folder_path +
                                           "/rgb_fine_map.pcd";
     pcl::io::savePCDFileBinary(rgb_fine_map_path, *rgb_fine_map);
+    traceFileWritten(rgb_fine_map_path);
+    span.pointsOut(rgb_fine_map->size());
 }
 
 void LidarProcess::generateFineMap(bool kGlobalUniformSampling) {
+    TraceSpan span("lidar.generateFineMap");
     if (MESSAGE_EN) {
         ROS_INFO("----------------- generate fine map ---------------------");
     }
@@ -757,21 +1151,24 @@ void LidarProcess::generateFineMap(bool kGlobalUniformSampling) {
     string fine_map_path = file_path_vec[0][0].recon_folder_path +
                                           "/fine_map.pcd";
     pcl::io::savePCDFileBinary(fine_map_path, *fine_map);
+    traceFileWritten(fine_map_path);
+    span.pointsOut(fine_map->size());
 }
 
 double LidarProcess::getFitnessScore(CloudI::Ptr cloud_tgt, CloudI::Ptr cloud_src, float max_range) {
     double fitness_score = 0.0;
-    std::vector<int> nn_indices(1);
-    std::vector<float> nn_dists(1);
     // For each point in the source dataset
     int nr = 0;
     pcl::KdTreeFLANN<PointI> kdtree;
     kdtree.setInputCloud(cloud_tgt);
+    const int num_points = cloud_src->points.size();
 
-    #pragma omp parallel for num_threads(THREADS)
-    for (auto &pt : cloud_src->points) {
+    #pragma omp parallel for num_threads(THREADS) reduction(+:fitness_score, nr)
+    for (int i = 0; i < num_points; ++i) {
+        std::vector<int> nn_indices(1);
+        std::vector<float> nn_dists(1);
         // Find its nearest neighbor in the target
-        kdtree.nearestKSearch(pt, 1, nn_indices, nn_dists);
+        kdtree.nearestKSearch(cloud_src->points[i], 1, nn_indices, nn_dists);
         // Deal with occlusions (incomplete targets)
         if (nn_dists[0] <= max_range) {
             // Add to the fitness score
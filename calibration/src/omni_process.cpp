@@ -1,6 +1,9 @@
 /** headings **/
 #include <omni_process.h>
 #include <common_lib.h>
+#ifndef CALIB_HEADLESS
+#include <ros_params.h>
+#endif
 
 /** namespace **/
 using namespace std;
@@ -11,15 +14,49 @@ using namespace mlpack::tree;
 using namespace mlpack::kernel;
 using namespace arma;
 
-OmniProcess::OmniProcess() {
-    /** parameter server **/
-    ros::param::get("essential/kDatasetName", this->dataset_name);
-    ros::param::get("essential/kNumSpots", this->num_spots);
-    ros::param::get("essential/kNumViews", this->num_views);
-    ros::param::get("essential/kImageRows", this->kImageSize.first);
-    ros::param::get("essential/kImageCols", this->kImageSize.second);
-    ros::param::get("essential/kAngleInit", this->view_angle_init);
-    ros::param::get("essential/kAngleStep", this->view_angle_step);
+#ifndef CALIB_HEADLESS
+OmniProcess::OmniProcess() : OmniProcess(paramServerConfig()) {}
+
+OmniProcess::Config OmniProcess::paramServerConfig() {
+    return loadConfig(RosParams(), ros::package::getPath("calibration"));
+}
+#endif
+
+OmniProcess::Config OmniProcess::loadConfig(const ParamSource &params, const string &pkg_path) {
+    Config config;
+    config.pkg_path = pkg_path;
+    params.get("essential/kDatasetName", config.dataset_name);
+    params.get("essential/kNumSpots", config.num_spots);
+    params.get("essential/kNumViews", config.num_views);
+    params.get("essential/kImageRows", config.image_size.first);
+    params.get("essential/kImageCols", config.image_size.second);
+    params.get("essential/kAngleInit", config.view_angle_init);
+    params.get("essential/kAngleStep", config.view_angle_step);
+    params.get("colorization/kDepthCell", config.depth_cell);
+    params.get("colorization/kDepthTolerance", config.depth_tolerance);
+    params.get("switch/kNativeEdge", config.native_edge);
+    params.get("switch/kEdgeCompare", config.edge_compare);
+    params.get("essential/kImageCacheMB", config.image_cache_mb);
+    params.get("essential/kCameraSerial", config.camera_serial);
+    return config;
+}
+
+OmniProcess::OmniProcess(const Config &config) {
+    this->kPkgPath = config.pkg_path;
+    this->dataset_name = config.dataset_name;
+    this->num_spots = config.num_spots;
+    this->num_views = config.num_views;
+    this->kImageSize = config.image_size;
+    this->view_angle_init = config.view_angle_init;
+    this->view_angle_step = config.view_angle_step;
+    this->kDepthCell = config.depth_cell;
+    this->kDepthTolerance = config.depth_tolerance;
+    this->kNativeEdge = config.native_edge;
+    this->kEdgeCompare = config.edge_compare;
+    /** rigs never share a response function by accident **/
+    this->kCameraSerial = config.camera_serial.empty() ? "dataset_" + config.dataset_name : config.camera_serial;
+    this->image_cache.reset(new ImageCache(size_t(config.image_cache_mb) << 20));
+    this->exposure_fusion.reset(new ExposureFusion(this->kPkgPath + "/data"));
     this->kDatasetPath = this->kPkgPath + "/data/" + this->dataset_name;
     this->fullview_idx = (this->num_views - 1) / 2;
 
@@ -48,27 +85,65 @@ void OmniProcess::ReadEdge() {
     loadPcd(edge_cloud_path, this->edge_cloud_vec[spot_idx][view_idx], "camera edge");
 }
 
+/** writable copy of the cached image of the current view, empty if it can not be read **/
 cv::Mat OmniProcess::loadImage(bool output) {
-    PoseFilePath &path_vec = this->file_path_vec[spot_idx][view_idx];
-    string img_path = path_vec.hdr_img_path;
-    cv::Mat image = cv::imread(img_path, cv::IMREAD_UNCHANGED);
-    ROS_ASSERT_MSG((image.rows != 0 || image.cols != 0),
-                   "Invalid size (%d, %d) from file: %s", image.rows, image.cols, img_path);
-    ROS_ASSERT_MSG((!MESSAGE_EN),
-                    "Loaded image from file: %s", img_path)
-    if (output) {
-        string output_img_path = path_vec.flat_img_path;
+    cv::Mat image = getImage()->clone();
+    if (output && !image.empty()) {
+        string output_img_path = this->file_path_vec[spot_idx][view_idx].flat_img_path;
         cv::imwrite(output_img_path, image);
     }
     return image;
 }
 
+/** shared read-only image of the current view, decoded once per file version; an empty matrix, never null, on failure **/
+ImageCache::ImagePtr OmniProcess::getImage() {
+    TraceSpan span("omni.getImage", spot_idx, view_idx);
+    string img_path = this->file_path_vec[spot_idx][view_idx].hdr_img_path;
+    ImageCache::ImagePtr image = this->image_cache->get(img_path);
+    /** checked at run time, the assertions are compiled out in release builds **/
+    if (image == nullptr) {
+        ROS_ERROR("Invalid image file: %s", img_path.c_str());
+        return ImageCache::ImagePtr(new cv::Mat());
+    }
+    if (MESSAGE_EN) {
+        ROS_INFO("Loaded image from file: %s", img_path.c_str());
+    }
+    return image;
+}
+
+/** decode another view of the current spot in the background **/
+void OmniProcess::prefetchImage(int view_idx) {
+    if (view_idx >= 0 && view_idx < this->num_views) {
+        this->image_cache->prefetch(this->file_path_vec[spot_idx][view_idx].hdr_img_path);
+    }
+}
+
+/** replaces python_scripts/auto_run/exposure_fusion.py, grab_0.bmp is still written for the scripts **/
+void OmniProcess::fuseExposures() {
+    TraceSpan span("omni.fuseExposures", spot_idx, view_idx);
+    string img_path = this->file_path_vec[spot_idx][view_idx].hdr_img_path;
+    string image_folder = img_path.substr(0, img_path.find_last_of('/'));
+    pcl::StopWatch timer;
+    cv::Mat fused = this->exposure_fusion->fuse(image_folder, this->kCameraSerial);
+    ROS_ASSERT_MSG(!fused.empty(), "Exposure fusion failed in %s", image_folder.c_str());
+    cv::imwrite(img_path, fused);
+    traceFileWritten(img_path);
+    /** the cached copy carries the new file time, later getImage() calls skip the decode **/
+    this->image_cache->put(img_path, fused);
+    if (MESSAGE_EN) {
+        ROS_INFO("Exposure fusion of %s: %f s", image_folder.c_str(), timer.getTimeSeconds());
+    }
+}
 
 void OmniProcess::generateEdgeCloud() {
+    TraceSpan span("omni.generateEdgeCloud", spot_idx, view_idx);
     string edge_img_path = file_path_vec[spot_idx][view_idx].edge_img_path;
-    cv::Mat edge_img = cv::imread(edge_img_path, cv::IMREAD_UNCHANGED);
-    ROS_ASSERT_MSG((image.rows != 0 || image.cols != 0),
-                   "Invalid size (%d, %d) from file: %s", image.rows, image.cols, edge_img_path);
+    cv::Mat edge_img = (this->edge_img_pose == std::make_pair(spot_idx, view_idx)) ?
+                       this->edge_img : cv::imread(edge_img_path, cv::IMREAD_UNCHANGED);
+    this->edge_img.release();
+    this->edge_img_pose = {-1, -1};
+    ROS_ASSERT_MSG((edge_img.rows != 0 || edge_img.cols != 0),
+                   "Invalid size (%d, %d) from file: %s", edge_img.rows, edge_img.cols, edge_img_path.c_str());
     
     EdgeCloud::Ptr edge_cloud(new EdgeCloud);
 
@@ -84,12 +159,15 @@ void OmniProcess::generateEdgeCloud() {
         }
     }
     this->edge_cloud_vec[spot_idx][view_idx] = *edge_cloud;
+    span.pointsOut(edge_cloud->size());
     string edge_cloud_path = file_path_vec[spot_idx][view_idx].edge_cloud_path;
     pcl::io::savePCDFileBinary(edge_cloud_path, *edge_cloud);
+    traceFileWritten(edge_cloud_path);
 }
 
 vector<double> OmniProcess::Kde(double bandwidth, double scale) {
-    clock_t start_time = clock();
+    TraceSpan span("omni.Kde", spot_idx, view_idx);
+    pcl::StopWatch timer; /** wall time, the evaluation runs on several threads **/
     const double default_rel_error = 0.05;
     const int n_rows = scale * this->kImageSize.first;
     const int n_cols = scale * this->kImageSize.second;
@@ -97,20 +175,19 @@ vector<double> OmniProcess::Kde(double bandwidth, double scale) {
     // number of rows equal to number of dimensions, query.n_rows == reference.n_rows is required
     EdgeCloud &fisheye_edge = this->edge_cloud_vec[this->spot_idx][this->view_idx];
     const int ref_size = fisheye_edge.size();
+    span.pointsIn(ref_size);
     arma::mat reference(2, ref_size);
     for (int i = 0; i < ref_size; ++i) {
         reference(0, i) = fisheye_edge.points[i].x;
         reference(1, i) = fisheye_edge.points[i].y;
     }
 
+    /** grid cell (i, j) samples the full resolution pixel (i / scale, j / scale), as DensityMap::Evaluate expects **/
     query = arma::mat(2, n_cols * n_rows);
-    arma::vec rows = arma::linspace(0, this->kImageSize.first - 1, n_rows);
-    arma::vec cols = arma::linspace(0, this->kImageSize.second - 1, n_cols);
-
     for (int i = 0; i < n_rows; ++i) {
         for (int j = 0; j < n_cols; ++j) {
-            query(0, i * n_cols + j) = rows.at(i);
-            query(1, i * n_cols + j) = cols.at(j);
+            query(0, i * n_cols + j) = i / scale;
+            query(1, i * n_cols + j) = j / scale;
         }
     }
 
@@ -122,6 +199,7 @@ vector<double> OmniProcess::Kde(double bandwidth, double scale) {
     kde.Evaluate(query, kde_estimations);
 
     std::vector<double> img = arma::conv_to<std::vector<double>>::from(kde_estimations);
+    span.pointsOut(img.size());
 
     if (EXTRA_FILE_EN) {
         /** kde prediction output **/
@@ -140,17 +218,88 @@ vector<double> OmniProcess::Kde(double bandwidth, double scale) {
             }
         }
         outfile.close();
+        traceFileWritten(kde_txt_path);
     }
     if (MESSAGE_EN) {
-        ROS_INFO("kde image generated in %f s.\n bandwidth = %f, size = (%d, %d)", ((float)(clock() - start_time) / CLOCKS_PER_SEC), bandwidth, n_rows, n_cols);
+        ROS_INFO("kde image generated in %f s.\n bandwidth = %f, size = (%d, %d)", timer.getTimeSeconds(), bandwidth, n_rows, n_cols);
+    }
+    return img;
+}
+
+/** exact euclidean distance (in full resolution pixels) from each grid cell to the nearest fisheye edge pixel **/
+cv::Mat OmniProcess::DistanceImage(double scale) {
+    const int n_rows = scale * this->kImageSize.first;
+    const int n_cols = scale * this->kImageSize.second;
+    EdgeCloud &fisheye_edge = this->edge_cloud_vec[this->spot_idx][this->view_idx];
+
+    cv::Mat edge_mask(n_rows, n_cols, CV_8UC1, cv::Scalar(255));
+    for (auto &point : fisheye_edge.points) {
+        int u = std::clamp((int)round(point.x * scale), 0, n_rows - 1);
+        int v = std::clamp((int)round(point.y * scale), 0, n_cols - 1);
+        edge_mask.at<uchar>(u, v) = 0;
+    }
+
+    cv::Mat dist_img;
+    cv::distanceTransform(edge_mask, dist_img, cv::DIST_L2, cv::DIST_MASK_PRECISE);
+    if (scale != 1) {
+        dist_img /= scale;
+    }
+    return dist_img;
+}
+
+/** truncated distance transform laid out like the kde image, the edges hold the maximum value **/
+vector<double> OmniProcess::DistanceMap(double truncation, double scale) {
+    TraceSpan span("omni.DistanceMap", spot_idx, view_idx);
+    span.pointsIn(this->edge_cloud_vec[spot_idx][view_idx].size());
+    pcl::StopWatch timer;
+    cv::Mat dist_img = DistanceImage(scale);
+    std::vector<double> img(dist_img.total());
+    for (int i = 0; i < dist_img.rows; ++i) {
+        const float *row = dist_img.ptr<float>(i);
+        for (int j = 0; j < dist_img.cols; ++j) {
+            img[i * dist_img.cols + j] = truncation - std::min<double>(row[j], truncation);
+        }
+    }
+    if (MESSAGE_EN) {
+        ROS_INFO("distance map generated in %f s.\n truncation = %f, size = (%d, %d)", timer.getTimeSeconds(), truncation, dist_img.rows, dist_img.cols);
     }
     return img;
 }
 
 void OmniProcess::edgeExtraction() {
+    TraceSpan span("omni.edgeExtraction", spot_idx, view_idx);
     string script_path = this->kPkgPath + "/python_scripts/image_process/edge_extraction.py";
-    string kSpots = to_string(this->spot_idx);
-    string cmd_str = "python3 " 
-        + script_path + " " + this->kDatasetPath + " " + "omni" + " " + kSpots;
-    int status = system(cmd_str.c_str());
+    pcl::StopWatch timer;
+    double native_time = 0;
+
+    if (kNativeEdge || kEdgeCompare) {
+        string mask_path = this->kPkgPath + "/python_scripts/image_process/flat_image_mask.png";
+        cv::Mat mask = cv::imread(mask_path, cv::IMREAD_GRAYSCALE);
+        ImageCache::ImagePtr image = getImage();
+        if (image->empty()) {
+            ROS_ERROR("No image of spot %d view %d, edge extraction skipped.", spot_idx, view_idx);
+            return;
+        }
+        this->edge_img = omniEdgeImage(*image, mask);
+        native_time = timer.getTimeSeconds();
+        /** written for the runs that start from generateEdgeCloud, the in-memory copy saves the read back **/
+        cv::imwrite(file_path_vec[spot_idx][view_idx].edge_img_path, this->edge_img);
+    }
+
+    if (!kNativeEdge || kEdgeCompare) {
+        string kSpots = to_string(this->spot_idx);
+        string cmd_str = "python3 " 
+            + script_path + " " + this->kDatasetPath + " " + "omni" + " " + kSpots;
+        timer.reset();
+        int status = system(cmd_str.c_str());
+        double script_time = timer.getTimeSeconds();
+        cv::Mat script_edges = cv::imread(file_path_vec[spot_idx][view_idx].edge_img_path, cv::IMREAD_GRAYSCALE);
+        if (kEdgeCompare) {
+            compareEdgeImages(this->edge_img, script_edges, native_time, script_time, "Camera");
+        }
+        if (!kNativeEdge) {
+            this->edge_img = script_edges;
+        }
+    }
+    this->edge_img_pose = {spot_idx, view_idx};
 }
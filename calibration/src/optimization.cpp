@@ -2,7 +2,12 @@
 #include <optimization.h>
 #include <common_lib.h>
 
-ofstream outfile;
+const std::vector<const char*> kParamNames = {
+        "rx", "ry", "rz",
+        "tx", "ty", "tz",
+        "u0", "v0",
+        "a0", "a1", "a2", "a3", "a4",
+        "c", "d", "e"};
 
 struct QuaternionFunctor {
     template <typename T>
@@ -14,8 +19,8 @@ struct QuaternionFunctor {
         Eigen::Matrix<T, 3, 1> lidar_point = R * lid_point_.cast<T>() + t;
         Eigen::Matrix<T, 2, 1> projection = IntrinsicTransform(intrinsic, lidar_point);
         T res, val;
-        kde_interpolator_.Evaluate(projection(0) * T(kde_scale_), projection(1) * T(kde_scale_), &val);
-        res = T(weight_) * (T(kde_val_) - val);
+        kde_map_.Evaluate(projection(0), projection(1), &val);
+        res = T(weight_) * (T(kde_map_.ref_val) - val);
         cost[0] = res;
         cost[1] = res;
         cost[2] = res;
@@ -23,30 +28,59 @@ struct QuaternionFunctor {
     }
 
     QuaternionFunctor(const Vec3D lid_point,
-                    const double weight,
-                    const double ref_val,
-                    const double scale,
-                    const ceres::BiCubicInterpolator<ceres::Grid2D<double>> &interpolator)
-                    : lid_point_(std::move(lid_point)), kde_interpolator_(interpolator), weight_(std::move(weight)), kde_val_(std::move(ref_val)), kde_scale_(std::move(scale)) {}
+                    const double &weight,
+                    const DensityMap &kde_map)
+                    : lid_point_(std::move(lid_point)), weight_(weight), kde_map_(kde_map) {}
 
     static ceres::CostFunction *Create(const Vec3D &lid_point,
                                        const double &weight,
-                                       const double &kde_val,
-                                       const double &kde_scale,
-                                       const ceres::BiCubicInterpolator<ceres::Grid2D<double>> &interpolator) {
+                                       const DensityMap &kde_map) {
         return new ceres::AutoDiffCostFunction<QuaternionFunctor, 3, ((6+1)-3), 3, K_INT>(
-                new QuaternionFunctor(lid_point, weight, kde_val, kde_scale, interpolator));
+                new QuaternionFunctor(lid_point, weight, kde_map));
     }
 
     const Vec3D lid_point_;
-    const double weight_;
-    const double kde_val_;
-    const double kde_scale_;
-    const ceres::BiCubicInterpolator<ceres::Grid2D<double>> &kde_interpolator_;
+    /** referenced rather than copied, so the weight and the map can be swapped between solves **/
+    const double &weight_;
+    const DensityMap &kde_map_;
 };
 
-void project2Image(OmniProcess &omnicam, LidarProcess &lidar, std::vector<double> &params, double bandwidth) {
+ceres::CostFunction *edgeCostFunction(const Vec3D &lid_point, const double &weight, const DensityMap &kde_map) {
+    return QuaternionFunctor::Create(lid_point, weight, kde_map);
+}
+
+/** Early exit of a stage once the cost stops improving over a window of iterations **/
+class PlateauCallback : public ceres::IterationCallback {
+public:
+    PlateauCallback(int window, double ratio) : window_(window), ratio_(ratio) {}
+
+    ceres::CallbackReturnType operator()(const ceres::IterationSummary &summary) {
+        costs_.push_back(summary.cost);
+        if (window_ > 0 && costs_.size() > window_) {
+            double prev_cost = costs_[costs_.size() - 1 - window_];
+            if ((prev_cost - summary.cost) < ratio_ * prev_cost) {
+                if (MESSAGE_EN) {
+                    ROS_INFO("Stage plateau after %d iterations, early exit.", summary.iteration);
+                }
+                return ceres::SOLVER_TERMINATE_SUCCESSFULLY;
+            }
+        }
+        return ceres::SOLVER_CONTINUE;
+    }
+
+private:
+    const int window_;
+    const double ratio_;
+    std::vector<double> costs_;
+};
+
+void project2Image(OmniProcess &omnicam, LidarProcess &lidar, std::vector<double> &params, double bandwidth,
+                   MapBackend backend) {
     cv::Mat raw_image = omnicam.loadImage();
+    if (raw_image.empty()) {
+        ROS_ERROR("No image of spot %d, fusion image skipped.", omnicam.spot_idx);
+        return;
+    }
     ofstream outfile;
 
     if (MESSAGE_EN) {
@@ -61,24 +95,26 @@ void project2Image(OmniProcess &omnicam, LidarProcess &lidar, std::vector<double
     EdgeCloud::Ptr fisheye_edge_cloud (new EdgeCloud);
     EdgeCloud::Ptr lidar_edge_cloud (new EdgeCloud);
     Mat4D T_mat = transformMat(extrinsic);
-    pcl::transformPointCloud(lidar.edge_cloud_vec[lidar.spot_idx][lidar.view_idx], *lidar_edge_cloud, T_mat);
+    pcl::copyPointCloud(lidar.edge_cloud_vec[lidar.spot_idx][lidar.view_idx], *lidar_edge_cloud);
     pcl::copyPointCloud(omnicam.edge_cloud_vec[lidar.spot_idx][lidar.view_idx], *fisheye_edge_cloud);
 
-    Vec3D lidar_point;
-    Vec2D projection;
+    OmniProjector projector(intrinsic);
+    projector.setBounds(omnicam.kEffectiveRadius.first, omnicam.kEffectiveRadius.second);
+    PointsSoA points;
+    PixelsSoA pixels;
+    toPointsSoA(*lidar_edge_cloud, points);
+    std::vector<uint8_t> mask(points.rows());
+    projector.transformProject(T_mat.block<3, 3>(0, 0), T_mat.block<3, 1>(0, 3), points, pixels, mask.data());
 
-    for (auto &point : lidar_edge_cloud->points) {
-        lidar_point << point.x, point.y, point.z;
-        projection = IntrinsicTransform(intrinsic, lidar_point);
-        int u = std::clamp((int)round(projection(0)), 0, raw_image.rows - 1);
-        int v = std::clamp((int)round(projection(1)), 0, raw_image.cols - 1);
-        point.x = projection(0);
-        point.y = projection(1);
+    for (int i = 0; i < lidar_edge_cloud->size(); ++i) {
+        auto &point = lidar_edge_cloud->points[i];
+        point.x = pixels(i, 0);
+        point.y = pixels(i, 1);
         point.z = 0;
 
-        float radius = pow(u-intrinsic(0),2) + pow(v-intrinsic(1),2);
-        Pair &bounds = omnicam.kEffectiveRadius;
-        if (radius > bounds.first * bounds.first && radius < bounds.second * bounds.second) {
+        if (mask[i]) {
+            int u = std::clamp((int)round(pixels(i, 0)), 0, raw_image.rows - 1);
+            int v = std::clamp((int)round(pixels(i, 1)), 0, raw_image.cols - 1);
             raw_image.at<cv::Vec3b>(u, v)[0] = 0;    // b
             raw_image.at<cv::Vec3b>(u, v)[1] = 255;    // g
             raw_image.at<cv::Vec3b>(u, v)[2] = 0;  // r
@@ -88,7 +124,12 @@ void project2Image(OmniProcess &omnicam, LidarProcess &lidar, std::vector<double
     
     if (MESSAGE_EN) {outfile.close(); }
 
-    lidar.getEdgeDistance(fisheye_edge_cloud, lidar_edge_cloud, 30);
+    if (backend == DT_BACKEND) {
+        lidar.getEdgeDistance(omnicam.DistanceImage(1), lidar_edge_cloud, 30);
+    }
+    else {
+        lidar.getEdgeDistance(fisheye_edge_cloud, lidar_edge_cloud, 30);
+    }
 
     /** generate fusion image **/
     string fusion_img_path = omnicam.file_path_vec[omnicam.spot_idx][omnicam.view_idx].fusion_folder_path 
@@ -97,168 +138,205 @@ void project2Image(OmniProcess &omnicam, LidarProcess &lidar, std::vector<double
 }
 
 void SpotColorization(OmniProcess &omnicam, LidarProcess &lidar, std::vector<double> &params) {
- 
-    string spot_cloud_path, pose_mat_path;
-    Ext_F extrinsic;
-    Int_F intrinsic;
-
-    cv::Mat target_view_img;
+    TraceSpan span("calib.SpotColorization", lidar.spot_idx);
+    const int kNumViews = lidar.num_views;
     CloudI::Ptr spot_cloud(new CloudI);
-    CloudRGB::Ptr input_cloud(new CloudRGB), spot_rgb_cloud(new CloudRGB);
+    CloudRGB::Ptr spot_rgb_cloud(new CloudRGB);
 
-    Mat4F T_mat, T_mat_inv;
-    Mat4F pose_mat, pose_mat_inv;
-    
-    Vec3F lidar_point;
-    Vec2F projection;
+    string spot_cloud_path = lidar.file_path_vec[lidar.spot_idx][lidar.view_idx].spot_cloud_path;
+    pcl::io::loadPCDFile(spot_cloud_path, *spot_cloud);
+    traceFileRead(spot_cloud_path);
+    span.pointsIn(spot_cloud->size());
 
-    spot_cloud_path = lidar.file_path_vec[lidar.spot_idx][lidar.view_idx].spot_cloud_path;
+    /** Loading optimized parameters **/
+    Ext_D extrinsic = Eigen::Map<Param_D>(params.data()).head(6);
+    Int_D intrinsic = Eigen::Map<Param_D>(params.data()).tail(K_INT);
+    Mat4D T_mat = transformMat(extrinsic);
 
-    pcl::io::loadPCDFile(spot_cloud_path, *spot_cloud);
-    pcl::copyPointCloud(*spot_cloud, *input_cloud);
+    /** valid inside the annulus less the excluded margin, the best view is the one closest to its middle **/
+    Pair &bounds = omnicam.kEffectiveRadius;
+    const double r_min = bounds.first + omnicam.kExcludeRadius;
+    const double r_max = bounds.second - omnicam.kExcludeRadius;
+    const double r_mid = 0.5 * (r_min + r_max);
+    OmniProjector projector(intrinsic);
+    projector.enableLut(LUT_MAX_ERROR);
+    projector.setBounds(r_min, r_max);
 
-    /** Loading optimized parameters and initial transform matrix **/
-    extrinsic = Eigen::Map<Param_D>(params.data()).head(6).cast<float>();
-    intrinsic = Eigen::Map<Param_D>(params.data()).tail(K_INT).cast<float>();
-    T_mat = transformMat(extrinsic);
-    T_mat_inv = T_mat.inverse();
-    pose_mat = Mat4F::Identity();
-    pose_mat_inv = Mat4F::Identity();
+    /********* Images and LiDAR-to-camera Transforms of All Views *********/
+    std::vector<ImageCache::ImagePtr> view_imgs(kNumViews);
+    std::vector<Mat3D> view_rotations(kNumViews);
+    std::vector<Vec3D> view_translations(kNumViews);
+    for (int view_idx = 0; view_idx < kNumViews; ++view_idx) {
+        string pose_mat_path = lidar.file_path_vec[lidar.spot_idx][view_idx].pose_trans_mat_path;
+        Mat4D pose_mat = LoadTransMat(pose_mat_path).cast<double>();
+        Mat4D view_mat = T_mat * pose_mat.inverse();
+        view_rotations[view_idx] = view_mat.topLeftCorner(3, 3);
+        view_translations[view_idx] = view_mat.topRightCorner(3, 1);
 
-    pcl::transformPointCloud(*input_cloud, *input_cloud, T_mat);
+        omnicam.prefetchImage(view_idx + 1);
+        omnicam.setView(view_idx);
+        view_imgs[view_idx] = omnicam.getImage();
+        if (view_imgs[view_idx]->empty()) {
+            ROS_WARN("No image of spot %d view %d, the view is skipped in the colorization.", lidar.spot_idx, view_idx);
+        }
+    }
+    omnicam.setView(lidar.center_view_idx);
 
-    for (int i = 0; i < lidar.num_views; i++)
-    {
-        int color_view_idx = lidar.center_view_idx - (int(0.5 * (i + 1)) * ((2 * (i % 2) - 1)));
-        CloudRGB::Ptr output_cloud(new CloudRGB);
-        std::vector<int> colored_point_idx(spot_cloud->points.size());
-        std::vector<int> blank_point_idx(spot_cloud->points.size());
-
-        /** Loading transform matrix between different views **/
-        pose_mat_path = lidar.file_path_vec[lidar.spot_idx][color_view_idx].pose_trans_mat_path;
-        pose_mat = LoadTransMat(pose_mat_path);
-        cout << "View: " << " Spot Index: " << lidar.spot_idx << " View Index: " << color_view_idx << "\n"
-            << "ICP Trans Mat:" << "\n " << pose_mat << endl;
-        pose_mat_inv = pose_mat.inverse();
-
-        /** Loading transform matrix between different views **/
-        omnicam.setView(color_view_idx);
-        target_view_img = omnicam.loadImage();
-
-        /** PointCloud Coloring **/
-        pcl::transformPointCloud(*input_cloud, *input_cloud, (T_mat * pose_mat_inv * T_mat_inv)); 
-
-        /** Multiprocessing test **/
-        #pragma omp parallel for num_threads(THREADS)
-
-        for (int point_idx = 0; point_idx < input_cloud->points.size(); ++point_idx) {
-            PointRGB &point = input_cloud->points[point_idx];
+    /********* Visibility: nearest range per low-resolution cell of each view *********/
+    const int kNumPoints = spot_cloud->points.size();
+    const bool kOcclusion = omnicam.kDepthTolerance > 0;
+    const int kCell = std::max(1, omnicam.kDepthCell);
+    const int kBufferRows = (omnicam.kImageSize.first + kCell - 1) / kCell;
+    const int kBufferCols = (omnicam.kImageSize.second + kCell - 1) / kCell;
+    std::vector<DepthBuffer> depth_buffers;
+    pcl::StopWatch timer;
+
+    if (kOcclusion) {
+        for (int view_idx = 0; view_idx < kNumViews; ++view_idx) {
+            depth_buffers.emplace_back(kBufferRows, kBufferCols);
+        }
+        #pragma omp parallel for num_threads(THREADS) schedule(static)
+        for (int point_idx = 0; point_idx < kNumPoints; ++point_idx) {
+            const PointI &point = spot_cloud->points[point_idx];
             if (point.x == 0 && point.y == 0 && point.z == 0) {
                 continue;
             }
-            lidar_point << point.x, point.y, point.z;
-            projection = IntrinsicTransform(intrinsic, lidar_point);
-            int u = round(projection(0));
-            int v = round(projection(1));
-
-            if (0 <= u && u < target_view_img.rows && 0 <= v && v < target_view_img.cols) {
-                double radius = sqrt(pow(projection(0) - intrinsic(0), 2) + pow(projection(1) - intrinsic(0), 2));
-                Pair &bounds = omnicam.kEffectiveRadius;
-                int &extra = omnicam.kExcludeRadius;
-                if (radius > (bounds.first + extra) && radius < (bounds.second - extra)) {
-                    point.b = target_view_img.at<cv::Vec3b>(u, v)[0];
-                    point.g = target_view_img.at<cv::Vec3b>(u, v)[1];
-                    point.r = target_view_img.at<cv::Vec3b>(u, v)[2];
-                    colored_point_idx[point_idx] = point_idx;
-                }
-                else {
-                    blank_point_idx[point_idx] = point_idx;
+            const Vec3D lidar_point(point.x, point.y, point.z);
+            for (int view_idx = 0; view_idx < kNumViews; ++view_idx) {
+                const Vec3D cam_point = view_rotations[view_idx] * lidar_point + view_translations[view_idx];
+                double u, v, uv_radius;
+                projector.project(cam_point(0), cam_point(1), cam_point(2), u, v, uv_radius);
+                if (projector.inBounds(u, v)) {
+                    depth_buffers[view_idx].update(int(round(u)) / kCell, int(round(v)) / kCell, cam_point.norm());
                 }
             }
-            else {
-                blank_point_idx[point_idx] = point_idx;
+        }
+        if (MESSAGE_EN) {
+            ROS_INFO("Depth buffers of %d views (%d x %d) rasterized in %f s.",
+                     kNumViews, kBufferRows, kBufferCols, timer.getTimeSeconds());
+        }
+    }
+
+    /********* Single Pass: every point against every view *********/
+    std::vector<int8_t> best_views(kNumPoints, -1);
+    std::vector<cv::Point> best_pixels(kNumPoints);
+
+    #pragma omp parallel for num_threads(THREADS) schedule(static)
+    for (int point_idx = 0; point_idx < kNumPoints; ++point_idx) {
+        const PointI &point = spot_cloud->points[point_idx];
+        if (point.x == 0 && point.y == 0 && point.z == 0) {
+            continue;
+        }
+        const Vec3D lidar_point(point.x, point.y, point.z);
+        double best_score = std::numeric_limits<double>::max();
+        for (int view_idx = 0; view_idx < kNumViews; ++view_idx) {
+            if (view_imgs[view_idx]->empty()) {
+                continue;
+            }
+            const Vec3D cam_point = view_rotations[view_idx] * lidar_point + view_translations[view_idx];
+            double u, v, uv_radius;
+            projector.project(cam_point(0), cam_point(1), cam_point(2), u, v, uv_radius);
+            const int u_idx = round(u);
+            const int v_idx = round(v);
+            if (!projector.inBounds(u, v)
+                || u_idx < 0 || u_idx >= view_imgs[view_idx]->rows || v_idx < 0 || v_idx >= view_imgs[view_idx]->cols) {
+                continue;
+            }
+            /** hidden behind a nearer surface of the same cell **/
+            if (kOcclusion && cam_point.norm() > depth_buffers[view_idx].at(u_idx / kCell, v_idx / kCell) * (1 + omnicam.kDepthTolerance)) {
+                continue;
+            }
+            const double score = fabs(sqrt(pow(u - projector.u0(), 2) + pow(v - projector.v0(), 2)) - r_mid);
+            if (score < best_score) {
+                best_score = score;
+                best_views[point_idx] = view_idx;
+                best_pixels[point_idx] = cv::Point(v_idx, u_idx);
             }
         }
-        colored_point_idx.erase(std::remove(colored_point_idx.begin(), colored_point_idx.end(), 0), colored_point_idx.end());
-        blank_point_idx.erase(std::remove(blank_point_idx.begin(), blank_point_idx.end(), 0), blank_point_idx.end());
-        pcl::transformPointCloud(*input_cloud, *input_cloud, (T_mat * pose_mat * T_mat_inv));
-        pcl::copyPointCloud(*input_cloud, colored_point_idx, *output_cloud);
-	    pcl::copyPointCloud(*input_cloud, blank_point_idx, *input_cloud);
-        
-        *spot_rgb_cloud += *output_cloud;
-        cout << input_cloud->points.size() << " " << spot_rgb_cloud->points.size() << " " << spot_cloud->points.size() << endl;
     }
 
-    pcl::transformPointCloud(*spot_rgb_cloud, *spot_rgb_cloud, T_mat_inv);
+    /********* Colored Points, written once in the LiDAR frame *********/
+    std::vector<int> output_idx(kNumPoints);
+    int num_colored = 0;
+    for (int point_idx = 0; point_idx < kNumPoints; ++point_idx) {
+        output_idx[point_idx] = num_colored;
+        num_colored += (best_views[point_idx] >= 0);
+    }
+    spot_rgb_cloud->resize(num_colored);
 
+    #pragma omp parallel for num_threads(THREADS) schedule(static)
+    for (int point_idx = 0; point_idx < kNumPoints; ++point_idx) {
+        if (best_views[point_idx] < 0) {
+            continue;
+        }
+        const PointI &point = spot_cloud->points[point_idx];
+        PointRGB &rgb_point = spot_rgb_cloud->points[output_idx[point_idx]];
+        const cv::Vec3b &color = view_imgs[best_views[point_idx]]->at<cv::Vec3b>(best_pixels[point_idx]);
+        rgb_point.x = point.x;
+        rgb_point.y = point.y;
+        rgb_point.z = point.z;
+        rgb_point.b = color[0];
+        rgb_point.g = color[1];
+        rgb_point.r = color[2];
+    }
+
+    if (MESSAGE_EN) {
+        ROS_INFO("Spot %d: %d of %d points colored from %d views in %f s.",
+                 lidar.spot_idx, num_colored, kNumPoints, kNumViews, timer.getTimeSeconds());
+    }
+
+    span.pointsOut(num_colored);
     pcl::io::savePCDFileBinary(lidar.file_path_vec[lidar.spot_idx][lidar.center_view_idx].spot_rgb_cloud_path, *spot_rgb_cloud);
+    traceFileWritten(lidar.file_path_vec[lidar.spot_idx][lidar.center_view_idx].spot_rgb_cloud_path);
 }
 
-std::vector<double> QuaternionCalib(OmniProcess &omnicam,
-                                    LidarProcess &lidar,
-                                    double bandwidth,
-                                    std::vector<int> spot_vec,
-                                    std::vector<double> init_params_vec,
-                                    std::vector<double> lb,
-                                    std::vector<double> ub,
-                                    bool lock_intrinsic) {
-    Param_D init_params = Eigen::Map<Param_D>(init_params_vec.data());
+/** spot of a trace span, -1 for a joint problem of several spots **/
+static int traceSpot(const std::vector<int> &spot_vec) {
+    return (spot_vec.size() == 1) ? spot_vec[0] : -1;
+}
+
+/** grid scale of a pyramid level relative to the full resolution image **/
+static double levelScale(int level) {
+    return KDE_SCALE / double(1 << level);
+}
+
+/** values of the density map of the current spot on the grid of a pyramid level **/
+static std::vector<double> densityValues(OmniProcess &omnicam, double bandwidth, MapBackend backend, int level = 0) {
+    if (backend == DT_BACKEND) {
+        return omnicam.DistanceMap(omnicam.kDistTruncation, levelScale(level));
+    }
+    return omnicam.Kde(bandwidth, levelScale(level));
+}
+
+static QParam_D toQuaternionParams(const Param_D &init_params) {
     Ext_D extrinsic = init_params.head(6);
-    MatD(K_INT+(6+1), 1) q_vector;
     Mat3D rotation_mat = transformMat(extrinsic).topLeftCorner(3, 3);
     Eigen::Quaterniond quaternion(rotation_mat);
-    ceres::EigenQuaternionManifold *q_manifold = new ceres::EigenQuaternionManifold();
-    
-    const int kParams = q_vector.size();
-    const int kViews = omnicam.num_views;
-    const double scale = KDE_SCALE;
+    QParam_D q_vector;
     q_vector.tail(K_INT + 3) = init_params.tail(K_INT + 3);
     q_vector.head(4) << quaternion.x(), quaternion.y(), quaternion.z(), quaternion.w();
-    double params[kParams];
-    memcpy(params, &q_vector(0), q_vector.size() * sizeof(double));
+    return q_vector;
+}
 
-    /********* Initialize Ceres Problem *********/
-    ceres::Problem problem;
+static std::vector<double> toResultVec(const double *params) {
+    Param_D result = Eigen::Map<const QParam_D>(params).tail(6 + K_INT);
+    result.head(3) = Eigen::Quaterniond(params[3], params[0], params[1], params[2]).matrix().eulerAngles(2,1,0).reverse();
+    std::vector<double> result_vec(&result[0], result.data()+result.cols()*result.rows());
+    return result_vec;
+}
+
+/** parameter blocks of {quaternion, translation, intrinsic} with their bounds **/
+static void addParameterBlocks(ceres::Problem &problem,
+                               double *params,
+                               const QParam_D &q_vector,
+                               std::vector<double> &lb,
+                               std::vector<double> &ub,
+                               bool lock_intrinsic) {
+    const int kParams = q_vector.size();
+    ceres::EigenQuaternionManifold *q_manifold = new ceres::EigenQuaternionManifold();
     problem.AddParameterBlock(params, ((6+1)-3), q_manifold);
     problem.AddParameterBlock(params+((6+1)-3), 3);
     problem.AddParameterBlock(params+(6+1), K_INT);
-    ceres::LossFunction *loss_function = new ceres::HuberLoss(0.05);
-
-    /********* Fisheye KDE *********/
-    std::vector<double> ref_vals;
-    std::vector<ceres::Grid2D<double>> grids;
-    std::vector<ceres::BiCubicInterpolator<ceres::Grid2D<double>>> interpolators;
-    omnicam.setView(omnicam.fullview_idx);
-    lidar.setView(lidar.center_view_idx);
-    for (int idx = 0; idx < spot_vec.size(); idx++) {
-        omnicam.setSpot(spot_vec[idx]);
-        std::vector<double> fisheye_kde = omnicam.Kde(bandwidth, scale);
-        double *kde_val = new double[fisheye_kde.size()];
-        memcpy(kde_val, &fisheye_kde[0], fisheye_kde.size() * sizeof(double));
-        ceres::Grid2D<double> grid(kde_val, 0, omnicam.kImageSize.first * scale, 0, omnicam.kImageSize.second * scale);
-        grids.push_back(grid);
-        double ref_val = *max_element(fisheye_kde.begin(), fisheye_kde.end());
-        ref_vals.push_back(ref_val);
-    }
-    const std::vector<ceres::Grid2D<double>> kde_grids(grids);
-    for (int idx = 0; idx < spot_vec.size(); idx++) {
-        ceres::BiCubicInterpolator<ceres::Grid2D<double>> interpolator(kde_grids[idx]);
-        interpolators.push_back(interpolator);
-    }
-    const std::vector<ceres::BiCubicInterpolator<ceres::Grid2D<double>>> kde_interpolators(interpolators);
-
-    for (int idx = 0; idx < spot_vec.size(); idx++) {
-        lidar.setSpot(spot_vec[idx]);
-        EdgeCloud &edge_cloud = lidar.edge_cloud_vec[lidar.spot_idx][lidar.view_idx];
-        double weight = sqrt(50000.0f / edge_cloud.size());
-        
-        for (auto &point : edge_cloud.points) {
-            Vec3D lid_point = {point.x, point.y, point.z};
-            problem.AddResidualBlock(QuaternionFunctor::Create(lid_point, weight, ref_vals[idx], scale, kde_interpolators[idx]),
-                                loss_function,
-                                params, params+((6+1)-3), params+(6+1));
-        }
-    }
 
     if (lock_intrinsic) {
         problem.SetParameterBlockConstant(params + (6+1));
@@ -278,8 +356,9 @@ std::vector<double> QuaternionCalib(OmniProcess &omnicam,
             problem.SetParameterUpperBound(params+(6+1), i-(6+1), ub[i-1]);
         }
     }
+}
 
-    /********* Initial Options *********/
+static ceres::Solver::Options solverOptions() {
     ceres::Solver::Options options;
     options.linear_solver_type = ceres::DENSE_SCHUR;
     options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
@@ -289,180 +368,693 @@ std::vector<double> QuaternionCalib(OmniProcess &omnicam,
     options.gradient_tolerance = 1e-6;
     options.function_tolerance = 1e-12;
     options.use_nonmonotonic_steps = true;
+    return options;
+}
+
+std::vector<double> QuaternionCalib(OmniProcess &omnicam,
+                                    LidarProcess &lidar,
+                                    double bandwidth,
+                                    std::vector<int> spot_vec,
+                                    std::vector<double> init_params_vec,
+                                    std::vector<double> lb,
+                                    std::vector<double> ub,
+                                    bool lock_intrinsic,
+                                    MapBackend backend) {
+    TraceSpan span("calib.QuaternionCalib", traceSpot(spot_vec));
+    Param_D init_params = Eigen::Map<Param_D>(init_params_vec.data());
+    QParam_D q_vector = toQuaternionParams(init_params);
+    double params[K_INT+(6+1)];
+    memcpy(params, &q_vector(0), q_vector.size() * sizeof(double));
+
+    /********* Initialize Ceres Problem *********/
+    ceres::Problem problem;
+    addParameterBlocks(problem, params, q_vector, lb, ub, lock_intrinsic);
+    ceres::LossFunction *loss_function = new ceres::HuberLoss(0.05);
+
+    /********* Fisheye KDE *********/
+    std::vector<DensityMap> kde_maps;
+    omnicam.setView(omnicam.fullview_idx);
+    lidar.setView(lidar.center_view_idx);
+    loadDensityMaps(omnicam, spot_vec, bandwidth, kde_maps, backend);
+
+    std::vector<double> weights(spot_vec.size());
+    for (int idx = 0; idx < spot_vec.size(); idx++) {
+        lidar.setSpot(spot_vec[idx]);
+        EdgeCloud &edge_cloud = lidar.edge_cloud_vec[lidar.spot_idx][lidar.view_idx];
+        weights[idx] = sqrt(50000.0f / edge_cloud.size());
+        
+        for (auto &point : edge_cloud.points) {
+            Vec3D lid_point = {point.x, point.y, point.z};
+            problem.AddResidualBlock(QuaternionFunctor::Create(lid_point, weights[idx], kde_maps[idx]),
+                                loss_function,
+                                params, params+((6+1)-3), params+(6+1));
+        }
+    }
+
+    /********* Initial Options *********/
+    ceres::Solver::Options options = solverOptions();
 
     ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
+    {
+        TraceSpan solve_span("ceres.Solve", traceSpot(spot_vec));
+        solve_span.pointsIn(problem.NumResidualBlocks());
+        ceres::Solve(options, &problem, &summary);
+    }
     std::cout << summary.FullReport() << "\n";
 
     /********* 2D Image Visualization *********/
-    Param_D result = Eigen::Map<MatD(K_INT+(6+1), 1)>(params).tail(6 + K_INT);
-    result.head(3) = Eigen::Quaterniond(params[3], params[0], params[1], params[2]).matrix().eulerAngles(2,1,0).reverse();
-    std::vector<double> result_vec(&result[0], result.data()+result.cols()*result.rows());
+    std::vector<double> result_vec = toResultVec(params);
     string record_path = lidar.file_path_vec[lidar.spot_idx][lidar.view_idx].result_folder_path 
                         + "/result_spot" + to_string(lidar.spot_idx) + ".txt";
     saveResults(record_path, result_vec, bandwidth, summary.initial_cost, summary.final_cost);
 
-    extrinsic = result.head(6);
     for (int &spot_idx : spot_vec) {
         omnicam.setSpot(spot_idx);
         lidar.setSpot(spot_idx);
-        project2Image(omnicam, lidar, result_vec, bandwidth);
+        project2Image(omnicam, lidar, result_vec, bandwidth, backend);
     }
     
     return result_vec;
 }
 
-void costAnalysis(OmniProcess &omnicam,
-                  LidarProcess &lidar,
-                   std::vector<int> spot_vec,
-                  std::vector<double> init_params_vec,
-                  std::vector<double> result_vec,
-                  double bandwidth) {
-    const int kViews = omnicam.num_views;
-    const double scale = KDE_SCALE;
+/** edge point indices ordered so that every prefix samples the rings x sectors cells of the fisheye annulus evenly **/
+static std::vector<int> stratifiedOrder(EdgeCloud &edge_cloud, const Param_D &params, const Pair &bounds, unsigned int seed) {
+    const int kRings = 4;
+    const int kSectors = 16;
+    const int kCells = kRings * kSectors + 1; /** the last cell collects the points projected outside the annulus **/
+    Ext_D extrinsic = params.head(6);
+    Int_D intrinsic = params.tail(K_INT);
+    Mat4D T_mat = transformMat(extrinsic);
 
-    /********* Fisheye KDE *********/
-    std::vector<double> ref_vals;
-    std::vector<ceres::Grid2D<double>> grids;
-    std::vector<ceres::BiCubicInterpolator<ceres::Grid2D<double>>> interpolators;
-    for (int i = 0; i < spot_vec.size(); i++) {
-        omnicam.setSpot(spot_vec[i]);
-        lidar.setSpot(spot_vec[i]);
-        std::vector<double> fisheye_kde = omnicam.Kde(bandwidth, scale);
-        double *kde_val = new double[fisheye_kde.size()];
-        memcpy(kde_val, &fisheye_kde[0], fisheye_kde.size() * sizeof(double));
-        ceres::Grid2D<double> grid(kde_val, 0, omnicam.kImageSize.first * scale, 0, omnicam.kImageSize.second * scale);
-        grids.push_back(grid);
-        double ref_val = *max_element(fisheye_kde.begin(), fisheye_kde.end());
-        ref_vals.push_back(ref_val);
-    }
-    const std::vector<ceres::Grid2D<double>> kde_grids(grids);
-    for (int i = 0; i < spot_vec.size(); i++) {
-        omnicam.setSpot(spot_vec[i]);
-        lidar.setSpot(spot_vec[i]);
-        ceres::BiCubicInterpolator<ceres::Grid2D<double>> interpolator(kde_grids[i]);
-        interpolators.push_back(interpolator);
-    }
-    const std::vector<ceres::BiCubicInterpolator<ceres::Grid2D<double>>> kde_interpolators(interpolators);
+    OmniProjector projector(intrinsic);
+    PointsSoA points;
+    PixelsSoA pixels;
+    toPointsSoA(edge_cloud, points);
+    projector.transformProject(T_mat.block<3, 3>(0, 0), T_mat.block<3, 1>(0, 3), points, pixels);
 
-    /***** Correlation Analysis *****/
-    Param_D params_mat = Eigen::Map<Param_D>(result_vec.data());
-    Ext_D extrinsic;
-    Int_D intrinsic;
-    std::vector<double> results;
-    std::vector<double> input_x;
-    std::vector<double> input_y;
-    std::vector<const char*> name = {
-            "rx", "ry", "rz",
-            "tx", "ty", "tz",
-            "u0", "v0",
-            "a0", "a1", "a2", "a3", "a4",
-            "c", "d", "e"};
-    int steps[3] = {1, 1, 1};
-    int param_idx[3] = {0, 3, 6};
-    const double step_size[3] = {0.0002, 0.001, 0.01};
-    const double deg2rad = M_PI / 180;
-    double offset[3] = {0, 0, 0};
-
-    /** update evaluate points in 2D grid **/
-    for (int m = 0; m < 6; m++) {
-        extrinsic = params_mat.head(6);
-        intrinsic = params_mat.tail(K_INT);
-        if (m < 3) {
-            steps[0] = 201;
-            steps[1] = 1;
-            steps[2] = 1;
-            param_idx[0] = m;
-            param_idx[1] = 3;
-            param_idx[2] = 6;
-        }
-        else if (m < 6){
-            steps[0] = 1;
-            steps[1] = 201;
-            steps[2] = 1;
-            param_idx[0] = 0;
-            param_idx[1] = m;
-            param_idx[2] = 6;
-        }
-        else {
-            steps[0] = 1;
-            steps[1] = 1;
-            steps[2] = 201;
-            param_idx[0] = 0;
-            param_idx[1] = 3;
-            param_idx[2] = m;
+    std::vector<std::vector<int>> cells(kCells);
+    for (int i = 0; i < edge_cloud.size(); ++i) {
+        double du = pixels(i, 0) - intrinsic(0);
+        double dv = pixels(i, 1) - intrinsic(1);
+        double radius = sqrt(du * du + dv * dv);
+        int cell = kCells - 1;
+        if (radius > bounds.first && radius < bounds.second) {
+            int ring = std::min(kRings - 1, int(kRings * (radius - bounds.first) / (bounds.second - bounds.first)));
+            int sector = std::min(kSectors - 1, int(kSectors * (atan2(dv, du) + M_PI) / (2 * M_PI)));
+            cell = ring * kSectors + sector;
         }
+        cells[cell].push_back(i);
+    }
 
-        for (int k = 0; k < spot_vec.size(); k++) {
-            lidar.setSpot(spot_vec[k]);
-            double normalize_weight = sqrt(1.0f / lidar.edge_cloud_vec[lidar.spot_idx][lidar.view_idx].size());
+    /** shuffle each cell and key its points by their fractional rank within the cell **/
+    std::mt19937 rng(seed);
+    std::vector<std::pair<double, int>> keys;
+    keys.reserve(edge_cloud.size());
+    for (auto &cell : cells) {
+        std::shuffle(cell.begin(), cell.end(), rng);
+        for (int rank = 0; rank < cell.size(); ++rank) {
+            keys.push_back({(rank + 0.5) / cell.size(), cell[rank]});
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<int> order(keys.size());
+    for (int i = 0; i < keys.size(); ++i) {
+        order[i] = keys[i].second;
+    }
+    return order;
+}
+
+std::vector<double> ContinuationCalib(OmniProcess &omnicam,
+                                      LidarProcess &lidar,
+                                      std::vector<CalibStage> stages,
+                                      std::vector<int> spot_vec,
+                                      std::vector<double> init_params_vec,
+                                      std::vector<double> lb,
+                                      std::vector<double> ub,
+                                      bool lock_intrinsic,
+                                      CalibReport *report,
+                                      const std::vector<DensityMap> *first_maps,
+                                      bool visualize) {
+    TraceSpan span("calib.ContinuationCalib", traceSpot(spot_vec));
+    const int kStages = stages.size();
+    /** only the final stage runs at full resolution **/
+    stages.back().level = 0;
+    Param_D init_params = Eigen::Map<Param_D>(init_params_vec.data());
+    QParam_D q_vector = toQuaternionParams(init_params);
+    /** the parameter blocks live through all stages, each stage warm-starts from the previous optimum **/
+    double params[K_INT+(6+1)];
+    memcpy(params, &q_vector(0), q_vector.size() * sizeof(double));
+
+    /********* Fisheye KDE of the first stage *********/
+    pcl::StopWatch timer;
+    std::vector<DensityMap> kde_maps;
+    omnicam.setView(omnicam.fullview_idx);
+    lidar.setView(lidar.center_view_idx);
+    if (first_maps != nullptr) {
+        /** copied, the maps are swapped in place by the later stages **/
+        kde_maps = std::vector<DensityMap>(spot_vec.size());
+        for (int idx = 0; idx < spot_vec.size(); idx++) {
+            const DensityMap &map = (*first_maps)[idx];
+            kde_maps[idx].setValues(std::vector<double>(map.values), map.rows, map.cols, map.scale);
+        }
+    }
+    else {
+        loadDensityMaps(omnicam, spot_vec, stages[0].bandwidth, kde_maps, stages[0].backend, stages[0].level);
+    }
+    if (report != nullptr) {
+        report->setup_time = timer.getTimeSeconds();
+    }
+
+    /********* Problem structure, built once, the residual blocks are swapped when the pyramid level changes *********/
+    ceres::Problem::Options problem_options;
+    problem_options.enable_fast_removal = true;
+    ceres::Problem problem(problem_options);
+    addParameterBlocks(problem, params, q_vector, lb, ub, lock_intrinsic);
+    ceres::LossFunction *loss_function = new ceres::HuberLoss(0.05);
+
+    /** edge subsets of the early stages are prefixes of a stratified order of their level, so they only grow within a level **/
+    std::vector<std::vector<int>> point_orders(spot_vec.size());
+    std::vector<std::vector<ceres::ResidualBlockId>> active_blocks(spot_vec.size());
+    std::vector<int> active_level(spot_vec.size(), -1);
+    std::vector<double> weights(spot_vec.size());
+
+    string record_path = lidar.file_path_vec[lidar.spot_idx][lidar.view_idx].result_folder_path
+                        + "/result_spot" + to_string(lidar.spot_idx) + ".txt";
+    std::vector<double> result_vec;
+    pcl::StopWatch total_timer;
+    ceres::Solver::Summary summary;
+
+    for (int stage = 0; stage < kStages; ++stage) {
+        CalibStage &cfg = stages[stage];
+        TraceSpan stage_span("calib.stage", traceSpot(spot_vec));
+        timer.reset();
 
-            /** Save & terminal output **/
-            string analysis_filepath = lidar.kDatasetPath + "/log/";
-            if (steps[0] > 1) {
-                analysis_filepath = analysis_filepath + name[param_idx[0]] + "_";
+        /** grow the active edge subsets, the final stage always runs on the full set **/
+        const double ratio = (stage == kStages - 1) ? 1.0 : std::min(1.0, cfg.sample_ratio);
+        for (int idx = 0; idx < spot_vec.size(); idx++) {
+            lidar.setSpot(spot_vec[idx]);
+            EdgeCloud &edge_cloud = lidar.edgeCloud(cfg.level);
+            std::vector<ceres::ResidualBlockId> stale_blocks;
+            if (cfg.level != active_level[idx]) {
+                stale_blocks.swap(active_blocks[idx]);
+                point_orders[idx] = stratifiedOrder(edge_cloud, init_params, omnicam.kEffectiveRadius, spot_vec[idx]);
+                active_level[idx] = cfg.level;
             }
-            if (steps[1] > 1) {
-                analysis_filepath = analysis_filepath + name[param_idx[1]] + "_";
+            const int num_active = active_blocks[idx].size();
+            const int num_target = std::max(num_active, int(ceil(ratio * edge_cloud.size())));
+            weights[idx] = sqrt(50000.0f / num_target);
+
+            for (int i = num_active; i < num_target; ++i) {
+                auto &point = edge_cloud.points[point_orders[idx][i]];
+                Vec3D lid_point = {point.x, point.y, point.z};
+                active_blocks[idx].push_back(
+                        problem.AddResidualBlock(QuaternionFunctor::Create(lid_point, weights[idx], kde_maps[idx]),
+                                                 loss_function,
+                                                 params, params+((6+1)-3), params+(6+1)));
             }
-            if (steps[2] > 1) {
-                analysis_filepath = analysis_filepath + name[param_idx[2]] + "_";
+            /** removed after the new blocks are in, so the shared loss function stays referenced **/
+            for (auto &block : stale_blocks) {
+                problem.RemoveResidualBlock(block);
             }
-            outfile.open(analysis_filepath + "spot_" + to_string(lidar.spot_idx) + "_bw_" + to_string(int(bandwidth)) + "_result.txt", ios::out);
-            if (steps[0] > 1) {
-                outfile << init_params_vec[param_idx[0]] << "\t" << result_vec[param_idx[0]] << endl;
+            if (MESSAGE_EN && num_target > num_active) {
+                ROS_INFO("Spot %d: %d of %ld edge points active at level %d.", spot_vec[idx], num_target, edge_cloud.size(), cfg.level);
             }
-            if (steps[1] > 1) {
-                outfile << init_params_vec[param_idx[1]] << "\t" << result_vec[param_idx[1]] << endl;
+        }
+
+        /** kde of the next stage is computed while this stage is solved **/
+        std::future<std::vector<std::vector<double>>> next_kde;
+        if (stage + 1 < kStages) {
+            const double next_bandwidth = stages[stage + 1].bandwidth;
+            const MapBackend next_backend = stages[stage + 1].backend;
+            const int next_level = stages[stage + 1].level;
+            next_kde = std::async(std::launch::async, [&omnicam, &spot_vec, next_bandwidth, next_backend, next_level]() {
+                std::vector<std::vector<double>> kde_vals;
+                for (int &spot_idx : spot_vec) {
+                    omnicam.setSpot(spot_idx);
+                    kde_vals.push_back(densityValues(omnicam, next_bandwidth, next_backend, next_level));
+                }
+                return kde_vals;
+            });
+        }
+
+        /********* Stage Options *********/
+        ceres::Solver::Options options = solverOptions();
+        options.max_num_iterations = cfg.max_iterations;
+        options.function_tolerance = cfg.function_tolerance;
+        options.gradient_tolerance = cfg.gradient_tolerance;
+        options.parameter_tolerance = cfg.parameter_tolerance;
+        PlateauCallback plateau(cfg.plateau_window, cfg.plateau_ratio);
+        options.callbacks.push_back(&plateau);
+
+        {
+            TraceSpan solve_span("ceres.Solve", traceSpot(spot_vec));
+            solve_span.pointsIn(problem.NumResidualBlocks());
+            ceres::Solve(options, &problem, &summary);
+        }
+        if (MESSAGE_EN) {
+            std::cout << summary.BriefReport() << "\n";
+            ROS_INFO("Stage %d (bandwidth = %f, level = %d): %d iterations in %f s.",
+                     stage, cfg.bandwidth, cfg.level, int(summary.iterations.size()), timer.getTimeSeconds());
+        }
+
+        result_vec = toResultVec(params);
+        saveResults(record_path, result_vec, cfg.bandwidth, summary.initial_cost, summary.final_cost);
+
+        /** swap the density maps in place, the residual blocks keep their references **/
+        if (next_kde.valid()) {
+            std::vector<std::vector<double>> kde_vals = next_kde.get();
+            const double next_scale = levelScale(stages[stage + 1].level);
+            const int next_rows = omnicam.kImageSize.first * next_scale;
+            const int next_cols = omnicam.kImageSize.second * next_scale;
+            for (int idx = 0; idx < spot_vec.size(); idx++) {
+                kde_maps[idx].setValues(std::move(kde_vals[idx]), next_rows, next_cols, next_scale);
             }
-            if (steps[2] > 1) {
-                outfile << init_params_vec[param_idx[2]] << "\t" << result_vec[param_idx[2]] << endl;
+        }
+
+        if (report != nullptr) {
+            report->stage_time.push_back(timer.getTimeSeconds());
+            report->stage_iterations.push_back(summary.iterations.size());
+            report->stage_evaluations.push_back(summary.num_residual_evaluations + summary.num_jacobian_evaluations);
+            report->stage_cost.push_back(summary.final_cost);
+        }
+    }
+
+    if (report != nullptr) {
+        report->total_time = total_timer.getTimeSeconds();
+        report->final_cost = summary.final_cost;
+    }
+    if (MESSAGE_EN) {
+        ROS_INFO("Continuation solved in %f s, final cost %f.", total_timer.getTimeSeconds(), summary.final_cost);
+    }
+
+    /********* 2D Image Visualization, final stage only *********/
+    for (int k = 0; visualize && k < spot_vec.size(); ++k) {
+        omnicam.setSpot(spot_vec[k]);
+        lidar.setSpot(spot_vec[k]);
+        project2Image(omnicam, lidar, result_vec, stages.back().bandwidth, stages.back().backend);
+    }
+
+    return result_vec;
+}
+
+std::vector<double> MultiStartCalib(OmniProcess &omnicam,
+                                    LidarProcess &lidar,
+                                    std::vector<CalibStage> stages,
+                                    std::vector<int> spot_vec,
+                                    std::vector<double> init_params_vec,
+                                    std::vector<double> lb,
+                                    std::vector<double> ub,
+                                    int num_starts,
+                                    int num_promoted) {
+    TraceSpan span("calib.MultiStartCalib", traceSpot(spot_vec));
+    num_starts = std::max(num_starts, 1);
+    num_promoted = std::max(1, std::min(num_promoted, num_starts));
+
+    /********* Initial Values, the first one is the given guess *********/
+    /** only the extrinsic is perturbed, the intrinsic of a new rig stays close to its nominal values **/
+    std::vector<std::vector<double>> starts(num_starts, init_params_vec);
+    std::mt19937 rng(0);
+    for (int k = 1; k < num_starts; ++k) {
+        for (int i = 0; i < 6; ++i) {
+            std::uniform_real_distribution<double> dist(lb[i], ub[i]);
+            starts[k][i] = dist(rng);
+        }
+    }
+
+    /********* Shared Read-only Data of the Coarse Stage *********/
+    std::vector<DensityMap> kde_maps;
+    omnicam.setView(omnicam.fullview_idx);
+    lidar.setView(lidar.center_view_idx);
+    loadDensityMaps(omnicam, spot_vec, stages[0].bandwidth, kde_maps, stages[0].backend, stages[0].level);
+
+    std::vector<EdgeCloud *> edge_clouds(spot_vec.size());
+    std::vector<double> weights(spot_vec.size());
+    for (int idx = 0; idx < spot_vec.size(); idx++) {
+        lidar.setSpot(spot_vec[idx]);
+        edge_clouds[idx] = &lidar.edgeCloud(stages[0].level);
+        weights[idx] = sqrt(50000.0f / edge_clouds[idx]->size());
+    }
+
+    /********* Coarse Solves, one single-threaded problem per start, intrinsic locked *********/
+    std::vector<std::vector<double>> coarse_results(num_starts);
+    std::vector<double> coarse_costs(num_starts, std::numeric_limits<double>::max());
+    pcl::StopWatch timer;
+    #pragma omp parallel for num_threads(THREADS) schedule(dynamic)
+    for (int k = 0; k < num_starts; ++k) {
+        TraceSpan start_span("calib.coarseStart", traceSpot(spot_vec));
+        Param_D init_params = Eigen::Map<Param_D>(starts[k].data());
+        QParam_D q_vector = toQuaternionParams(init_params);
+        double params[K_INT+(6+1)];
+        memcpy(params, &q_vector(0), q_vector.size() * sizeof(double));
+
+        ceres::Problem problem;
+        addParameterBlocks(problem, params, q_vector, lb, ub, true);
+        ceres::LossFunction *loss_function = new ceres::HuberLoss(0.05);
+        for (int idx = 0; idx < spot_vec.size(); idx++) {
+            for (auto &point : edge_clouds[idx]->points) {
+                Vec3D lid_point = {point.x, point.y, point.z};
+                problem.AddResidualBlock(QuaternionFunctor::Create(lid_point, weights[idx], kde_maps[idx]),
+                                    loss_function,
+                                    params, params+((6+1)-3), params+(6+1));
             }
-            
-            
-            for (int i = -int((steps[0]-1)/2); i < int((steps[0]-1)/2)+1; i++) {
-                offset[0] = i * step_size[0];
-                extrinsic(param_idx[0]) = params_mat(param_idx[0]) + offset[0];
-                
-                for (int j = -int((steps[1]-1)/2); j < int((steps[1]-1)/2)+1; j++) {
-                    offset[1] = j * step_size[1];
-                    extrinsic(param_idx[1]) = params_mat(param_idx[1]) + offset[1];
-
-                    for (int n = -int((steps[2]-1)/2); n < int((steps[2]-1)/2)+1; n++) {
-                        offset[2] = n * step_size[2];
-                        intrinsic(param_idx[2]-6) = params_mat(param_idx[2]) + offset[2];
-                    
-                        double step_res = 0;
-                        int num_valid = 0;
-                        /** Evaluate cost funstion **/
-                        for (auto &point : lidar.edge_cloud_vec[lidar.spot_idx][lidar.view_idx].points) {
-                            double val;
-                            double weight = normalize_weight;
-                            Eigen::Vector4d lidar_point4 = {point.x, point.y, point.z, 1.0};
-                            Mat4D T_mat = transformMat(extrinsic);
-                            Vec3D lidar_point = (T_mat * lidar_point4).head(3);
-                            Vec2D projection = IntrinsicTransform(intrinsic, lidar_point);
-                            kde_interpolators[k].Evaluate(projection(0) * scale, projection(1) * scale, &val);
-                            Pair &bounds = omnicam.kEffectiveRadius;
-                            if ((pow(projection(0) - intrinsic(0), 2) + pow(projection(1) - intrinsic(1), 2)) > pow(bounds.first, 2)
-                             && (pow(projection(0) - intrinsic(0), 2) + pow(projection(1) - intrinsic(1), 2)) < pow(bounds.second, 2)) {
-                                step_res += pow(weight * val, 2);
-                            }
-                        }
-                        if (steps[0] > 1) {
-                            outfile << offset[0] + params_mat(param_idx[0]) << "\t";
-                        }
-                        if (steps[1] > 1) {
-                            outfile << offset[1] + params_mat(param_idx[1]) << "\t";
-                        }
-                        if (steps[2] > 1) {
-                            outfile << offset[2] + params_mat(param_idx[2]) << "\t";
-                        }
-                        outfile << step_res << endl;
-                    }
-                }
+        }
+
+        ceres::Solver::Options options = solverOptions();
+        options.minimizer_progress_to_stdout = false;
+        options.num_threads = 1;
+        options.max_num_iterations = stages[0].max_iterations;
+        options.function_tolerance = stages[0].function_tolerance;
+        options.gradient_tolerance = stages[0].gradient_tolerance;
+        options.parameter_tolerance = stages[0].parameter_tolerance;
+        ceres::Solver::Summary summary;
+        ceres::Solve(options, &problem, &summary);
+
+        coarse_results[k] = toResultVec(params);
+        coarse_costs[k] = summary.final_cost;
+    }
+
+    std::vector<int> ranking(num_starts);
+    std::iota(ranking.begin(), ranking.end(), 0);
+    std::sort(ranking.begin(), ranking.end(), [&coarse_costs](int a, int b) {
+        return coarse_costs[a] < coarse_costs[b];
+    });
+    if (MESSAGE_EN) {
+        ROS_INFO("%d coarse starts (bandwidth = %f) solved in %f s.", num_starts, stages[0].bandwidth, timer.getTimeSeconds());
+        for (int i = 0; i < num_promoted; ++i) {
+            ROS_INFO("Candidate %d: start %d, coarse cost %f.", i, ranking[i], coarse_costs[ranking[i]]);
+        }
+    }
+
+    /********* Fine Stages of the Best Candidates *********/
+    std::vector<CalibStage> fine_stages(stages.begin() + std::min<int>(1, stages.size() - 1), stages.end());
+    fine_stages.back().level = 0; /** as ContinuationCalib runs it **/
+    /** the first fine stage does not depend on the candidate, its maps are computed once **/
+    std::vector<DensityMap> fine_maps;
+    loadDensityMaps(omnicam, spot_vec, fine_stages[0].bandwidth, fine_maps, fine_stages[0].backend, fine_stages[0].level);
+    std::vector<double> best_result;
+    double best_cost = std::numeric_limits<double>::max();
+    for (int i = 0; i < num_promoted; ++i) {
+        CalibReport report;
+        std::vector<double> candidate = coarse_results[ranking[i]];
+        std::vector<double> result = ContinuationCalib(omnicam, lidar, fine_stages, spot_vec, candidate, lb, ub, false,
+                                                       &report, &fine_maps, false);
+        if (report.final_cost < best_cost) {
+            best_cost = report.final_cost;
+            best_result = result;
+        }
+    }
+    if (MESSAGE_EN) {
+        ROS_INFO("Multi-start best final cost %f.", best_cost);
+    }
+
+    /** images of the best candidate only **/
+    for (int &spot_idx : spot_vec) {
+        omnicam.setSpot(spot_idx);
+        lidar.setSpot(spot_idx);
+        project2Image(omnicam, lidar, best_result, fine_stages.back().bandwidth, fine_stages.back().backend);
+    }
+    return best_result;
+}
+
+void loadDensityMaps(OmniProcess &omnicam, std::vector<int> &spot_vec, double bandwidth, std::vector<DensityMap> &maps,
+                     MapBackend backend, int level) {
+    TraceSpan span("calib.loadDensityMaps", traceSpot(spot_vec));
+    const double scale = levelScale(level);
+    const int rows = omnicam.kImageSize.first * scale;
+    const int cols = omnicam.kImageSize.second * scale;
+    /** sized once, the cost terms keep references to the maps **/
+    maps = std::vector<DensityMap>(spot_vec.size());
+    for (int idx = 0; idx < spot_vec.size(); idx++) {
+        omnicam.setSpot(spot_vec[idx]);
+        maps[idx].setValues(densityValues(omnicam, bandwidth, backend, level), rows, cols, scale);
+    }
+}
+
+/** sum of squared kde values over the edge points that land inside the annulus, one value per grid sample **/
+static std::vector<double> evaluateLandscape(const DensityMap &kde_map,
+                                             const PointsSoA &edge_points,
+                                             const Pair &bounds,
+                                             const Param_D &center,
+                                             const std::vector<SweepAxis> &axes) {
+    int num_samples = 1;
+    for (auto &axis : axes) {
+        num_samples *= axis.steps;
+    }
+    std::vector<double> costs(num_samples, 0);
+    const double weight = sqrt(1.0f / edge_points.rows());
+
+    /** the intrinsic is fixed unless swept, then the radius table is built once for all samples **/
+    bool fixed_intrinsic = true;
+    for (auto &axis : axes) {
+        fixed_intrinsic = fixed_intrinsic && (axis.param_idx < 6);
+    }
+    OmniProjector fixed_projector(center.tail(K_INT));
+    fixed_projector.setBounds(bounds.first, bounds.second);
+    if (fixed_intrinsic) {
+        fixed_projector.enableLut(LUT_MAX_ERROR);
+    }
+
+    #pragma omp parallel for num_threads(THREADS) schedule(dynamic)
+    for (int sample = 0; sample < num_samples; ++sample) {
+        /** row-major grid index, the first axis varies slowest **/
+        Param_D params = center;
+        for (int d = axes.size() - 1, rem = sample; d >= 0; --d) {
+            const SweepAxis &axis = axes[d];
+            int offset = rem % axis.steps - (axis.steps - 1) / 2;
+            rem /= axis.steps;
+            params(axis.param_idx) += offset * axis.step_size;
+        }
+
+        /** per-sample transform and projector, hoisted out of the point loop **/
+        Ext_D extrinsic = params.head(6);
+        Int_D intrinsic = params.tail(K_INT);
+        Mat4D T_mat = transformMat(extrinsic);
+        OmniProjector sample_projector;
+        if (!fixed_intrinsic) {
+            sample_projector.setIntrinsic(intrinsic);
+            sample_projector.setBounds(bounds.first, bounds.second);
+        }
+        const OmniProjector &projector = fixed_intrinsic ? fixed_projector : sample_projector;
+        PixelsSoA pixels;
+        std::vector<uint8_t> mask(edge_points.rows());
+        projector.transformProject(T_mat.block<3, 3>(0, 0), T_mat.block<3, 1>(0, 3), edge_points, pixels, mask.data());
+
+        double step_res = 0;
+        for (int i = 0; i < pixels.rows(); ++i) {
+            if (mask[i]) {
+                double val;
+                kde_map.Evaluate(pixels(i, 0), pixels(i, 1), &val);
+                step_res += pow(weight * val, 2);
+            }
+        }
+        costs[sample] = step_res;
+    }
+    return costs;
+}
+
+/** binary layout: "CLS1", int32 ndims, ndims x {int32 param_idx, int32 steps, float64 step_size, float64 result, float64 init}, float64 costs[...] **/
+static void saveLandscape(string &filepath,
+                          const std::vector<SweepAxis> &axes,
+                          std::vector<double> &init_params_vec,
+                          std::vector<double> &result_vec,
+                          std::vector<double> &costs) {
+    ofstream outfile(filepath, ios::out | ios::binary);
+    const int32_t ndims = axes.size();
+    outfile.write("CLS1", 4);
+    outfile.write(reinterpret_cast<const char*>(&ndims), sizeof(ndims));
+    for (auto &axis : axes) {
+        const int32_t header[2] = {axis.param_idx, axis.steps};
+        const double values[3] = {axis.step_size, result_vec[axis.param_idx], init_params_vec[axis.param_idx]};
+        outfile.write(reinterpret_cast<const char*>(header), sizeof(header));
+        outfile.write(reinterpret_cast<const char*>(values), sizeof(values));
+    }
+    outfile.write(reinterpret_cast<const char*>(costs.data()), costs.size() * sizeof(double));
+    outfile.close();
+}
+
+void costLandscape(OmniProcess &omnicam,
+                   LidarProcess &lidar,
+                   std::vector<int> spot_vec,
+                   std::vector<double> init_params_vec,
+                   std::vector<double> result_vec,
+                   double bandwidth,
+                   std::vector<SweepAxis> axes) {
+    ROS_ASSERT_MSG((axes.size() >= 1 && axes.size() <= 3), "Cost landscape supports 1 to 3 axes, %ld given.", axes.size());
+
+    /********* Fisheye KDE *********/
+    std::vector<DensityMap> kde_maps;
+    loadDensityMaps(omnicam, spot_vec, bandwidth, kde_maps);
+
+    /***** Correlation Analysis *****/
+    Param_D params_mat = Eigen::Map<Param_D>(result_vec.data());
+    string analysis_filepath = lidar.kDatasetPath + "/log/";
+    for (auto &axis : axes) {
+        analysis_filepath = analysis_filepath + kParamNames[axis.param_idx] + "_";
+    }
+
+    for (int k = 0; k < spot_vec.size(); k++) {
+        lidar.setSpot(spot_vec[k]);
+        EdgeCloud &edge_cloud = lidar.edge_cloud_vec[lidar.spot_idx][lidar.view_idx];
+        PointsSoA edge_points;
+        toPointsSoA(edge_cloud, edge_points);
+
+        pcl::StopWatch timer;
+        std::vector<double> costs = evaluateLandscape(kde_maps[k], edge_points, omnicam.kEffectiveRadius, params_mat, axes);
+        if (MESSAGE_EN) {
+            ROS_INFO("Cost landscape of %ld samples evaluated in %f s.", costs.size(), timer.getTimeSeconds());
+        }
+
+        string landscape_path = analysis_filepath + "spot_" + to_string(lidar.spot_idx) + "_bw_" + to_string(int(bandwidth)) + "_result.bin";
+        saveLandscape(landscape_path, axes, init_params_vec, result_vec, costs);
+    }
+}
+
+void projectorBenchmark(OmniProcess &omnicam, LidarProcess &lidar, std::vector<double> params_vec) {
+    const int kRepeats = 5;
+    Ext_D extrinsic = Eigen::Map<Param_D>(params_vec.data()).head(6);
+    Int_D intrinsic = Eigen::Map<Param_D>(params_vec.data()).tail(K_INT);
+    Mat4D T_mat = transformMat(extrinsic);
+    pcl::StopWatch timer;
+
+    OmniProjector exact(intrinsic), lut(intrinsic);
+    timer.reset();
+    bool covered = lut.enableLut(LUT_MAX_ERROR);
+    ROS_INFO("Radius table built in %f s, %s %f of cos(theta) covered.",
+             timer.getTimeSeconds(), covered ? "" : "only", lut.lutCoverage());
+
+    CloudI::Ptr spot_cloud(new CloudI);
+    pcl::io::loadPCDFile(lidar.file_path_vec[lidar.spot_idx][lidar.center_view_idx].spot_cloud_path, *spot_cloud);
+    PointsSoA points;
+    PixelsSoA exact_pixels, lut_pixels;
+    toPointsSoA(*spot_cloud, points);
+
+    timer.reset();
+    for (int i = 0; i < kRepeats; ++i) {
+        exact.transformProject(T_mat.block<3, 3>(0, 0), T_mat.block<3, 1>(0, 3), points, exact_pixels);
+    }
+    double exact_time = timer.getTimeSeconds() / kRepeats;
+    timer.reset();
+    for (int i = 0; i < kRepeats; ++i) {
+        lut.transformProject(T_mat.block<3, 3>(0, 0), T_mat.block<3, 1>(0, 3), points, lut_pixels);
+    }
+    double lut_time = timer.getTimeSeconds() / kRepeats;
+
+    Eigen::VectorXd errors = (exact_pixels - lut_pixels).rowwise().norm();
+    ROS_INFO("Spot %d, %ld points: exact %f s, table %f s, speedup %f.",
+             lidar.spot_idx, spot_cloud->size(), exact_time, lut_time, exact_time / lut_time);
+    ROS_INFO("Table error: max %f px, mean %f px, bound %f px.", errors.maxCoeff(), errors.mean(), LUT_MAX_ERROR);
+}
+
+void compareCostMaps(OmniProcess &omnicam,
+                     LidarProcess &lidar,
+                     std::vector<int> spot_vec,
+                     std::vector<double> params_vec,
+                     std::vector<double> lb,
+                     std::vector<double> ub,
+                     double bandwidth) {
+    Ext_D extrinsic = Eigen::Map<Param_D>(params_vec.data()).head(6);
+    Int_D intrinsic = Eigen::Map<Param_D>(params_vec.data()).tail(K_INT);
+    Mat4D T_mat = transformMat(extrinsic);
+    pcl::StopWatch timer;
+    omnicam.setView(omnicam.fullview_idx);
+    lidar.setView(lidar.center_view_idx);
+
+    for (int &spot_idx : spot_vec) {
+        omnicam.setSpot(spot_idx);
+        lidar.setSpot(spot_idx);
+
+        /********* Map Generation *********/
+        timer.reset();
+        std::vector<double> kde_vals = omnicam.Kde(bandwidth, KDE_SCALE);
+        double kde_time = timer.getTimeSeconds();
+        timer.reset();
+        std::vector<double> dt_vals = omnicam.DistanceMap(omnicam.kDistTruncation, KDE_SCALE);
+        double dt_time = timer.getTimeSeconds();
+
+        /********* Projection Error Metric *********/
+        EdgeCloud::Ptr fisheye_edge_cloud (new EdgeCloud(omnicam.edge_cloud_vec[spot_idx][omnicam.view_idx]));
+        EdgeCloud::Ptr lidar_edge_cloud (new EdgeCloud);
+        pcl::transformPointCloud(lidar.edge_cloud_vec[spot_idx][lidar.view_idx], *lidar_edge_cloud, T_mat);
+        for (auto &point : lidar_edge_cloud->points) {
+            Vec3D lidar_point(point.x, point.y, point.z);
+            Vec2D projection = IntrinsicTransform(intrinsic, lidar_point);
+            point.x = projection(0);
+            point.y = projection(1);
+            point.z = 0;
+        }
+
+        timer.reset();
+        float kdtree_error = lidar.getEdgeDistance(fisheye_edge_cloud, lidar_edge_cloud, 30);
+        double kdtree_time = timer.getTimeSeconds();
+        timer.reset();
+        float dt_error = lidar.getEdgeDistance(omnicam.DistanceImage(1), lidar_edge_cloud, 30);
+        double lookup_time = timer.getTimeSeconds();
+
+        ROS_INFO("Spot %d map generation: kde (bandwidth = %f) %f s, distance transform %f s.",
+                 spot_idx, bandwidth, kde_time, dt_time);
+        ROS_INFO("Spot %d projection error: kd-tree %f px in %f s, distance transform %f px in %f s.",
+                 spot_idx, kdtree_error, kdtree_time, dt_error, lookup_time);
+    }
+
+    /********* Cost Sweeps of each backend from the same initial values *********/
+    /** the maps are evaluated directly, no solver run, so no result file or fusion image is touched **/
+    const int kSweepSteps = 21;
+    Param_D params_mat = Eigen::Map<Param_D>(params_vec.data());
+    for (MapBackend backend : {KDE_BACKEND, DT_BACKEND}) {
+        const char *backend_name = (backend == DT_BACKEND) ? "Distance transform" : "Kde";
+        std::vector<DensityMap> maps;
+        timer.reset();
+        loadDensityMaps(omnicam, spot_vec, bandwidth, maps, backend);
+        ROS_INFO("%s maps of %ld spots generated in %f s.", backend_name, spot_vec.size(), timer.getTimeSeconds());
+
+        for (int k = 0; k < spot_vec.size(); k++) {
+            lidar.setSpot(spot_vec[k]);
+            PointsSoA edge_points;
+            toPointsSoA(lidar.edge_cloud_vec[lidar.spot_idx][lidar.view_idx], edge_points);
+            timer.reset();
+            /** one sweep over [lb, ub] per parameter, the landscape peaks where the edges align **/
+            for (int i = 0; i < params_vec.size(); ++i) {
+                SweepAxis axis = {i, kSweepSteps, (ub[i] - lb[i]) / (kSweepSteps - 1)};
+                std::vector<double> costs = evaluateLandscape(maps[k], edge_points, omnicam.kEffectiveRadius, params_mat, {axis});
+                const int best = std::max_element(costs.begin(), costs.end()) - costs.begin();
+                ROS_INFO("Spot %d %s %s: cost at init %f, peak %f at offset %f.", lidar.spot_idx, backend_name,
+                         kParamNames[i], costs[(kSweepSteps - 1) / 2], costs[best],
+                         (best - (kSweepSteps - 1) / 2) * axis.step_size);
             }
-            outfile.close();
+            ROS_INFO("Spot %d %s sweeps evaluated in %f s.", lidar.spot_idx, backend_name, timer.getTimeSeconds());
+        }
+    }
+}
+
+void costAnalysis(OmniProcess &omnicam,
+                  LidarProcess &lidar,
+                  std::vector<int> spot_vec,
+                  std::vector<double> init_params_vec,
+                  std::vector<double> result_vec,
+                  double bandwidth) {
+    /********* Fisheye KDE *********/
+    std::vector<DensityMap> kde_maps;
+    loadDensityMaps(omnicam, spot_vec, bandwidth, kde_maps);
+
+    /***** Correlation Analysis *****/
+    Param_D params_mat = Eigen::Map<Param_D>(result_vec.data());
+    const double step_size[3] = {0.0002, 0.001, 0.01};
+
+    for (int k = 0; k < spot_vec.size(); k++) {
+        lidar.setSpot(spot_vec[k]);
+        EdgeCloud &edge_cloud = lidar.edge_cloud_vec[lidar.spot_idx][lidar.view_idx];
+        PointsSoA edge_points;
+        toPointsSoA(edge_cloud, edge_points);
+
+        /** single parameter sweeps of the extrinsic parameters **/
+        for (int m = 0; m < 6; m++) {
+            std::vector<SweepAxis> axes = {{m, 201, step_size[m / 3]}};
+            std::vector<double> costs = evaluateLandscape(kde_maps[k], edge_points, omnicam.kEffectiveRadius, params_mat, axes);
+
+            string landscape_path = lidar.kDatasetPath + "/log/" + kParamNames[m] + "_spot_" + to_string(lidar.spot_idx)
+                                  + "_bw_" + to_string(int(bandwidth)) + "_result.bin";
+            saveLandscape(landscape_path, axes, init_params_vec, result_vec, costs);
         }
     }
 }
@@ -0,0 +1,129 @@
+/** headings **/
+#include <param_source.h>
+/** basic **/
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+static string trim(const string &str) {
+    const size_t begin = str.find_first_not_of(" \t\r");
+    if (begin == string::npos) {
+        return "";
+    }
+    const size_t end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+}
+
+/** drops a comment that is not inside a quoted string **/
+static string stripComment(const string &line) {
+    char quote = 0;
+    for (int i = 0; i < line.size(); ++i) {
+        if (quote) {
+            quote = (line[i] == quote) ? 0 : quote;
+        }
+        else if (line[i] == '"' || line[i] == '\'') {
+            quote = line[i];
+        }
+        else if (line[i] == '#') {
+            return line.substr(0, i);
+        }
+    }
+    return line;
+}
+
+YamlParams::YamlParams(const std::string &path) {
+    std::ifstream file(path);
+    good_ = file.is_open();
+    string line, section;
+    while (std::getline(file, line)) {
+        line = stripComment(line);
+        const string content = trim(line);
+        if (content.empty() || content.compare(0, 3, "---") == 0) {
+            continue;
+        }
+        const size_t colon = content.find(':');
+        if (colon == string::npos) {
+            continue;
+        }
+        const bool indented = line.find_first_not_of(" \t") > 0;
+        const string key = trim(content.substr(0, colon));
+        string value = trim(content.substr(colon + 1));
+        if (!indented) {
+            section = value.empty() ? key : "";
+            if (value.empty()) {
+                continue;
+            }
+        }
+        if (value.size() >= 2 && (value.front() == '"' || value.front() == '\'') && value.back() == value.front()) {
+            value = value.substr(1, value.size() - 2);
+        }
+        values_[(indented && !section.empty()) ? section + "/" + key : key] = value;
+    }
+}
+
+bool YamlParams::get(const std::string &key, std::string &value) const {
+    auto it = values_.find(key);
+    if (it == values_.end()) {
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
+bool YamlParams::get(const std::string &key, double &value) const {
+    string str;
+    if (!get(key, str)) {
+        return false;
+    }
+    char *end = nullptr;
+    const double val = strtod(str.c_str(), &end);
+    if (end == str.c_str()) {
+        return false;
+    }
+    value = val;
+    return true;
+}
+
+bool YamlParams::get(const std::string &key, int &value) const {
+    double val;
+    if (!get(key, val)) {
+        return false;
+    }
+    value = int(val); /** 2.0e+6 style counts are accepted **/
+    return true;
+}
+
+bool YamlParams::get(const std::string &key, bool &value) const {
+    string str;
+    if (!get(key, str)) {
+        return false;
+    }
+    if (str == "true" || str == "True" || str == "TRUE" || str == "1") {
+        value = true;
+        return true;
+    }
+    if (str == "false" || str == "False" || str == "FALSE" || str == "0") {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+bool YamlParams::get(const std::string &key, std::vector<int> &value) const {
+    string str;
+    if (!get(key, str) || str.size() < 2 || str.front() != '[' || str.back() != ']') {
+        return false;
+    }
+    std::vector<int> vals;
+    std::stringstream stream(str.substr(1, str.size() - 2));
+    string item;
+    while (std::getline(stream, item, ',')) {
+        item = trim(item);
+        if (!item.empty()) {
+            vals.push_back(std::stoi(item));
+        }
+    }
+    value = vals;
+    return true;
+}
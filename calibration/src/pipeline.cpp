@@ -0,0 +1,358 @@
+/** basic **/
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+/** heading **/
+#include "pipeline.h"
+#include "optimization.h"
+#include "common_lib.h"
+/** namespace **/
+using namespace std;
+
+PipelineConfig PipelineConfig::load(const ParamSource &params, const std::string &pkg_path) {
+    PipelineConfig config;
+    config.lidar = LidarProcess::loadConfig(params, pkg_path);
+    config.omni = OmniProcess::loadConfig(params, pkg_path);
+    params.get("switch/kGenerateLidarEdge", config.generate_lidar_edge);
+    params.get("switch/kExposureFusion", config.exposure_fusion);
+    params.get("switch/kGenerateOmniEdge", config.generate_omni_edge);
+    params.get("switch/kGenerateViewCloud", config.generate_view_cloud);
+    params.get("switch/kStitchViewCloud", config.stitch_view_cloud);
+    params.get("switch/kGimbalStitch", config.gimbal_stitch);
+    params.get("switch/kGenerateSpotCloud", config.generate_spot_cloud);
+    params.get("switch/kSpotColorization", config.spot_colorization);
+    params.get("switch/kStitchSpotCloud", config.stitch_spot_cloud);
+    params.get("switch/kGlobalMapping", config.global_mapping);
+    params.get("switch/kGlobalColoredMapping", config.global_colored_mapping);
+    params.get("switch/kCeresOptimization", config.ceres_optimization);
+    params.get("switch/kMultiSpotsOptimization", config.multi_spots_optimization);
+    params.get("switch/kAnalysis", config.params_analysis);
+    params.get("switch/kContinuation", config.continuation);
+    params.get("switch/kSubsampling", config.subsampling);
+    params.get("switch/kSubsamplingCompare", config.subsampling_compare);
+    params.get("switch/kMultiStart", config.multi_start);
+    params.get("switch/kCostMapCompare", config.cost_map_compare);
+    params.get("switch/kDtRefinement", config.dt_refinement);
+    params.get("switch/kPyramid", config.pyramid);
+    params.get("switch/kProjectorBenchmark", config.projector_benchmark);
+    params.get("multistart/kNumStarts", config.num_starts);
+    params.get("multistart/kNumPromoted", config.num_promoted);
+    params.get("switch/kUniformSampling", config.uniform_sampling);
+    params.get("analysis/kLandscapeParams", config.landscape_params);
+    params.get("spot/kOneSpot", config.one_spot);
+    params.get("trace/kTrace", config.trace);
+    params.get("trace/kTraceFile", config.trace_file);
+    return config;
+}
+
+int runPipeline(const PipelineConfig &config) {
+    /***** Initial Parameters *****/
+    std::vector<double> params_init = {
+        M_PI + 0.02, 0.02, -M_PI/2, /** Rx Ry Rz **/
+        0.27, 0.00, 0.03, /** tx ty tz **/
+        1023.0, 1201.0, /** u0 v0 **/
+        616.7214056132 * M_PI, -616.7214056132, 0.0, 0.0, 0.0,
+        1, 0, 0 /** c, d, e **/
+    }; /** the two sensors are parallel on y axis **/
+    std::vector<double> params_calib(params_init);
+    std::vector<double> dev = {
+        1e-1, 1e-1, 1e-1,
+        5e-2, 5e-2, 5e-2,
+        5e+0, 5e+0,
+        160e+0, 80e+0, 40e+0, 20+0, 10e+0,
+        1e-2, 1e-2, 1e-2
+    };
+
+    /***** Class Object Initialization *****/
+    OmniProcess omnicam(config.omni);
+    LidarProcess lidar(config.lidar);
+    lidar.ext_ = Eigen::Map<Param_D>(params_init.data()).head(6);
+    omnicam.int_ = Eigen::Map<Param_D>(params_init.data()).tail(K_INT);
+
+    /***** Data Folder Check **/
+    for (int i = 0; i < lidar.num_spots; ++i) {
+        string spot_path = lidar.kDatasetPath + "/spot" + to_string(i);
+        CheckFolder(spot_path);
+        string log_path = lidar.kDatasetPath + "/log";
+        CheckFolder(log_path);
+        for (int j = 0; j < lidar.num_views; ++j) {
+            int view_degree = lidar.view_angle_init + lidar.view_angle_step * j;
+            string view_path = spot_path + "/" + to_string(view_degree);
+            string center_view_path = spot_path + "/recon";
+            CheckFolder(view_path);
+            CheckFolder(view_path + "/bags");
+            CheckFolder(view_path + "/images");
+            CheckFolder(view_path + "/edges");
+            CheckFolder(view_path + "/outputs");
+            CheckFolder(view_path + "/outputs/omni_outputs");
+            CheckFolder(view_path + "/outputs/lidar_outputs");
+            CheckFolder(view_path + "/results");
+            CheckFolder(center_view_path);
+        }
+    }
+    if (config.trace) {
+        /** written with the summary table when main returns **/
+        Tracer::instance().enable(lidar.kDatasetPath + "/log/" + config.trace_file);
+    }
+
+    /***** Registration, Colorization and Mapping *****/
+    std::vector<int> registration_spots;
+    for (int i = 0; i < lidar.num_spots; ++i) {
+        if (config.one_spot == -1 || config.one_spot == i) {
+            registration_spots.push_back(i);
+            lidar.setSpot(i);
+            for (int j = 0; j < lidar.num_views; ++j) {
+                lidar.setView(j);
+                if (config.generate_view_cloud) {
+                    lidar.generateViewCloud();
+                }
+            }
+            for (int j = 0; j < lidar.num_views; ++j) {
+                lidar.setView(j);
+                if (config.stitch_view_cloud && !config.gimbal_stitch && j != lidar.center_view_idx) {
+                    lidar.stitchViewCloud();
+                }
+            }
+            if (config.generate_spot_cloud && !(config.stitch_view_cloud && config.gimbal_stitch)) {
+                lidar.generateSpotCloud();
+            }
+        }
+    }
+    /** the gimbal fit is joint over all spots, the spot clouds follow it **/
+    if (config.stitch_view_cloud && config.gimbal_stitch && !registration_spots.empty()) {
+        lidar.stitchGimbalViews(registration_spots);
+        for (int i : registration_spots) {
+            lidar.setSpot(i);
+            if (config.generate_spot_cloud) {
+                lidar.generateSpotCloud();
+            }
+        }
+    }
+
+    /***** Data Process *****/
+    
+    for (int i = 0; i < lidar.num_spots; ++i) {
+        if (config.one_spot == -1 || config.one_spot == i) {
+            if (config.exposure_fusion) {
+                omnicam.setSpot(i);
+                for (int j = 0; j < omnicam.num_views; ++j) {
+                    omnicam.setView(j);
+                    omnicam.fuseExposures();
+                }
+            }
+            if (config.generate_lidar_edge) {
+                CloudI::Ptr lidar_cart_cloud(new CloudI);
+                CloudI::Ptr lidar_polar_cloud(new CloudI);
+                lidar.setSpot(i);
+                lidar.setView(lidar.center_view_idx);
+                lidar.lidarToSphere(lidar_cart_cloud, lidar_polar_cloud);
+                lidar.sphereToPlane(lidar_polar_cloud);
+                lidar.edgeExtraction();
+                lidar.generateEdgeCloud(lidar_cart_cloud);
+            }
+            if (config.generate_omni_edge) {
+                omnicam.setSpot(i);
+                omnicam.setView(omnicam.fullview_idx);
+                omnicam.loadImage(true);
+                omnicam.edgeExtraction();
+                omnicam.generateEdgeCloud(); 
+
+            }
+        }
+    }
+    
+
+    /***** Calibration and Optimization Cost Analysis *****/
+    if (config.ceres_optimization) {
+        cout << "----------------- Ceres Optimization ---------------------" << endl;
+        std::vector<double> lb(dev.size()), ub(dev.size());
+        std::vector<double> bw = {32, 16, 4, 1};
+        std::vector<CalibStage> stages = {
+            /** bandwidth, max iterations, function / gradient / parameter tolerance, plateau window, plateau ratio **/
+            {32, 50, 1e-6, 1e-4, 1e-6, 5, 1e-3},
+            {16, 50, 1e-6, 1e-4, 1e-6, 5, 1e-3},
+            {4, 100, 1e-8, 1e-5, 1e-8, 5, 1e-4},
+            {1, 200, 1e-12, 1e-6, 1e-8, 0, 0}
+        };
+        if (config.dt_refinement) {
+            stages.back().backend = DT_BACKEND;
+        }
+        if (config.pyramid) {
+            std::vector<int> levels = {2, 1, 0, 0}; /** quarter and half resolution for the wide kernels **/
+            for (int i = 0; i < stages.size(); ++i) {
+                stages[i].level = levels[i];
+            }
+        }
+        std::vector<CalibStage> sampled_stages(stages);
+        std::vector<double> sample_ratios = {0.125, 0.25, 0.5, 1.0}; /** fraction of edge points per stage **/
+        for (int i = 0; i < sampled_stages.size(); ++i) {
+            sampled_stages[i].sample_ratio = sample_ratios[i];
+        }
+        for (int i = 0; i < dev.size(); ++i) {
+            ub[i] = params_init[i] + dev[i];
+            lb[i] = params_init[i] - dev[i];
+        }
+        Eigen::Matrix<double, 3, 17> params_mat;
+        params_mat.row(0) = Eigen::Map<Eigen::Matrix<double, 1, 17>>(params_init.data());
+        params_mat.row(1) = params_mat.row(0) - Eigen::Map<Eigen::Matrix<double, 1, 17>>(dev.data());
+        params_mat.row(2) = params_mat.row(0) + Eigen::Map<Eigen::Matrix<double, 1, 17>>(dev.data());
+
+        /********* Initial Visualization *********/
+        std::vector<int> spot_vec;
+
+        for (int spot = 0; spot < lidar.num_spots; ++spot) {
+            if (config.one_spot == -1 || config.one_spot == spot) {
+                omnicam.setSpot(spot);
+                lidar.setSpot(spot);
+                omnicam.setView(omnicam.fullview_idx);
+                lidar.setView(lidar.center_view_idx);
+                omnicam.ReadEdge();
+                lidar.ReadEdge();
+                
+                project2Image(omnicam, lidar, params_init, 0); /** 0 - invalid bandwidth to initialize the visualization **/
+                string record_path = lidar.file_path_vec[lidar.spot_idx][lidar.view_idx].result_folder_path
+                                    + "/result_spot" + to_string(lidar.spot_idx) + ".txt";
+                saveResults(record_path, params_init, 0, 0, 0);
+            }
+        }
+
+        std::vector<int> landscape_params = config.landscape_params;
+
+        for (int spot = 0; spot < lidar.num_spots; ++spot) {
+            if (config.one_spot == -1 || config.one_spot == spot) {
+                if (config.multi_spots_optimization && config.one_spot == -1) {
+                    vector<int> spot_init_vec(lidar.num_spots);
+                    std::iota(spot_init_vec.begin(), spot_init_vec.end(), 0);
+                    spot_vec = spot_init_vec;
+                }
+                else {
+                    spot_vec = {spot};
+                }
+
+                /** per-bandwidth solves are kept for the cost analysis, which needs every stage result **/
+                if (config.multi_start && !config.params_analysis) {
+                    params_calib = MultiStartCalib(omnicam, lidar, stages, spot_vec, params_calib, lb, ub,
+                                                   config.num_starts, config.num_promoted);
+                    if (config.multi_spots_optimization) { break;}
+                    continue;
+                }
+                if (config.continuation && !config.params_analysis) {
+                    if (config.subsampling && config.subsampling_compare) {
+                        /** full-set baseline from the same initial values, for time-to-solution and final cost **/
+                        CalibReport full_report, sampled_report;
+                        std::vector<double> full_params = ContinuationCalib(omnicam, lidar, stages, spot_vec, params_calib, lb, ub, false, &full_report);
+                        params_calib = ContinuationCalib(omnicam, lidar, sampled_stages, spot_vec, params_calib, lb, ub, false, &sampled_report);
+                        double max_diff = 0;
+                        for (int i = 0; i < params_calib.size(); ++i) {
+                            max_diff = std::max(max_diff, fabs(params_calib[i] - full_params[i]));
+                        }
+                        ROS_INFO("Full set: %f s, final cost %f. Subsampled: %f s, final cost %f. Max parameter difference %f.",
+                                 full_report.total_time, full_report.final_cost,
+                                 sampled_report.total_time, sampled_report.final_cost, max_diff);
+                    }
+                    else {
+                        params_calib = ContinuationCalib(omnicam, lidar, config.subsampling ? sampled_stages : stages,
+                                                         spot_vec, params_calib, lb, ub, false);
+                    }
+                    if (config.multi_spots_optimization) { break;}
+                    continue;
+                }
+
+                for (int i = 0; i < bw.size(); i++) {
+                    double bandwidth = bw[i];
+                    vector<double> init_params_vec(params_calib);
+                    MapBackend backend = (config.dt_refinement && i == bw.size() - 1) ? DT_BACKEND : KDE_BACKEND;
+                    params_calib = QuaternionCalib(omnicam, lidar, bandwidth, spot_vec, params_calib, lb, ub, false, backend);
+                    // if (i == bw.size() - 1) {
+                    //     params_calib = QuaternionCalib(fisheye, lidar, bandwidth, spot_vec, params_calib, lb, ub, true);
+                    // }
+                    if (config.params_analysis) {
+                        costAnalysis(omnicam, lidar, spot_vec, init_params_vec, params_calib, bandwidth);
+                        if (!landscape_params.empty()) {
+                            std::vector<SweepAxis> axes;
+                            for (int &idx : landscape_params) {
+                                axes.push_back({idx, 201, (idx < 3) ? 0.0002 : ((idx < 6) ? 0.001 : 0.01)});
+                            }
+                            costLandscape(omnicam, lidar, spot_vec, init_params_vec, params_calib, bandwidth, axes);
+                        }
+                    }
+                }
+
+                if (config.multi_spots_optimization) { break;}
+            }
+        }
+
+        /** timing and accuracy of the kde and distance transform maps around the calibrated values **/
+        if (config.cost_map_compare) {
+            compareCostMaps(omnicam, lidar, spot_vec, params_calib, lb, ub, bw.back());
+        }
+    }
+
+    /***** Registration, Colorization and Mapping *****/
+    /** spot **/
+        if (config.spot_colorization) {
+        cout << "----------------- Spot Cloud Colorization ---------------------" << endl;
+        // lh3_global:
+        // params_calib = {
+        //         0.000472, -3.139975, 1.563091, /** Rx Ry Rz **/
+        //         0.274670, -0.012239, 0.034630, /** tx ty tz **/
+        //         1022.412883, 1199.429484,       /** u0, v0 **/
+        //         1995.940476, -696.447201, 27.426648, 2.044011, -1.568044, 
+        //         0.999972, -0.008120, 0.007628
+        // }
+        // parking:
+        // params_calib = {
+        //         0.001335, -3.139391, 1.559892,
+        //         0.281820, -0.006560, 0.044851,
+        //         1024.081111, 1197.734465,
+        //         1986.768694, -691.831611, 37.178636, -6.742971, 0.362401,
+        //         1.000177, -0.005878, 0.006144
+        // };
+        // bs_hall:
+        params_calib = {
+                0.000990, -3.138274, 1.560729,
+                0.291672, -0.005141, 0.038923,
+                1021.553425, 1196.789762,
+                1995.359807, -666.475065, -13.940682, 20.000000, -4.049823,
+                0.998262, -0.005735, 0.005314
+        };
+        
+        for (int i = 0; i < lidar.num_spots; ++i) {
+            if (config.one_spot == -1 || config.one_spot == i) {
+                omnicam.setSpot(i);
+                lidar.setSpot(i);
+                omnicam.setView(lidar.center_view_idx);
+                lidar.setView(lidar.center_view_idx);
+                if (config.projector_benchmark) {
+                    projectorBenchmark(omnicam, lidar, params_calib);
+                }
+                SpotColorization(omnicam, lidar, params_calib);
+            }
+        }
+    }
+
+    if (config.stitch_spot_cloud) {
+        cout << "----------------- Spot Registration ---------------------" << endl;
+        for (int i = lidar.num_spots - 1; i > 0; --i) {
+            if (config.one_spot == -1 || config.one_spot == i) {
+                lidar.setSpot(i);
+                lidar.stitchSpotCloud();
+            }
+        }
+        
+    }
+
+    if (config.global_mapping) {
+        cout << "----------------- Global Mapping ---------------------" << endl;
+        lidar.generateFineMap(config.uniform_sampling);
+    }
+
+    if (config.global_colored_mapping) {
+        cout << "----------------- Global Colored Mapping ---------------------" << endl;
+        lidar.generateColoredFineMap(config.uniform_sampling);
+    }
+
+    return 0;
+}
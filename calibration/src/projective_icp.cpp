@@ -0,0 +1,162 @@
+/** headings **/
+#include <projective_icp.h>
+/** basic **/
+#include <algorithm>
+#include <cmath>
+#include <limits>
+/** eigen **/
+#include <Eigen/Geometry>
+
+using namespace std;
+
+ProjectiveIcp::ProjectiveIcp(int rows, int cols)
+    : rows_(rows), cols_(cols), row_step_(M_PI / rows), col_step_((M_PI * 2) / cols) {}
+
+bool ProjectiveIcp::cell(const Eigen::Vector3d &point, int &row, int &col) const {
+    const double range = point.norm();
+    if (!std::isfinite(range) || range == 0) {
+        return false;
+    }
+    row = std::clamp(int((M_PI - acos(point.z() / range)) / row_step_), 0, rows_ - 1);
+    col = std::clamp(int((atan2(point.y(), point.x()) + M_PI) / col_step_), 0, cols_ - 1);
+    return true;
+}
+
+void ProjectiveIcp::setInputTarget(const CloudI::ConstPtr &target) {
+    target_ = target;
+    range_image_.assign(rows_ * cols_, -1);
+    std::vector<float> ranges(rows_ * cols_, std::numeric_limits<float>::max());
+    for (int i = 0; i < target->size(); ++i) {
+        const Eigen::Vector3d point = target->points[i].getVector3fMap().cast<double>();
+        int row, col;
+        if (!cell(point, row, col)) {
+            continue;
+        }
+        const int idx = row * cols_ + col;
+        if (point.norm() < ranges[idx]) {
+            ranges[idx] = point.norm();
+            range_image_[idx] = i;
+        }
+    }
+
+    SphericalNormalEstimation normal_est(rows_, cols_);
+    normal_est.setRadius(normal_radius_);
+    normal_est.setInputCloud(target);
+    normal_est.compute(normals_);
+}
+
+/** nearest target point with a valid normal in the 3 x 3 cells around the projection, wrapped in azimuth **/
+int ProjectiveIcp::associate(const Eigen::Vector3d &point, double &dist_sq) const {
+    int row, col;
+    if (!cell(point, row, col)) {
+        return -1;
+    }
+    int best = -1;
+    dist_sq = max_corr_dist_ * max_corr_dist_;
+    for (int dr = -1; dr <= 1; ++dr) {
+        const int r = row + dr;
+        if (r < 0 || r >= rows_) {
+            continue;
+        }
+        for (int dc = -1; dc <= 1; ++dc) {
+            const int c = (col + dc + cols_) % cols_;
+            const int idx = range_image_[r * cols_ + c];
+            if (idx < 0 || !std::isfinite(normals_.points[idx].normal_x)) {
+                continue;
+            }
+            const double d = (target_->points[idx].getVector3fMap().cast<double>() - point).squaredNorm();
+            if (d < dist_sq) {
+                dist_sq = d;
+                best = idx;
+            }
+        }
+    }
+    return best;
+}
+
+bool ProjectiveIcp::correspondence(const Eigen::Vector3d &point, Eigen::Vector3d &target_point, Eigen::Vector3d &normal) const {
+    double dist_sq;
+    const int idx = associate(point, dist_sq);
+    if (idx < 0) {
+        return false;
+    }
+    target_point = target_->points[idx].getVector3fMap().cast<double>();
+    normal << normals_.points[idx].normal_x, normals_.points[idx].normal_y, normals_.points[idx].normal_z;
+    return true;
+}
+
+bool ProjectiveIcp::align(const CloudI &source, const Mat4F &init_trans_mat, Mat4F &result_trans_mat) {
+    typedef Eigen::Matrix<double, 6, 6> Mat6D;
+    typedef Eigen::Matrix<double, 6, 1> Vec6D;
+    const int kNumPoints = source.size();
+    Mat4D trans_mat = init_trans_mat.cast<double>();
+    correspondences_ = 0;
+    fitness_ = std::numeric_limits<double>::max();
+
+    for (iterations_ = 0; iterations_ < max_iterations_; ) {
+        const Mat3D R = trans_mat.topLeftCorner(3, 3);
+        const Vec3D t = trans_mat.topRightCorner(3, 1);
+        Mat6D JtJ = Mat6D::Zero();
+        Vec6D Jtr = Vec6D::Zero();
+        double dist_sum = 0;
+        int num_corr = 0;
+
+        /** linearized point-to-plane residual n . (p + w x p + dt - q), per thread sums merged at the end **/
+        #pragma omp parallel num_threads(THREADS)
+        {
+            Mat6D JtJ_local = Mat6D::Zero();
+            Vec6D Jtr_local = Vec6D::Zero();
+            double dist_local = 0;
+            int num_local = 0;
+            #pragma omp for schedule(static) nowait
+            for (int i = 0; i < kNumPoints; ++i) {
+                const Vec3D p = R * source.points[i].getVector3fMap().cast<double>() + t;
+                double dist_sq;
+                const int idx = associate(p, dist_sq);
+                if (idx < 0) {
+                    continue;
+                }
+                const pcl::Normal &normal = normals_.points[idx];
+                const Vec3D n(normal.normal_x, normal.normal_y, normal.normal_z);
+                const Vec3D q = target_->points[idx].getVector3fMap().cast<double>();
+                Vec6D J;
+                J.head(3) = p.cross(n);
+                J.tail(3) = n;
+                const double r = n.dot(p - q);
+                JtJ_local.noalias() += J * J.transpose();
+                Jtr_local.noalias() += J * r;
+                dist_local += dist_sq;
+                ++num_local;
+            }
+            #pragma omp critical
+            {
+                JtJ += JtJ_local;
+                Jtr += Jtr_local;
+                dist_sum += dist_local;
+                num_corr += num_local;
+            }
+        }
+
+        correspondences_ = num_corr;
+        if (num_corr < 6) {
+            result_trans_mat = trans_mat.cast<float>();
+            return false;
+        }
+        fitness_ = dist_sum / num_corr;
+        ++iterations_;
+
+        const Vec6D delta = JtJ.ldlt().solve(-Jtr);
+        Mat4D update = Mat4D::Identity();
+        const double angle = delta.head(3).norm();
+        if (angle > 0) {
+            update.topLeftCorner(3, 3) = Eigen::AngleAxisd(angle, delta.head(3) / angle).toRotationMatrix();
+        }
+        update.topRightCorner(3, 1) = delta.tail(3);
+        trans_mat = update * trans_mat;
+        if (angle < epsilon_ && delta.tail(3).norm() < epsilon_) {
+            break;
+        }
+    }
+    result_trans_mat = trans_mat.cast<float>();
+    return true;
+}
@@ -0,0 +1,195 @@
+/** headings **/
+#include <spherical_normals.h>
+/** basic **/
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+SphericalNormalEstimation::SphericalNormalEstimation(int rows, int cols)
+    : rows_(rows), cols_(cols), row_step_(M_PI / rows), col_step_((M_PI * 2) / cols) {}
+
+/** same cell layout as sphereToPlane: theta from pi downwards, phi from -pi upwards **/
+bool SphericalNormalEstimation::cell(const PointI &point, int &row, int &col, double &range) const {
+    range = point.getVector3fMap().cast<double>().norm();
+    if (!std::isfinite(range) || range == 0) {
+        return false;
+    }
+    double theta = acos(point.z / range);
+    double phi = atan2(point.y, point.x);
+    row = std::clamp(int((M_PI - theta) / row_step_), 0, rows_ - 1);
+    col = std::clamp(int((phi + M_PI) / col_step_), 0, cols_ - 1);
+    return true;
+}
+
+void SphericalNormalEstimation::setInputCloud(const CloudI::ConstPtr &cloud) {
+    cloud_ = cloud;
+    const int kNumPoints = cloud->size();
+    const int kStride = (cols_ + 1) * kChannels;
+    point_rows_.assign(kNumPoints, -1);
+    point_cols_.assign(kNumPoints, -1);
+    point_ranges_.assign(kNumPoints, 0);
+    integral_.assign(size_t(rows_ + 1) * kStride, 0);
+
+    /** moments per cell, stored at (row + 1, col + 1) of the integral layout **/
+    for (int i = 0; i < kNumPoints; ++i) {
+        const PointI &point = cloud->points[i];
+        int row, col;
+        double range;
+        if (!cell(point, row, col, range)) {
+            continue;
+        }
+        point_rows_[i] = row;
+        point_cols_[i] = col;
+        point_ranges_[i] = range;
+        const double x = point.x, y = point.y, z = point.z;
+        double *m = &integral_[size_t(row + 1) * kStride + (col + 1) * kChannels];
+        m[0] += 1;
+        m[1] += x; m[2] += y; m[3] += z;
+        m[4] += x * x; m[5] += x * y; m[6] += x * z;
+        m[7] += y * y; m[8] += y * z; m[9] += z * z;
+        m[10] += range; m[11] += range * range;
+    }
+
+    /** prefix sums along the rows in parallel, then down the columns **/
+    #pragma omp parallel for num_threads(THREADS)
+    for (int row = 1; row <= rows_; ++row) {
+        double *line = &integral_[size_t(row) * kStride];
+        for (int col = 1; col <= cols_; ++col) {
+            for (int c = 0; c < kChannels; ++c) {
+                line[col * kChannels + c] += line[(col - 1) * kChannels + c];
+            }
+        }
+    }
+    for (int row = 1; row <= rows_; ++row) {
+        double *line = &integral_[size_t(row) * kStride];
+        const double *prev = line - kStride;
+        #pragma omp parallel for num_threads(THREADS)
+        for (int i = 0; i < kStride; ++i) {
+            line[i] += prev[i];
+        }
+    }
+}
+
+/** sum over rows [row_0, row_1] and columns [col_0, col_1], both inside the grid **/
+void SphericalNormalEstimation::rectSum(int row_0, int row_1, int col_0, int col_1, double *sum) const {
+    const size_t kStride = (cols_ + 1) * kChannels;
+    const double *a = &integral_[size_t(row_1 + 1) * kStride + (col_1 + 1) * kChannels];
+    const double *b = &integral_[size_t(row_0) * kStride + (col_1 + 1) * kChannels];
+    const double *c = &integral_[size_t(row_1 + 1) * kStride + col_0 * kChannels];
+    const double *d = &integral_[size_t(row_0) * kStride + col_0 * kChannels];
+    for (int i = 0; i < kChannels; ++i) {
+        sum[i] += a[i] - b[i] - c[i] + d[i];
+    }
+}
+
+/** square window clamped at the poles and wrapped in azimuth **/
+void SphericalNormalEstimation::windowSum(int row, int col, int half_window, double *sum) const {
+    std::fill(sum, sum + kChannels, 0.0);
+    const int row_0 = std::max(0, row - half_window);
+    const int row_1 = std::min(rows_ - 1, row + half_window);
+    half_window = std::min(half_window, (cols_ - 1) / 2);
+    int col_0 = col - half_window;
+    int col_1 = col + half_window;
+    if (col_0 < 0) {
+        rectSum(row_0, row_1, col_0 + cols_, cols_ - 1, sum);
+        col_0 = 0;
+    }
+    if (col_1 >= cols_) {
+        rectSum(row_0, row_1, 0, col_1 - cols_, sum);
+        col_1 = cols_ - 1;
+    }
+    rectSum(row_0, row_1, col_0, col_1, sum);
+}
+
+/**
+ * Largest window that passes the gates: the range spread rejects windows across a depth discontinuity, the surface
+ * variation rejects windows with a few points of another surface. If no window is planar enough, the smallest one
+ * that passes the range gate is used, so corners still get a normal.
+ **/
+bool SphericalNormalEstimation::windowCovariance(int point_idx, Eigen::Matrix3d &covariance,
+                                                 Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> &solver) const {
+    const int row = point_rows_[point_idx];
+    const int col = point_cols_[point_idx];
+    if (row < 0) {
+        return false;
+    }
+    const double range = point_ranges_[point_idx];
+    const double max_spread = std::max(depth_tolerance_ * range, radius_);
+    int half_window = std::clamp(int(ceil(radius_ / (range * std::max(row_step_, col_step_)))), 1, max_half_window_);
+
+    bool found = false;
+    double m[kChannels];
+    for (; half_window >= 1; half_window /= 2) {
+        windowSum(row, col, half_window, m);
+        const double n = m[0];
+        if (n < 3) {
+            break;
+        }
+        const double mean_range = m[10] / n;
+        const double range_var = std::max(0.0, m[11] / n - mean_range * mean_range);
+        if (range_var > max_spread * max_spread) {
+            continue;
+        }
+        const Eigen::Vector3d mean(m[1] / n, m[2] / n, m[3] / n);
+        covariance << m[4], m[5], m[6],
+                      m[5], m[7], m[8],
+                      m[6], m[8], m[9];
+        covariance = covariance / n - mean * mean.transpose();
+        solver.computeDirect(covariance);
+        found = true;
+        const double eigen_sum = solver.eigenvalues().sum();
+        if (eigen_sum <= 0 || solver.eigenvalues()(0) / eigen_sum <= max_variation_) {
+            break;
+        }
+    }
+    return found;
+}
+
+void SphericalNormalEstimation::compute(pcl::PointCloud<pcl::Normal> &normals, Covariances *covariances) {
+    const int kNumPoints = cloud_->size();
+    const float kNaN = std::numeric_limits<float>::quiet_NaN();
+    normals.resize(kNumPoints);
+    if (covariances != nullptr) {
+        covariances->resize(kNumPoints);
+    }
+
+    #pragma omp parallel for num_threads(THREADS) schedule(dynamic, 1024)
+    for (int i = 0; i < kNumPoints; ++i) {
+        pcl::Normal &normal = normals.points[i];
+        Eigen::Matrix3d covariance;
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+        if (!windowCovariance(i, covariance, solver)) {
+            normal.normal_x = normal.normal_y = normal.normal_z = normal.curvature = kNaN;
+            if (covariances != nullptr) {
+                (*covariances)[i].setIdentity();
+            }
+            continue;
+        }
+        const Eigen::Vector3d &eigen_vals = solver.eigenvalues();
+        Eigen::Vector3d n = solver.eigenvectors().col(0);
+        const PointI &point = cloud_->points[i];
+        if (n.dot(Eigen::Vector3d(point.x, point.y, point.z)) > 0) {
+            n = -n;
+        }
+        normal.normal_x = n(0);
+        normal.normal_y = n(1);
+        normal.normal_z = n(2);
+        const double eigen_sum = eigen_vals.sum();
+        normal.curvature = (eigen_sum > 0) ? eigen_vals(0) / eigen_sum : 0;
+
+        if (covariances != nullptr) {
+            Eigen::Matrix3d eigen_vecs = solver.eigenvectors();
+            (*covariances)[i] = eigen_vecs * Eigen::Vector3d(gicp_epsilon_, 1, 1).asDiagonal() * eigen_vecs.transpose();
+        }
+    }
+    normals.width = kNumPoints;
+    normals.height = 1;
+    normals.is_dense = false;
+}
+
+void SphericalNormalEstimation::computeCovariances(Covariances &covariances) {
+    pcl::PointCloud<pcl::Normal> normals;
+    compute(normals, &covariances);
+}
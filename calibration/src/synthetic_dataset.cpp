@@ -0,0 +1,219 @@
+/** basic **/
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+/** ros **/
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <sensor_msgs/PointCloud2.h>
+/** pcl **/
+#include <pcl/io/pcd_io.h>
+#include <pcl/common/time.h>
+#include <pcl_conversions/pcl_conversions.h>
+/** opencv **/
+#include <opencv2/opencv.hpp>
+/** headings **/
+#include <define.h>
+#include <lidar_process.h>
+#include <omni_process.h>
+#include <synthetic_scene.h>
+#include "common_lib.h"
+
+using namespace std;
+
+/**
+ * Synthetic dataset in the layout of LidarProcess and OmniProcess: data/<dataset>/spot<i>/<angle>/ with the view bag,
+ * the fisheye image and optionally the view cloud, plus the ground truth the pipeline should recover:
+ *   data/<dataset>/ground_truth.txt                            rx ry rz tx ty tz u0 v0 a0 a1 a2 a3 a4 c d e
+ *   spot<i>/recon/gt_spot_trans_mat.txt                        spot i center view -> spot 0 center view
+ *   spot<i>/<angle>/outputs/lidar_outputs/gt_pose_trans_mat.txt  view -> center view of the spot
+ * Views follow the gimbal kinematics of GimbalRegistration: p_center = R(y, angle) (p_view - c) + c, c = (0, 0, -radius).
+ **/
+
+void writeTransMat(const string &path, const Mat4D &trans_mat) {
+    std::ofstream file(path);
+    file << trans_mat << endl;
+}
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "synthetic_dataset");
+    ros::NodeHandle nh;
+
+    /***** ROS Parameters Server *****/
+    string dataset_name = "synthetic";
+    int num_spots = 2;
+    double points_per_view = 2e6;
+    double spot_spacing = 4.0;
+    double range_noise = 0.01;
+    double image_noise = 2.0;
+    int seed = 1;
+    bool write_bag = true;
+    bool write_view_cloud = false;
+    nh.param<string>("synthetic/kDatasetName", dataset_name, "synthetic");
+    nh.param<int>("synthetic/kNumSpots", num_spots, 2);
+    nh.param<double>("synthetic/kPointsPerView", points_per_view, 2e6);
+    nh.param<double>("synthetic/kSpotSpacing", spot_spacing, 4.0);
+    nh.param<double>("synthetic/kRangeNoise", range_noise, 0.01);
+    nh.param<double>("synthetic/kImageNoise", image_noise, 2.0);
+    nh.param<int>("synthetic/kSeed", seed, 1);
+    nh.param<bool>("synthetic/kWriteBag", write_bag, true);
+    nh.param<bool>("synthetic/kWriteViewCloud", write_view_cloud, false);
+
+    /** the processes of the pipeline provide the folder layout and the view angles **/
+    LidarProcess::Config lidar_config = LidarProcess::paramServerConfig();
+    lidar_config.dataset_name = dataset_name;
+    lidar_config.num_spots = num_spots;
+    OmniProcess::Config omni_config = OmniProcess::paramServerConfig();
+    omni_config.dataset_name = dataset_name;
+    omni_config.num_spots = num_spots;
+    LidarProcess lidar(lidar_config);
+    OmniProcess omnicam(omni_config);
+
+    /** ground truth, within the dev bounds of params_init in main **/
+    std::vector<double> params_gt = {
+        M_PI + 0.01, -0.005, -M_PI/2 + 0.008, /** Rx Ry Rz **/
+        0.275, -0.01, 0.04, /** tx ty tz **/
+        1022.0, 1199.0, /** u0 v0 **/
+        616.7214056132 * M_PI, -616.7214056132, 2.0, -1.0, 0.2,
+        1.001, -0.004, 0.003 /** c, d, e **/
+    };
+    Ext_D ext_gt = Eigen::Map<Param_D>(params_gt.data()).head(6);
+    Int_D int_gt = Eigen::Map<Param_D>(params_gt.data()).tail(K_INT);
+    const Mat4D lidar_to_camera = transformMat(ext_gt);
+    const Mat4D camera_pose = lidar_to_camera.inverse(); /** camera in the lidar frame **/
+
+    /** spot poses in the world, spot 0 at the origin **/
+    std::vector<Mat4D> spot_poses(num_spots);
+    std::vector<Vec3D> spot_positions(num_spots);
+    for (int spot = 0; spot < num_spots; ++spot) {
+        spot_poses[spot] = Mat4D::Identity();
+        spot_poses[spot].topLeftCorner(3, 3) = Eigen::AngleAxisd(0.15 * spot, Vec3D::UnitZ()).toRotationMatrix();
+        spot_poses[spot].topRightCorner(3, 1) = Vec3D(spot_spacing * spot, 0.3 * (spot % 2), 0);
+        spot_positions[spot] = spot_poses[spot].topRightCorner(3, 1);
+    }
+    SyntheticScene scene = SyntheticScene::hall(spot_positions, seed);
+    if (MESSAGE_EN) {
+        ROS_INFO("Synthetic scene of %d primitives, %d spots x %d views x %.0f points.",
+                 scene.size(), num_spots, lidar.num_views, points_per_view);
+    }
+
+    /** folders, parents first **/
+    CheckFolder(lidar.kPkgPath + "/data");
+    CheckFolder(lidar.kDatasetPath);
+    std::ofstream gt_file(lidar.kDatasetPath + "/ground_truth.txt");
+    for (double param : params_gt) {
+        gt_file << std::setprecision(12) << param << " ";
+    }
+    gt_file << endl;
+
+    const Vec3D pivot(0, 0, -lidar.kGimbalRadius);
+    const int num_points = points_per_view;
+    const int num_frames = (num_points + Mid360Pattern::kPointsPerFrame - 1) / Mid360Pattern::kPointsPerFrame;
+    pcl::StopWatch timer;
+
+    for (int spot = 0; spot < num_spots; ++spot) {
+        const string spot_path = lidar.kDatasetPath + "/spot" + to_string(spot);
+        CheckFolder(spot_path);
+        CheckFolder(lidar.file_path_vec[spot][0].recon_folder_path);
+        writeTransMat(lidar.file_path_vec[spot][0].recon_folder_path + "/gt_spot_trans_mat.txt", spot_poses[spot]);
+
+        for (int view = 0; view < lidar.num_views; ++view) {
+            timer.reset();
+            const string folder_path = lidar.folder_path_vec[spot][view];
+            for (const string &sub_folder : {string(""), string("/bags"), string("/images"), string("/edges"),
+                                             string("/outputs"), string("/outputs/lidar_outputs"),
+                                             string("/outputs/omni_outputs"), string("/results")}) {
+                CheckFolder(folder_path + sub_folder);
+            }
+
+            /** view -> center view of the spot by the gimbal rotation about the pivot **/
+            Mat4D view_trans_mat = Mat4D::Identity();
+            const Mat3D R = Eigen::AngleAxisd(DEG2RAD(lidar.degree_map[view]), Vec3D::UnitY()).toRotationMatrix();
+            view_trans_mat.topLeftCorner(3, 3) = R;
+            view_trans_mat.topRightCorner(3, 1) = pivot - R * pivot;
+            writeTransMat(lidar.file_path_vec[spot][view].output_folder_path + "/gt_pose_trans_mat.txt", view_trans_mat);
+            const Mat4D view_pose = spot_poses[spot] * view_trans_mat;
+            const Mat3D view_rotation = view_pose.topLeftCorner(3, 3);
+            const Vec3D view_origin = view_pose.topRightCorner(3, 1);
+
+            /********* LiDAR scan, one message per 0.1 s frame *********/
+            rosbag::Bag bag;
+            if (write_bag) {
+                string bag_path = lidar.file_path_vec[spot][view].bag_folder_path
+                                + "/" + dataset_name + "_spot" + to_string(spot)
+                                + "_" + to_string(lidar.degree_map[view]) + ".bag";
+                bag.open(bag_path, rosbag::bagmode::Write);
+            }
+            CloudI::Ptr view_cloud(new CloudI);
+            const uint64_t view_key = (uint64_t(seed) << 40) + (uint64_t(spot * lidar.num_views + view) << 32);
+            const uint64_t pattern_offset = uint64_t(spot * lidar.num_views + view) * 7919 * seed;
+
+            for (int frame = 0; frame < num_frames; ++frame) {
+                const int begin = frame * Mid360Pattern::kPointsPerFrame;
+                const int end = std::min(num_points, begin + Mid360Pattern::kPointsPerFrame);
+                std::vector<PointI> points(end - begin);
+                std::vector<char> valid(end - begin, 0);
+
+                #pragma omp parallel for num_threads(THREADS)
+                for (int i = begin; i < end; ++i) {
+                    const Vec3D dir = Mid360Pattern::direction(pattern_offset + i);
+                    SceneHit hit;
+                    if (!scene.raycast(view_origin, view_rotation * dir, Mid360Pattern::kMaxRange, hit)) {
+                        continue;
+                    }
+                    const double range = hit.range + range_noise * hashNormal(view_key + 2 * i);
+                    if (range < Mid360Pattern::kMinRange) {
+                        continue;
+                    }
+                    const double incidence = fabs(hit.normal.dot(view_rotation * dir));
+                    const double reflectivity = 255 * hit.albedo * (0.5 + 0.5 * incidence) + 2 * hashNormal(view_key + 2 * i + 1);
+                    PointI &point = points[i - begin];
+                    point.x = dir(0) * range;
+                    point.y = dir(1) * range;
+                    point.z = dir(2) * range;
+                    point.intensity = std::min(255.0, std::max(0.0, reflectivity));
+                    valid[i - begin] = 1;
+                }
+
+                CloudI frame_cloud;
+                for (int i = 0; i < points.size(); ++i) {
+                    if (valid[i]) {
+                        frame_cloud.points.push_back(points[i]);
+                    }
+                }
+                frame_cloud.width = frame_cloud.points.size();
+                frame_cloud.height = 1;
+                if (write_bag) {
+                    sensor_msgs::PointCloud2 msg;
+                    pcl::toROSMsg(frame_cloud, msg);
+                    msg.header.frame_id = "livox_frame";
+                    msg.header.stamp = ros::Time(1.0 + 0.1 * frame);
+                    bag.write(lidar.topic_name, msg.header.stamp, msg);
+                }
+                if (write_view_cloud) {
+                    *view_cloud += frame_cloud;
+                }
+            }
+            if (write_bag) {
+                bag.close();
+            }
+            if (write_view_cloud) {
+                pcl::io::savePCDFileBinary(lidar.file_path_vec[spot][view].view_cloud_path, *view_cloud);
+            }
+
+            /********* Fisheye image of the view, the camera is rigid with the lidar on the gimbal *********/
+            cv::Mat image = renderFisheye(scene, int_gt, view_pose * camera_pose,
+                                          omnicam.kImageSize.first, omnicam.kImageSize.second,
+                                          DEG2RAD(95), image_noise, seed + spot * lidar.num_views + view);
+            cv::imwrite(omnicam.file_path_vec[spot][view].hdr_img_path, image);
+
+            if (MESSAGE_EN) {
+                ROS_INFO("Spot %d view %d (%d deg): %d frames and the fisheye image in %f s.",
+                         spot, view, lidar.degree_map[view], num_frames, timer.getTimeSeconds());
+            }
+        }
+    }
+    return 0;
+}
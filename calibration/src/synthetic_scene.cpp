@@ -0,0 +1,233 @@
+/** headings **/
+#include <synthetic_scene.h>
+/** basic **/
+#include <algorithm>
+#include <limits>
+#include <random>
+/** openmp **/
+#include <omp.h>
+
+using namespace std;
+
+void SyntheticScene::addBox(const Vec3D &lo, const Vec3D &hi, const SceneMaterial &material, bool inside) {
+    boxes_.push_back({lo, hi, material, inside});
+}
+
+void SyntheticScene::addRect(const Vec3D &center, const Vec3D &axis_u, const Vec3D &axis_v,
+                             double half_u, double half_v, const SceneMaterial &material) {
+    Vec3D u = axis_u.normalized();
+    Vec3D v = axis_v.normalized();
+    rects_.push_back({center, u, v, u.cross(v).normalized(), half_u, half_v, material});
+}
+
+double SyntheticScene::textured(const SceneMaterial &material, double s, double t) {
+    const double size = material.texture_size;
+    switch (material.texture) {
+        case TEXTURE_CHECKER: {
+            const long parity = long(floor(s / size)) + long(floor(t / size));
+            return (parity & 1) ? material.albedo : 0.25 * material.albedo;
+        }
+        case TEXTURE_STRIPES:
+            return (long(floor(s / size)) & 1) ? material.albedo : 0.4 * material.albedo;
+        default:
+            return material.albedo;
+    }
+}
+
+bool SyntheticScene::raycast(const Vec3D &origin, const Vec3D &dir, double max_range, SceneHit &hit) const {
+    hit.range = max_range;
+    bool found = false;
+
+    /** slab test, an inside box is hit where the ray leaves it **/
+    for (const Box &box : boxes_) {
+        double t_near = -std::numeric_limits<double>::max();
+        double t_far = std::numeric_limits<double>::max();
+        int axis_near = 0, axis_far = 0;
+        bool miss = false;
+        for (int k = 0; k < 3 && !miss; ++k) {
+            if (fabs(dir(k)) < 1e-12) {
+                miss = (origin(k) < box.lo(k) || origin(k) > box.hi(k));
+                continue;
+            }
+            double t0 = (box.lo(k) - origin(k)) / dir(k);
+            double t1 = (box.hi(k) - origin(k)) / dir(k);
+            if (t0 > t1) {
+                std::swap(t0, t1);
+            }
+            if (t0 > t_near) {
+                t_near = t0;
+                axis_near = k;
+            }
+            if (t1 < t_far) {
+                t_far = t1;
+                axis_far = k;
+            }
+        }
+        if (miss || t_near > t_far) {
+            continue;
+        }
+        const double t = box.inside ? t_far : t_near;
+        const int axis = box.inside ? axis_far : axis_near;
+        if (t <= 0 || t >= hit.range) {
+            continue;
+        }
+        hit.range = t;
+        hit.point = origin + t * dir;
+        hit.normal = Vec3D::Zero();
+        hit.normal(axis) = (dir(axis) > 0) ? -1 : 1;
+        hit.albedo = textured(box.material, hit.point((axis + 1) % 3), hit.point((axis + 2) % 3));
+        found = true;
+    }
+
+    for (const Rect &rect : rects_) {
+        const double denom = rect.normal.dot(dir);
+        if (fabs(denom) < 1e-12) {
+            continue;
+        }
+        const double t = rect.normal.dot(rect.center - origin) / denom;
+        if (t <= 0 || t >= hit.range) {
+            continue;
+        }
+        const Vec3D point = origin + t * dir;
+        const double s = rect.axis_u.dot(point - rect.center);
+        const double r = rect.axis_v.dot(point - rect.center);
+        if (fabs(s) > rect.half_u || fabs(r) > rect.half_v) {
+            continue;
+        }
+        hit.range = t;
+        hit.point = point;
+        hit.normal = (denom > 0) ? Vec3D(-rect.normal) : rect.normal;
+        hit.albedo = textured(rect.material, s, r);
+        found = true;
+    }
+    return found;
+}
+
+SyntheticScene SyntheticScene::hall(const std::vector<Vec3D> &spot_positions, unsigned int seed) {
+    SyntheticScene scene;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    Vec3D lo = spot_positions.front(), hi = spot_positions.front();
+    for (const Vec3D &spot : spot_positions) {
+        lo = lo.cwiseMin(spot);
+        hi = hi.cwiseMax(spot);
+    }
+    /** sensor about 1.2 m above the floor, walls 8-12 m away from the spots **/
+    const Vec3D room_lo(lo(0) - 10, lo(1) - 8, lo(2) - 1.2);
+    const Vec3D room_hi(hi(0) + 12, hi(1) + 9, lo(2) + 4.5);
+    scene.addBox(room_lo, room_hi, {0.6, TEXTURE_STRIPES, 0.8}, true);
+
+    /** boxes and free standing panels, at least 2 m from every spot so no view is blocked completely **/
+    auto clear = [&](const Vec3D &center, double radius) {
+        for (const Vec3D &spot : spot_positions) {
+            if ((center - spot).head(2).norm() < radius + 2.0) {
+                return false;
+            }
+        }
+        return true;
+    };
+    const int kNumBoxes = 12 + 4 * spot_positions.size();
+    for (int i = 0, tries = 0; i < kNumBoxes && tries < 100 * kNumBoxes; ++tries) {
+        const Vec3D size(0.4 + 1.6 * uniform(rng), 0.4 + 1.6 * uniform(rng), 0.4 + 2.0 * uniform(rng));
+        const Vec3D center(room_lo(0) + 1 + (room_hi(0) - room_lo(0) - 2) * uniform(rng),
+                           room_lo(1) + 1 + (room_hi(1) - room_lo(1) - 2) * uniform(rng),
+                           room_lo(2) + size(2) / 2);
+        if (!clear(center, size.head(2).norm() / 2)) {
+            continue;
+        }
+        const SceneMaterial material = {0.2 + 0.7 * uniform(rng), TextureType(i % 3), 0.1 + 0.3 * uniform(rng)};
+        scene.addBox(center - size / 2, center + size / 2, material);
+        ++i;
+    }
+    const int kNumPanels = 4 + 2 * spot_positions.size();
+    for (int i = 0, tries = 0; i < kNumPanels && tries < 100 * kNumPanels; ++tries) {
+        const double half_u = 0.5 + uniform(rng), half_v = 0.4 + 0.8 * uniform(rng);
+        const double yaw = M_PI * uniform(rng), tilt = 0.3 * (uniform(rng) - 0.5);
+        const Vec3D center(room_lo(0) + 1 + (room_hi(0) - room_lo(0) - 2) * uniform(rng),
+                           room_lo(1) + 1 + (room_hi(1) - room_lo(1) - 2) * uniform(rng),
+                           room_lo(2) + half_v + 0.5 * uniform(rng));
+        if (!clear(center, half_u)) {
+            continue;
+        }
+        const Vec3D axis_u(cos(yaw), sin(yaw), 0);
+        const Vec3D axis_v(-sin(yaw) * sin(tilt), cos(yaw) * sin(tilt), cos(tilt));
+        scene.addRect(center, axis_u, axis_v, half_u, half_v, {0.3 + 0.6 * uniform(rng), TEXTURE_CHECKER, 0.15});
+        ++i;
+    }
+    return scene;
+}
+
+double hashNormal(uint64_t key) {
+    /** splitmix64 for two uniforms, box-muller for the normal **/
+    auto mix = [](uint64_t z) {
+        z += 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    };
+    const uint64_t a = mix(key), b = mix(a);
+    const double u1 = ((a >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+    const double u2 = (b >> 11) * (1.0 / 9007199254740992.0);
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+cv::Mat renderFisheye(const SyntheticScene &scene, const Int_D &intrinsic, const Mat4D &camera_pose,
+                      int rows, int cols, double max_theta, double noise, unsigned int seed) {
+    const double u0 = intrinsic(0), v0 = intrinsic(1);
+    auto polynomial = [&](double theta) {
+        return intrinsic(2) + theta * (intrinsic(3) + theta * (intrinsic(4) + theta * (intrinsic(5) + theta * intrinsic(6))));
+    };
+
+    /** radius as a function of the angle to the optical axis, sampled until it stops growing **/
+    const int kTableSize = 4096;
+    std::vector<double> radius_table, angle_table;
+    for (int i = 0; i <= kTableSize; ++i) {
+        const double angle = max_theta * i / kTableSize;
+        const double radius = polynomial(M_PI - angle);
+        if (!radius_table.empty() && radius <= radius_table.back()) {
+            break;
+        }
+        radius_table.push_back(radius);
+        angle_table.push_back(angle);
+    }
+
+    const Mat3D R = camera_pose.topLeftCorner(3, 3);
+    const Vec3D origin = camera_pose.topRightCorner(3, 1);
+    const Vec3D light = Vec3D(0.3, 0.2, 1.0).normalized();
+    const double c = intrinsic(7), d = intrinsic(8), e = intrinsic(9);
+    cv::Mat image = cv::Mat::zeros(rows, cols, CV_8UC3);
+
+    #pragma omp parallel for num_threads(THREADS) schedule(dynamic, 16)
+    for (int u = 0; u < rows; ++u) {
+        for (int v = 0; v < cols; ++v) {
+            /** forward model: (u, v) = affine^-1 (pu, pv), so (pu, pv) = affine (u, v) **/
+            const double du = c * u + d * v - u0;
+            const double dv = e * u + v - v0;
+            const double radius = sqrt(du * du + dv * dv);
+            if (radius > radius_table.back()) {
+                continue;
+            }
+            const int idx = std::min<int>(radius_table.size() - 1,
+                    std::upper_bound(radius_table.begin(), radius_table.end(), radius) - radius_table.begin());
+            double angle = 0;
+            if (idx > 0) {
+                const double w = (radius - radius_table[idx - 1]) / (radius_table[idx] - radius_table[idx - 1]);
+                angle = angle_table[idx - 1] + w * (angle_table[idx] - angle_table[idx - 1]);
+            }
+            const double theta = M_PI - angle;
+            const double rho = std::max(radius, 1e-9);
+            const Vec3D ray(sin(theta) * du / rho, sin(theta) * dv / rho, cos(theta));
+
+            SceneHit hit;
+            if (!scene.raycast(origin, R * ray, Mid360Pattern::kMaxRange * 2, hit)) {
+                continue;
+            }
+            const double shading = 0.35 + 0.65 * std::max(0.0, hit.normal.dot(light));
+            const double gray = 255 * hit.albedo * shading + noise * hashNormal((uint64_t(seed) << 32) + u * cols + v);
+            const uchar level = cv::saturate_cast<uchar>(gray);
+            image.at<cv::Vec3b>(u, v) = cv::Vec3b(level, level, level);
+        }
+    }
+    return image;
+}
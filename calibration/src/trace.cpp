@@ -0,0 +1,213 @@
+/** headings **/
+#include <trace.h>
+/** basic **/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sys/stat.h>
+
+using namespace std;
+
+static std::atomic<int> next_thread_id {0};
+static thread_local int span_depth = 0;
+static thread_local TraceSpan *current_span = nullptr;
+
+Tracer::Tracer() : origin_(std::chrono::steady_clock::now()) {}
+
+Tracer &Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::enable(const std::string &trace_path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        trace_path_ = trace_path;
+        enable_us_ = nowUs();
+        enable_tid_ = threadId();
+    }
+    if (!enabled_.exchange(true)) {
+        /** the tracer is constructed before the handler is registered, so it is still alive when it runs **/
+        std::atexit([]() { Tracer::instance().finish(); });
+    }
+}
+
+double Tracer::nowUs() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin_).count();
+}
+
+void Tracer::record(TraceEvent &&event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(std::move(event));
+}
+
+int Tracer::threadId() {
+    static thread_local int id = next_thread_id++;
+    return id;
+}
+
+void Tracer::writeTrace(const std::string &path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        fprintf(stderr, "Trace file %s can not be written.\n", path.c_str());
+        return;
+    }
+    int max_tid = 0;
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    file << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"calibration\"}}";
+    for (const TraceEvent &event : events_) {
+        max_tid = std::max(max_tid, event.tid);
+        file << ",\n  {\"name\": \"" << event.name << "\", \"cat\": \"stage\", \"ph\": \"X\", \"pid\": 1"
+             << ", \"tid\": " << event.tid << ", \"ts\": " << (long long)event.start_us
+             << ", \"dur\": " << (long long)event.dur_us
+             << ", \"args\": {\"spot\": " << event.spot << ", \"view\": " << event.view
+             << ", \"points_in\": " << event.points_in << ", \"points_out\": " << event.points_out
+             << ", \"bytes_read\": " << event.bytes_read << ", \"bytes_written\": " << event.bytes_written
+             << ", \"hwm_mb\": " << event.hwm_kb / 1024.0 << "}}";
+        /** memory as a counter track, sampled where the spans close **/
+        file << ",\n  {\"name\": \"memory\", \"ph\": \"C\", \"pid\": 1, \"ts\": "
+             << (long long)(event.start_us + event.dur_us)
+             << ", \"args\": {\"rss_mb\": " << event.rss_kb / 1024.0 << ", \"hwm_mb\": " << event.hwm_kb / 1024.0 << "}}";
+    }
+    for (int tid = 0; tid <= max_tid; ++tid) {
+        file << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+             << ", \"args\": {\"name\": \"thread " << tid << "\"}}";
+    }
+    file << "\n]}\n";
+}
+
+void Tracer::printSummary() const {
+    struct Row {
+        int calls = 0;
+        double total_us = 0;
+        double max_us = 0;
+        long points_in = 0;
+        long points_out = 0;
+        long bytes_read = 0;
+        long bytes_written = 0;
+    };
+    std::map<string, Row> stages;
+    std::map<int, double> spots; /** outermost spans of the enabling thread, the others are part of them **/
+    long peak_kb = 0;
+    double wall_us = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const TraceEvent &event : events_) {
+            Row &row = stages[event.name];
+            row.calls++;
+            row.total_us += event.dur_us;
+            row.max_us = std::max(row.max_us, event.dur_us);
+            row.points_in += event.points_in;
+            row.points_out += event.points_out;
+            row.bytes_read += event.bytes_read;
+            row.bytes_written += event.bytes_written;
+            if (event.depth == 0 && event.tid == enable_tid_) {
+                spots[event.spot] += event.dur_us;
+            }
+            peak_kb = std::max(peak_kb, event.hwm_kb);
+        }
+        wall_us = nowUs() - enable_us_;
+    }
+    std::vector<std::pair<string, Row>> rows(stages.begin(), stages.end());
+    std::sort(rows.begin(), rows.end(), [](const std::pair<string, Row> &a, const std::pair<string, Row> &b) {
+        return a.second.total_us > b.second.total_us;
+    });
+
+    printf("----------------- Trace Summary ---------------------\n");
+    printf("%-36s %7s %12s %10s %10s %7s %12s %12s %10s %10s\n", "stage", "calls", "total [s]", "mean [s]", "max [s]",
+           "wall %", "points in", "points out", "read [MB]", "write [MB]");
+    for (const auto &entry : rows) {
+        const Row &row = entry.second;
+        printf("%-36s %7d %12.3f %10.3f %10.3f %7.1f %12ld %12ld %10.1f %10.1f\n", entry.first.c_str(), row.calls,
+               row.total_us * 1e-6, row.total_us * 1e-6 / row.calls, row.max_us * 1e-6,
+               (wall_us > 0) ? 100 * row.total_us / wall_us : 0.0, row.points_in, row.points_out,
+               row.bytes_read / 1048576.0, row.bytes_written / 1048576.0);
+    }
+    for (const auto &entry : spots) {
+        if (entry.first < 0) {
+            printf("no spot: %.3f s\n", entry.second * 1e-6);
+        }
+        else {
+            printf("spot %d: %.3f s\n", entry.first, entry.second * 1e-6);
+        }
+    }
+    printf("wall time %.3f s, memory high-water %.1f MB\n", wall_us * 1e-6, peak_kb / 1024.0);
+}
+
+void Tracer::finish() {
+    if (!enabled() || finished_) {
+        return;
+    }
+    finished_ = true;
+    enabled_ = false;
+    if (!trace_path_.empty()) {
+        writeTrace(trace_path_);
+        printf("Trace of %ld spans written to %s\n", events_.size(), trace_path_.c_str());
+    }
+    printSummary();
+}
+
+TraceSpan::TraceSpan(const char *name, int spot, int view) : active_(Tracer::instance().enabled()) {
+    if (!active_) {
+        return;
+    }
+    event_.name = name;
+    event_.spot = spot;
+    event_.view = view;
+    event_.tid = Tracer::threadId();
+    event_.depth = span_depth++;
+    parent_ = current_span;
+    current_span = this;
+    event_.start_us = Tracer::instance().nowUs();
+}
+
+TraceSpan::~TraceSpan() {
+    if (!active_) {
+        return;
+    }
+    span_depth--;
+    current_span = parent_;
+    Tracer &tracer = Tracer::instance();
+    event_.dur_us = tracer.nowUs() - event_.start_us;
+    processMemory(event_.rss_kb, event_.hwm_kb);
+    tracer.record(std::move(event_));
+}
+
+TraceSpan *TraceSpan::current() {
+    return current_span;
+}
+
+void traceFileRead(const std::string &path) {
+    if (current_span) {
+        current_span->bytesRead(fileBytes(path));
+    }
+}
+
+void traceFileWritten(const std::string &path) {
+    if (current_span) {
+        current_span->bytesWritten(fileBytes(path));
+    }
+}
+
+long fileBytes(const std::string &path) {
+    struct stat info;
+    return (stat(path.c_str(), &info) == 0) ? long(info.st_size) : 0;
+}
+
+void processMemory(long &rss_kb, long &hwm_kb) {
+    rss_kb = 0;
+    hwm_kb = 0;
+    std::ifstream status("/proc/self/status");
+    string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            rss_kb = atol(line.c_str() + 6);
+        }
+        else if (line.compare(0, 6, "VmHWM:") == 0) {
+            hwm_kb = atol(line.c_str() + 6);
+        }
+    }
+}